@@ -0,0 +1,529 @@
+// Замеры хост-модема: прошивка в процессе, терминал на псевдотерминале,
+// сервер на 127.0.0.1. Числа сравнимы только между прогонами на одной
+// машине - это поиск регрессий, а не цифры платы.
+//
+//   bench [раздел...]   без аргументов - все разделы
+//
+// Результаты - в stdout; в корне репозитория принято класть их в
+// bench_output.txt.
+
+#include "harness.h"
+
+#include <charset.h>
+#include <host.h>
+#include <modem_core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+static const size_t BENCH_BYTES = 8 * 1024 * 1024;
+
+static Terminal *term;
+
+// Печатный текст без 0xFF и '+': не мешает ни telnet, ни +++
+static std::vector<uint8_t> textPayload(size_t n) {
+  std::vector<uint8_t> data(n);
+  for (size_t i = 0; i < n; i++) data[i] = (i % 80 == 79) ? '\n' : 'A' + (i * 7) % 26;
+  return data;
+}
+
+static double mbPerSec(size_t bytes, unsigned long us) {
+  return us ? bytes / (double)us : 0; // байт/мкс = МБ/с
+}
+
+// Терминал -> сеть: сервер считает байты, в конце - PKT/KB из ATI
+static void benchUpload() {
+  std::atomic<size_t> received{0};
+  TcpServer sink([&](int fd) {
+    char buf[16384];
+    for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) break;
+      received += n;
+    }
+  });
+  if (!dialLocal(*term, sink.port())) {
+    printf("upload: no CONNECT\n");
+    return;
+  }
+  std::vector<uint8_t> data = textPayload(BENCH_BYTES);
+  unsigned long started = micros();
+  term->write(data.data(), data.size());
+  while (received < data.size() && micros() - started < 60000000UL) usleep(1000);
+  unsigned long took = micros() - started;
+
+  usleep(1100000);
+  term->write("+++");
+  term->expect("OK", 3000);
+  std::string info = term->command("ATI");
+  printf("upload:    %6.2f MB/s, %ld PKT/KB, %zu of %zu bytes\n", mbPerSec(received, took),
+         reportValue(info, "TX:", "PKT/KB"), (size_t)received, data.size());
+  term->write("ATH\r");
+  term->expect("NO CARRIER");
+  term->drain(50);
+}
+
+// Для сравнения - насос до кольцевых буферов: байт из Serial, send() на
+// каждый байт при TCP_NODELAY. Свой псевдотерминал, прошивка не участвует.
+static void benchUploadLegacy() {
+  const size_t bytes = 1024 * 1024;
+  std::atomic<size_t> received{0};
+  TcpServer sink([&](int fd) {
+    char buf[16384];
+    for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) break;
+      received += n;
+    }
+  });
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  grantpt(master);
+  unlockpt(master);
+  int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  struct termios tio;
+  tcgetattr(slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  int sock = tcpConnect(sink.port());
+  int one = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  std::atomic<bool> running{true};
+  std::atomic<size_t> writes{0};
+  std::thread oldLoop([&] {
+    uint8_t c;
+    while (running) {
+      if (read(master, &c, 1) == 1) { // Serial.read()
+        send(sock, &c, 1, 0);          // tcpClient.write(c)
+        writes++;
+      }
+    }
+  });
+
+  std::vector<uint8_t> data = textPayload(bytes);
+  unsigned long started = micros();
+  std::thread writer([&] { write(slave, data.data(), data.size()); });
+  while (received < bytes && micros() - started < 60000000UL) usleep(1000);
+  unsigned long took = micros() - started;
+  printf("legacy:    %6.2f MB/s, %zu PKT/KB, %zu of %zu bytes (per-byte loop)\n", mbPerSec(received, took),
+         received ? writes * 1024 / received : 0, (size_t)received, bytes);
+
+  writer.join();
+  running = false;
+  close(slave); // read() в потоке вернет ошибку
+  oldLoop.join();
+  close(master);
+  close(sock);
+}
+
+// Сеть -> терминал: МБ/с или -1 без CONNECT, got - сколько байт дошло
+static double downloadRate(size_t bytes, size_t &got) {
+  std::vector<uint8_t> data = textPayload(bytes);
+  TcpServer source([&](int fd) {
+    sendAll(fd, data.data(), data.size());
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {} // до отбоя, +++ тоже приходит сюда
+  });
+  got = 0;
+  if (!dialLocal(*term, source.port())) return -1;
+  std::vector<uint8_t> buf(65536);
+  unsigned long started = micros();
+  while (got < data.size()) {
+    size_t n = term->read(buf.data(), buf.size(), 2000);
+    if (n == 0) break;
+    got += n;
+  }
+  unsigned long took = micros() - started;
+  hangUp(*term);
+  return mbPerSec(got, took);
+}
+
+static void benchDownload() {
+  size_t got;
+  double rate = downloadRate(BENCH_BYTES, got);
+  if (rate < 0) printf("download: no CONNECT\n");
+  else printf("download:  %6.2f MB/s, %zu of %zu bytes\n", rate, got, BENCH_BYTES);
+}
+
+// Эхо одного символа: терминал -> модем -> эхо-сервер -> модем -> терминал
+static void benchEcho() {
+  TcpServer echo(echoHandler);
+  if (!dialLocal(*term, echo.port())) {
+    printf("echo: no CONNECT\n");
+    return;
+  }
+  std::vector<unsigned long> samples;
+  for (int i = 0; i < 500; i++) {
+    char c = 'a' + i % 26, back = 0;
+    unsigned long started = micros();
+    term->write(&c, 1);
+    if (term->read(&back, 1, 1000) != 1 || back != c) break;
+    samples.push_back(micros() - started);
+  }
+  std::sort(samples.begin(), samples.end());
+  if (samples.empty()) {
+    printf("echo: no reply\n");
+  } else {
+    printf("echo:      p50 %lu us, p99 %lu us, max %lu us, n=%zu\n", samples[samples.size() / 2],
+           samples[samples.size() * 99 / 100], samples.back(), samples.size());
+  }
+  hangUp(*term);
+}
+
+// Команды подряд без ожидания ответа: разбор ограничивает только loop()
+static void benchCommands() {
+  const int count = 2000;
+  term->command("ATE0");
+  std::string batch;
+  for (int i = 0; i < count; i++) batch += "ATS7=30S0=0V1\r";
+  unsigned long started = micros();
+  std::thread writer([&] { term->write(batch); });
+  int seen = 0;
+  std::string tail;
+  char buf[4096];
+  while (seen < count) {
+    size_t n = term->read(buf, sizeof(buf), 2000);
+    if (n == 0) break;
+    tail.append(buf, n);
+    size_t at;
+    while ((at = tail.find("OK\r\n")) != std::string::npos) {
+      seen++;
+      tail.erase(0, at + 4);
+    }
+  }
+  unsigned long took = micros() - started;
+  writer.join();
+  printf("commands:  %6.0f lines/s (3 commands per line), %d of %d\n", seen * 1e6 / took, seen, count);
+  term->command("ATE1");
+}
+
+// Кольцо между задачами: SpscRing без блокировок против RingBuffer под
+// мьютексом, как было до разделения serialTask и netTask. Прошивка не
+// участвует; блоки по 512 байт - типичный кусок из USB.
+template <class Ring, class Lock>
+static double ringMbPerSec(Ring &ring, Lock &lock) {
+  const size_t total = 256 * 1024 * 1024;
+  std::thread writer([&] {
+    uint8_t chunk[512] = {};
+    size_t sent = 0;
+    while (sent < total) {
+      size_t n;
+      {
+        std::lock_guard<Lock> guard(lock);
+        n = ring.write(chunk, sizeof(chunk));
+      }
+      if (n == 0) std::this_thread::yield();
+      sent += n;
+    }
+  });
+  size_t got = 0;
+  unsigned long started = micros();
+  while (got < total) {
+    size_t len;
+    {
+      std::lock_guard<Lock> guard(lock);
+      ring.readPtr(len);
+      ring.consume(len);
+    }
+    if (len == 0) std::this_thread::yield();
+    got += len;
+  }
+  unsigned long took = micros() - started;
+  writer.join();
+  return mbPerSec(total, took);
+}
+
+struct NoLock {
+  void lock() {}
+  void unlock() {}
+};
+
+static void benchRing() {
+  static SpscRing<16384> spsc;
+  static RingBuffer<16384> plain;
+  NoLock none;
+  std::mutex mutex;
+  double lockFree = ringMbPerSec(spsc, none);
+  double locked = ringMbPerSec(plain, mutex);
+  printf("ring:      SpscRing %.0f MB/s, RingBuffer+mutex %.0f MB/s\n", lockFree, locked);
+}
+
+// Перекодировка блоками по 4 КБ, как в насосе: мкс на мегабайт в каждую
+// сторону. Текст - ANSI-графика: половина байт выше 0x7F.
+static void benchCharset() {
+  const size_t total = 16 * 1024 * 1024, block = 4096;
+  std::vector<uint8_t> in(block), mid(block * 3), out(block * 3);
+  for (size_t i = 0; i < block; i++) in[i] = (i & 1) ? 0xB0 + i % 32 : 'A' + i % 26;
+  static const char *const names[CS_COUNT] = {"", "PETSCII", "ATASCII", "CP437 <> UTF-8"};
+  CharsetTranslator t;
+  for (int cs = CS_PETSCII; cs < CS_COUNT; cs++) {
+    unsigned long started = micros();
+    size_t produced = 0;
+    for (size_t done = 0; done < total; done += block) {
+      size_t consumed;
+      produced += CharsetTranslator::toTerminal((Charset)cs, in.data(), block, mid.data(), mid.size(), consumed);
+    }
+    unsigned long toUs = micros() - started;
+    size_t consumed;
+    size_t midLen = CharsetTranslator::toTerminal((Charset)cs, in.data(), block, mid.data(), mid.size(), consumed);
+    started = micros();
+    for (size_t done = 0; done < total; done += block) t.fromTerminal((Charset)cs, mid.data(), midLen, out.data());
+    unsigned long fromUs = micros() - started;
+    printf("charset:   %-14s to terminal %5lu us/MB, from terminal %5lu us/MB (%zu bytes out)\n", names[cs],
+           toUs * 1024 * 1024 / total, fromUs * 1024 * 1024 / total, produced);
+  }
+}
+
+// Передача файла: заголовок ZRQINIT, дальше двоичные данные со всеми
+// значениями байт, 0xFF и '+' тоже. Насос должен узнать ZMODEM и пропускать
+// поток без перекодировки и без поиска +++.
+static std::vector<uint8_t> zmodemStream(size_t n) {
+  static const char zrqinit[] = "**\x18" "B00000000000000\r\n";
+  std::vector<uint8_t> data(zrqinit, zrqinit + sizeof(zrqinit) - 1);
+  uint32_t x = 1;
+  while (data.size() < n) {
+    x = x * 1103515245 + 12345;
+    data.push_back(x >> 23);
+  }
+  return data;
+}
+
+// Передача закончена (пауза XFER_IDLE_MS) - строка LAST TRANSFER из ATI
+static std::string lastTransfer() {
+  usleep(3200000);
+  term->write("+++");
+  term->expect("OK", 3000);
+  term->write("ATI\r");
+  std::string info = term->drain(300);
+  size_t at = info.find("LAST TRANSFER:");
+  std::string line = at == std::string::npos ? "no transfer seen" : info.substr(at, info.find('\r', at) - at);
+  term->write("ATH\r");
+  term->expect("NO CARRIER");
+  term->drain(50);
+  return line;
+}
+
+static void benchTransferDown(const std::vector<uint8_t> &data) {
+  TcpServer source([&](int fd) {
+    sendAll(fd, data.data(), data.size());
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+  if (!dialLocal(*term, source.port())) {
+    printf("transfer: no CONNECT\n");
+    return;
+  }
+  std::vector<uint8_t> buf(65536);
+  size_t got = 0;
+  bool same = true;
+  unsigned long started = micros();
+  while (got < data.size()) {
+    size_t n = term->read(buf.data(), buf.size(), 2000);
+    if (n == 0) break;
+    same = same && got + n <= data.size() && memcmp(buf.data(), data.data() + got, n) == 0;
+    got += n;
+  }
+  unsigned long took = micros() - started;
+  printf("transfer:  down %6.2f MB/s, %zu of %zu bytes%s; %s\n", mbPerSec(got, took), got, data.size(),
+         same ? "" : " (CORRUPTED)", lastTransfer().c_str());
+}
+
+static void benchTransferUp(const std::vector<uint8_t> &data) {
+  std::atomic<size_t> received{0};
+  std::atomic<bool> same{true};
+  TcpServer sink([&](int fd) {
+    std::vector<uint8_t> buf(65536);
+    for (;;) {
+      ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+      if (n <= 0) break;
+      size_t at = received;
+      if (at + n <= data.size() && memcmp(buf.data(), data.data() + at, n) != 0) same = false;
+      received += n;
+    }
+  });
+  if (!dialLocal(*term, sink.port())) {
+    printf("transfer: no CONNECT\n");
+    return;
+  }
+  unsigned long started = micros();
+  std::thread writer([&] { term->write(data.data(), data.size()); });
+  while (received < data.size() && micros() - started < 60000000UL) usleep(1000);
+  unsigned long took = micros() - started;
+  writer.join();
+  size_t got = std::min((size_t)received, data.size()); // +++ при отбое тоже приходит
+  printf("transfer:  up   %6.2f MB/s, %zu of %zu bytes%s; %s\n", mbPerSec(got, took), got, data.size(),
+         same ? "" : " (CORRUPTED)", lastTransfer().c_str());
+}
+
+static bool onPath(const char *name) {
+  std::string cmd = std::string("command -v ") + name + " >/dev/null 2>&1";
+  return system(cmd.c_str()) == 0;
+}
+
+// Настоящий sz на терминале и rz на сервере - только если lrzsz установлен
+static void benchLrzsz() {
+  if (!onPath("sz") || !onPath("rz")) {
+    printf("transfer:  sz/rz not on PATH, real ZMODEM run skipped\n");
+    return;
+  }
+  std::string dir = std::string(hostDataDir()) + "/lrzsz";
+  mkdir(dir.c_str(), 0755);
+  std::string src = dir + "/send.bin", dst = dir + "/in";
+  mkdir(dst.c_str(), 0755);
+  std::vector<uint8_t> data = zmodemStream(BENCH_BYTES);
+  FILE *fp = fopen(src.c_str(), "wb");
+  fwrite(data.data(), 1, data.size(), fp);
+  fclose(fp);
+
+  TcpServer receiver([&](int fd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      dup2(fd, 0);
+      dup2(fd, 1);
+      if (chdir(dst.c_str()) != 0) _exit(1);
+      execlp("rz", "rz", "-q", "-y", (char *)nullptr);
+      _exit(127);
+    }
+    waitpid(pid, nullptr, 0);
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+  if (!dialLocal(*term, receiver.port())) {
+    printf("transfer: no CONNECT\n");
+    return;
+  }
+  unsigned long started = micros();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int tty = open(hostSerialPath(), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    tcgetattr(tty, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(tty, TCSANOW, &tio);
+    dup2(tty, 0);
+    dup2(tty, 1);
+    execlp("sz", "sz", "-q", src.c_str(), (char *)nullptr);
+    _exit(127);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  unsigned long took = micros() - started;
+  struct stat st = {};
+  stat((dst + "/send.bin").c_str(), &st);
+  bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && (size_t)st.st_size == data.size();
+  printf("transfer:  sz   %6.2f MB/s, %zu of %zu bytes%s; %s\n", mbPerSec(st.st_size, took), (size_t)st.st_size,
+         data.size(), ok ? "" : " (FAILED)", lastTransfer().c_str());
+}
+
+static void benchTransfer() {
+  std::vector<uint8_t> data = zmodemStream(BENCH_BYTES);
+  benchTransferDown(data);
+  benchTransferUp(data);
+  benchLrzsz();
+}
+
+// Терминал -> сеть без отчета ATI: МБ/с или -1 без CONNECT
+static double uploadRate(size_t bytes, size_t &got) {
+  std::atomic<size_t> received{0};
+  TcpServer sink([&](int fd) {
+    char buf[16384];
+    for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) break;
+      received += n;
+    }
+  });
+  got = 0;
+  if (!dialLocal(*term, sink.port())) return -1;
+  std::vector<uint8_t> data = textPayload(bytes);
+  unsigned long started = micros();
+  term->write(data.data(), data.size());
+  while (received < data.size() && micros() - started < 60000000UL) usleep(1000);
+  unsigned long took = micros() - started;
+  got = std::min((size_t)received, bytes);
+  hangUp(*term);
+  return mbPerSec(got, took);
+}
+
+// Цена ATHEX для насоса: те же прием и передача без трассировки, с выводом
+// только в веб (3) и в файл (2). Без трассировки - в начале и в конце, чтобы
+// видеть разброс между прогонами. Счетчики ATHEX? накопительные - печатаем
+// разность за прогон: байты в кольце, байты, не влезшие в полное кольцо, и
+// время netTask на запись событий.
+static void benchTrace() {
+  static const struct {
+    int mode;
+    const char *name;
+  } modes[] = {{0, "off"}, {3, "web"}, {2, "file"}, {0, "off"}};
+  for (const auto &m : modes) {
+    if (term->command("ATHEX=" + std::to_string(m.mode)).find("OK") == std::string::npos) {
+      printf("trace:     %-4s ATHEX=%d refused\n", m.name, m.mode);
+      continue;
+    }
+    std::string before = term->command("ATHEX?");
+    size_t down, up;
+    double downRate = downloadRate(BENCH_BYTES, down);
+    double upRate = uploadRate(BENCH_BYTES, up);
+    std::string after = term->command("ATHEX?");
+    printf("trace:     %-4s down %6.2f MB/s, up %6.2f MB/s, %zu/%zu of %zu bytes", m.name, downRate, upRate,
+           down, up, BENCH_BYTES);
+    if (m.mode) {
+      auto delta = [&](const char *line, const char *label) {
+        return std::max(reportValue(after, line, label), 0L) - std::max(reportValue(before, line, label), 0L);
+      };
+      printf(", traced %ld, dropped %ld bytes, %ld us in netTask", delta("TRACE:", "BYTES"),
+             delta("TRACE:", "DROPPED"), delta("TRACE COST:", "US IN NET TASK"));
+    }
+    printf("\n");
+  }
+  term->command("ATHEX=0");
+}
+
+struct Section {
+  const char *name;
+  void (*fn)();
+};
+
+static const Section sections[] = {
+  {"upload", benchUpload},
+  {"legacy", benchUploadLegacy},
+  {"download", benchDownload},
+  {"echo", benchEcho},
+  {"commands", benchCommands},
+  {"ring", benchRing},
+  {"charset", benchCharset},
+  {"transfer", benchTransfer},
+  {"trace", benchTrace},
+};
+
+int main(int argc, char **argv) {
+  modemStart();
+  term = new Terminal;
+  term->drain(200);
+  term->command("AT");
+
+  for (const Section &s : sections) {
+    bool wanted = argc < 2;
+    for (int i = 1; i < argc; i++) wanted |= strcmp(argv[i], s.name) == 0;
+    if (wanted) {
+      s.fn();
+      fflush(stdout);
+    }
+  }
+  _exit(0);
+}
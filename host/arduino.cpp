@@ -0,0 +1,388 @@
+// Хост-сборка: время, Print, Serial на псевдотерминале, ESP, FreeRTOS на
+// потоках, аппаратный таймер
+
+#include <Arduino.h>
+#include <host.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+HWCDC Serial;
+HardwareSerial Serial1;
+EspClass ESP;
+
+// === ВРЕМЯ ===
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) {}
+int digitalRead(uint8_t pin) { return LOW; }
+
+uint32_t esp_random() {
+  static std::mutex lock;
+  static std::mt19937 gen{std::random_device{}()};
+  std::lock_guard<std::mutex> guard(lock);
+  return gen();
+}
+
+// === IPAddress / Print ===
+
+bool IPAddress::fromString(const char *s) {
+  unsigned a, b, c, d;
+  char tail;
+  if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4) return false;
+  if (a > 255 || b > 255 || c > 255 || d > 255) return false;
+  *this = IPAddress(a, b, c, d);
+  return true;
+}
+
+size_t Print::write(const uint8_t *buf, size_t n) {
+  size_t done = 0;
+  while (done < n && write(buf[done])) done++;
+  return done;
+}
+
+static const char *numberFormat(int base, bool isSigned) {
+  switch (base) {
+    case HEX: return "%lX";
+    case OCT: return "%lo";
+    default: return isSigned ? "%ld" : "%lu";
+  }
+}
+
+size_t Print::print(long v, int base) {
+  char buf[24];
+  int n = snprintf(buf, sizeof(buf), numberFormat(base, true), v);
+  return write((const uint8_t *)buf, n);
+}
+
+size_t Print::print(unsigned long v, int base) {
+  char buf[24];
+  int n = snprintf(buf, sizeof(buf), numberFormat(base, false), v);
+  return write((const uint8_t *)buf, n);
+}
+
+size_t Print::print(double v, int digits) {
+  char buf[48];
+  int n = snprintf(buf, sizeof(buf), "%.*f", digits, v);
+  return write((const uint8_t *)buf, n);
+}
+
+size_t Print::print(const IPAddress &ip) {
+  char buf[16];
+  int n = snprintf(buf, sizeof(buf), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return write((const uint8_t *)buf, n);
+}
+
+size_t Print::printf(const char *fmt, ...) {
+  char small[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(small, sizeof(small), fmt, args);
+  va_end(args);
+  if (n < 0) return 0;
+  if ((size_t)n < sizeof(small)) return write((const uint8_t *)small, n);
+
+  std::string big(n + 1, '\0');
+  va_start(args, fmt);
+  vsnprintf(&big[0], big.size(), fmt, args);
+  va_end(args);
+  return write((const uint8_t *)big.data(), n);
+}
+
+// === SERIAL ===
+
+// Запись из loop() и serialTask идет параллельно - по куску под замком
+static std::mutex serialWriteLock;
+
+// Как у HWCDC: запись ждет место не дольше tx_timeout (100 мс)
+static const int SERIAL_TX_TIMEOUT_MS = 100;
+
+void HWCDC::begin(unsigned long baud) {
+  if (fd_ >= 0) return;
+  fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd_ < 0 || grantpt(fd_) != 0 || unlockpt(fd_) != 0) {
+    perror("posix_openpt");
+    exit(1);
+  }
+  snprintf(path_, sizeof(path_), "%s", ptsname(fd_));
+  // Ведомая сторона держится открытой: без нее чтение дает EIO, а так
+  // неоткрытый терминал просто не забирает вывод - как USB без хоста
+  slave_ = open(path_, O_RDWR | O_NOCTTY);
+  struct termios tio;
+  tcgetattr(slave_, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slave_, TCSANOW, &tio);
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+}
+
+int HWCDC::available() {
+  int n = 0;
+  if (fd_ < 0 || ioctl(fd_, FIONREAD, &n) != 0) return 0;
+  return n;
+}
+
+int HWCDC::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t HWCDC::read(uint8_t *buf, size_t n) {
+  if (fd_ < 0) return 0;
+  ssize_t got = ::read(fd_, buf, n);
+  return got > 0 ? got : 0;
+}
+
+int HWCDC::availableForWrite() {
+  if (fd_ < 0) return 0;
+  struct pollfd pfd = {fd_, POLLOUT, 0};
+  return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLOUT) ? 256 : 0;
+}
+
+size_t HWCDC::write(const uint8_t *buf, size_t n) {
+  if (fd_ < 0) return 0;
+  std::lock_guard<std::mutex> guard(serialWriteLock);
+  size_t done = 0;
+  unsigned long started = millis();
+  while (done < n) {
+    ssize_t res = ::write(fd_, buf + done, n - done);
+    if (res > 0) {
+      done += res;
+      continue;
+    }
+    if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK) break;
+    long left = SERIAL_TX_TIMEOUT_MS - (long)(millis() - started);
+    if (left <= 0) break;
+    struct pollfd pfd = {fd_, POLLOUT, 0};
+    poll(&pfd, 1, left);
+  }
+  return done;
+}
+
+void HWCDC::flush() {
+  if (fd_ >= 0) tcdrain(fd_);
+}
+
+const char *hostSerialPath() {
+  return Serial.path();
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rx, int8_t tx) {
+  if (fd_ >= 0) return;
+  const char *path = getenv("MODEM_SERIAL1");
+  fd_ = open(path ? path : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+  if (fd_ < 0) return 0;
+  ssize_t res = ::write(fd_, buf, n);
+  return res > 0 ? res : 0;
+}
+
+// === ESP ===
+
+static void (*restartHandler)() = nullptr;
+
+void hostOnRestart(void (*handler)()) {
+  restartHandler = handler;
+}
+
+void EspClass::restart() {
+  if (restartHandler) restartHandler();
+  exit(0);
+}
+
+// Куча на хосте не ограничена: цифры - как у свободного ESP32-S3
+uint32_t EspClass::getFreeHeap() { return 320 * 1024; }
+uint32_t EspClass::getMinFreeHeap() { return 300 * 1024; }
+uint32_t EspClass::getMaxAllocHeap() { return 110 * 1024; }
+
+void *ps_malloc(size_t size) {
+  return calloc(1, size);
+}
+
+bool psramFound() {
+  return true;
+}
+
+// === FreeRTOS ===
+
+struct HostTask {
+  std::mutex lock;
+  std::condition_variable wake;
+  uint32_t notify = 0;
+};
+
+struct TaskDeleted {};
+
+struct HostSemaphore {
+  std::recursive_timed_mutex mutex;
+};
+
+// Поток без xTaskCreate (loop(), тест) тоже может ждать уведомление
+static thread_local HostTask *currentTask = nullptr;
+
+static HostTask *selfTask() {
+  if (!currentTask) currentTask = new HostTask;
+  return currentTask;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core) {
+  HostTask *task = new HostTask;
+  if (handle) *handle = task;
+  std::thread([fn, arg, task] {
+    currentTask = task;
+    try {
+      fn(arg);
+    } catch (const TaskDeleted &) {
+    }
+  }).detach();
+  return pdPASS;
+}
+
+// Только vTaskDelete(nullptr) в конце своей задачи: поток сворачивается
+void vTaskDelete(TaskHandle_t task) {
+  if (task && task != currentTask) abort();
+  throw TaskDeleted();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks);
+}
+
+TickType_t xTaskGetTickCount() {
+  return millis();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+  HostTask *task = selfTask();
+  std::unique_lock<std::mutex> guard(task->lock);
+  if (ticks == portMAX_DELAY) {
+    task->wake.wait(guard, [task] { return task->notify > 0; });
+  } else {
+    task->wake.wait_for(guard, std::chrono::milliseconds(ticks), [task] { return task->notify > 0; });
+  }
+  uint32_t value = task->notify;
+  if (value) task->notify = clear ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  if (!task) return pdFALSE;
+  {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notify++;
+  }
+  task->wake.notify_one();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  xTaskNotifyGive(task);
+  if (woken) *woken = pdFALSE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new HostSemaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return new HostSemaphore;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    sem->mutex.lock();
+    return pdTRUE;
+  }
+  return sem->mutex.try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+  sem->mutex.unlock();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  return xSemaphoreTakeRecursive(sem, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  return xSemaphoreGiveRecursive(sem);
+}
+
+// === ТАЙМЕР ===
+
+struct hw_timer_s {
+  void (*isr)() = nullptr;
+  uint64_t periodUs = 0;
+  bool autoreload = true;
+  std::atomic<bool> running{false};
+  std::thread thread;
+};
+
+hw_timer_t *timerBegin(uint8_t num, uint16_t divider, bool countUp) {
+  return new hw_timer_s;
+}
+
+void timerAttachInterrupt(hw_timer_t *timer, void (*fn)(), bool edge) {
+  timer->isr = fn;
+}
+
+void timerAlarmWrite(hw_timer_t *timer, uint64_t us, bool autoreload) {
+  timer->periodUs = us;
+  timer->autoreload = autoreload;
+}
+
+void timerAlarmEnable(hw_timer_t *timer) {
+  if (timer->running || !timer->isr || !timer->periodUs) return;
+  timer->running = true;
+  timer->thread = std::thread([timer] {
+    auto next = std::chrono::steady_clock::now();
+    while (timer->running) {
+      next += std::chrono::microseconds(timer->periodUs);
+      std::this_thread::sleep_until(next);
+      if (!timer->running) break;
+      timer->isr();
+      if (!timer->autoreload) break;
+    }
+  });
+}
+
+void timerEnd(hw_timer_t *timer) {
+  timer->running = false;
+  if (timer->thread.joinable()) timer->thread.join();
+  delete timer;
+}
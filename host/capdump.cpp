@@ -0,0 +1,88 @@
+// Разбор записи сессии (AT$CAP) на ПК: файл capture.wmc с LittleFS платы
+// или из modem_data/littlefs хост-модема.
+//
+//   capdump [--raw] [--session N] capture.wmc
+//
+// По умолчанию - строка на запись: смещение, время, направление, сессия,
+// длина и начало данных. --raw - только данные из сети подряд, как их
+// видел терминал до перекодировки (для сравнения с исходным потоком).
+
+#include <capture.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+static void usage(const char *self) {
+  fprintf(stderr, "usage: %s [--raw] [--session N] FILE\n", self);
+  exit(2);
+}
+
+// Начало данных: печатные как есть, остальное \xNN
+static void preview(const uint8_t *p, size_t n) {
+  for (size_t i = 0; i < n && i < 32; i++) {
+    if (p[i] >= 0x20 && p[i] < 0x7F && p[i] != '\\') putchar(p[i]);
+    else printf("\\x%02X", p[i]);
+  }
+  if (n > 32) printf("...");
+}
+
+int main(int argc, char **argv) {
+  bool raw = false;
+  int session = -1;
+  const char *path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--raw") == 0) raw = true;
+    else if (strcmp(argv[i], "--session") == 0 && i + 1 < argc) session = atoi(argv[++i]);
+    else if (!path) path = argv[i];
+    else usage(argv[0]);
+  }
+  if (!path) usage(argv[0]);
+
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    perror(path);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[65536];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), fp)) > 0) data.insert(data.end(), chunk, chunk + got);
+  fclose(fp);
+
+  if (data.size() < CAP_FILE_HEADER_SIZE || !captureCheckHeader(data.data())) {
+    fprintf(stderr, "%s: not a capture file (version %d expected)\n", path, CAP_VERSION);
+    return 1;
+  }
+
+  size_t pos = CAP_FILE_HEADER_SIZE;
+  unsigned long long us = 0;
+  unsigned long records = 0, in = 0, out = 0;
+  while (pos < data.size()) {
+    CaptureRecord rec;
+    size_t h = captureDecodeHeader(data.data() + pos, data.size() - pos, rec);
+    if (h == 0 || pos + h + rec.length > data.size()) {
+      fprintf(stderr, "%s: truncated record at offset %zu\n", path, pos);
+      return 1;
+    }
+    const uint8_t *p = data.data() + pos + h;
+    us += rec.deltaUs;
+    if (session < 0 || rec.session == session) {
+      if (raw) {
+        if (!rec.outbound) fwrite(p, 1, rec.length, stdout);
+      } else {
+        printf("%8zu %10.3f %s s%u %5u  ", pos, us / 1e6, rec.outbound ? "out" : "in ", rec.session,
+               (unsigned)rec.length);
+        preview(p, rec.length);
+        putchar('\n');
+      }
+      records++;
+      (rec.outbound ? out : in) += rec.length;
+    }
+    pos += h + rec.length;
+  }
+  if (!raw) printf("%lu records, %lu bytes in, %lu bytes out\n", records, in, out);
+  return 0;
+}
@@ -0,0 +1,216 @@
+#pragma once
+// Хост-сборка (Linux): то подмножество ядра Arduino-ESP32, которым
+// пользуется прошивка. Serial - псевдотерминал, задачи FreeRTOS - потоки,
+// аппаратный таймер - поток с sleep_until.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+#define ESP_ARDUINO_VERSION_MAJOR 2
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define IRAM_ATTR
+#define F(x) x
+
+using std::min;
+using std::max;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+uint32_t esp_random();
+
+// === String ===
+
+class String {
+public:
+  String(const char *s = "") : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  const char *c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  String &operator+=(const char *s) { s_ += s; return *this; }
+  String &operator+=(char c) { s_ += c; return *this; }
+  bool operator==(const char *s) const { return s_ == s; }
+
+private:
+  std::string s_;
+};
+
+// === IPAddress ===
+
+// Адрес хранится в сетевом порядке, как s_addr: [0] - первый октет
+class IPAddress {
+public:
+  IPAddress() : addr_(0) {}
+  IPAddress(uint32_t addr) : addr_(addr) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    uint8_t *p = (uint8_t *)&addr_;
+    p[0] = a; p[1] = b; p[2] = c; p[3] = d;
+  }
+  operator uint32_t() const { return addr_; }
+  uint8_t operator[](int i) const { return ((const uint8_t *)&addr_)[i]; }
+  bool operator==(const IPAddress &o) const { return addr_ == o.addr_; }
+  bool fromString(const char *s);
+
+private:
+  uint32_t addr_;
+};
+
+// === Print / Stream ===
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n);
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t write(const char *s, size_t n) { return write((const uint8_t *)s, n); }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(double v, int digits = 2);
+  size_t print(const IPAddress &ip);
+
+  template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(const T &v, int base) { size_t n = print(v, base); return n + println(); }
+  size_t println() { return write("\r\n"); }
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual void flush() {}
+};
+
+// === Serial ===
+
+// USB CDC прошивки -> ведущая сторона псевдотерминала. Терминал (или тест)
+// открывает ведомую сторону: hostSerialPath() после Serial.begin().
+class HWCDC : public Stream {
+public:
+  void begin(unsigned long baud);
+  int available() override;
+  int read() override;
+  size_t read(uint8_t *buf, size_t n);
+  int availableForWrite();
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  void flush() override;
+  operator bool() const { return fd_ >= 0; }
+  const char *path() const { return path_; }
+
+private:
+  int fd_ = -1;
+  int slave_ = -1;
+  char path_[64] = "";
+};
+
+// UART трассировки: в файл из MODEM_SERIAL1, иначе в никуда
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud, uint32_t config = 0, int8_t rx = -1, int8_t tx = -1);
+  int available() override { return 0; }
+  int read() override { return -1; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+
+private:
+  int fd_ = -1;
+};
+
+extern HWCDC Serial;
+extern HardwareSerial Serial1;
+
+// === ESP ===
+
+class EspClass {
+public:
+  void restart();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+};
+
+extern EspClass ESP;
+
+void *ps_malloc(size_t size);
+bool psramFound();
+
+// === FreeRTOS ===
+
+typedef struct HostTask *TaskHandle_t;
+typedef struct HostSemaphore *SemaphoreHandle_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portYIELD_FROM_ISR(x) (void)(x)
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+
+// === Аппаратный таймер (API ядра 2.x) ===
+
+typedef struct hw_timer_s hw_timer_t;
+
+hw_timer_t *timerBegin(uint8_t num, uint16_t divider, bool countUp);
+void timerAttachInterrupt(hw_timer_t *timer, void (*fn)(), bool edge);
+void timerAlarmWrite(hw_timer_t *timer, uint64_t us, bool autoreload);
+void timerAlarmEnable(hw_timer_t *timer);
+void timerEnd(hw_timer_t *timer);
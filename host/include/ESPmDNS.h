@@ -0,0 +1,9 @@
+#pragma once
+// Хост-сборка: mDNS не нужен, имя в сети - адрес 127.0.0.1
+
+class MDNSResponder {
+public:
+  bool begin(const char *hostname) { return true; }
+};
+
+extern MDNSResponder MDNS;
@@ -0,0 +1,46 @@
+#pragma once
+// Хост-сборка: LittleFS - подкаталог littlefs/ в каталоге данных
+
+#include <Arduino.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+class File : public Stream {
+public:
+  File() {}
+  explicit File(FILE *fp) : fp_(fp) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  size_t read(uint8_t *buf, size_t n);
+  void flush() override;
+  size_t size() const;
+  void close();
+  operator bool() const { return fp_ != nullptr; }
+
+private:
+  FILE *fp_ = nullptr;
+};
+
+namespace fs {
+
+class LittleFSFS {
+public:
+  bool begin(bool formatOnFail = false);
+  bool format();
+  File open(const char *path, const char *mode = FILE_READ);
+  bool exists(const char *path);
+  bool remove(const char *path);
+
+private:
+  std::string root_;
+  bool mounted_ = false;
+};
+
+} // namespace fs
+
+extern fs::LittleFSFS LittleFS;
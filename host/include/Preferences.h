@@ -0,0 +1,34 @@
+#pragma once
+// Хост-сборка: NVS - по файлу на пространство имен в каталоге данных
+// (hostDataDir()). Файл переписывается целиком на каждую запись.
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+  bool clear();
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  size_t putBytes(const char *key, const void *buf, size_t len);
+  size_t getString(const char *key, char *buf, size_t maxLen);
+  size_t putString(const char *key, const char *value);
+  int32_t getInt(const char *key, int32_t def = 0);
+  size_t putInt(const char *key, int32_t value);
+  bool getBool(const char *key, bool def = false);
+  size_t putBool(const char *key, bool value);
+  uint8_t getUChar(const char *key, uint8_t def = 0);
+  size_t putUChar(const char *key, uint8_t value);
+
+private:
+  const std::vector<uint8_t> *find(const char *key) const;
+  size_t put(const char *key, const void *buf, size_t len);
+  bool save();
+
+  std::string path_;
+  std::map<std::string, std::vector<uint8_t>> values_;
+  bool open_ = false;
+  bool readOnly_ = false;
+};
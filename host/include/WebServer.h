@@ -0,0 +1,35 @@
+#pragma once
+// Хост-сборка: HTTP/1.1-сервер в объеме, нужном прошивке. Один запрос на
+// соединение; ответ неизвестной длины идет кусками (chunked), как в ядре.
+
+#include <WiFi.h>
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+class WebServer {
+public:
+  explicit WebServer(int port) : port_(port) {}
+  void on(const char *uri, void (*handler)());
+  void begin();
+  void handleClient();
+  void setContentLength(size_t len) { contentLength_ = len; }
+  void send(int code, const char *type, const char *content);
+  void send(int code, const char *type, const String &content) { send(code, type, content.c_str()); }
+  void sendContent(const char *buf, size_t len);
+  void sendContent(const char *s) { sendContent(s, strlen(s)); }
+  void sendContent(const String &s) { sendContent(s.c_str(), s.length()); }
+
+private:
+  static const int MAX_ROUTES = 16;
+  struct Route { const char *uri; void (*handler)(); };
+
+  bool sendAll(const char *buf, size_t len);
+
+  int port_;
+  int fd_ = -1;
+  int client_ = -1;
+  Route routes_[MAX_ROUTES];
+  int routeCount_ = 0;
+  size_t contentLength_ = 0;
+  bool chunked_ = false;
+};
@@ -0,0 +1,85 @@
+#pragma once
+// Хост-сборка: WiFiClient/WiFiServer на сокетах POSIX. Станция WiFi
+// "подключается" сразу: событие GOT_IP приходит из отдельного потока,
+// как из задачи событий ESP-IDF.
+
+#include <Arduino.h>
+#include <memory>
+
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+};
+
+enum wifi_mode_t { WIFI_OFF, WIFI_STA };
+
+enum WiFiEvent_t {
+  ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP = 7
+};
+
+typedef struct { int reason; } WiFiEventInfo_t;
+typedef void (*WiFiEventFuncCb)(WiFiEvent_t event, WiFiEventInfo_t info);
+
+// Как в ядре: копии клиента делят один сокет, последняя закрывает его
+class WiFiClient : public Stream {
+public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd);
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t n);
+  uint8_t connected();
+  void stop();
+  int fd() const;
+  int setNoDelay(bool nodelay);
+  IPAddress remoteIP() const;
+  uint16_t remotePort() const;
+  operator bool() { return connected(); }
+
+private:
+  struct Socket;
+  std::shared_ptr<Socket> sock_;
+  bool connected_ = false;
+};
+
+class WiFiServer {
+public:
+  explicit WiFiServer(uint16_t port) : port_(port) {}
+  void begin();
+  bool hasClient();
+  WiFiClient available();
+  WiFiClient accept() { return available(); }
+
+private:
+  uint16_t port_;
+  int fd_ = -1;
+  int pending_ = -1;
+};
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t m) { return true; }
+  bool persistent(bool p) { return true; }
+  bool setAutoReconnect(bool on) { return true; }
+  int onEvent(WiFiEventFuncCb cb);
+  wl_status_t begin(const char *ssid, const char *pass = nullptr, int32_t channel = 0,
+                    const uint8_t *bssid = nullptr, bool connect = true);
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  wl_status_t status();
+  String SSID();
+  IPAddress localIP();
+  int8_t RSSI() { return -55; }
+  uint8_t *BSSID();
+  int32_t channel() { return 6; }
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,6 @@
+#pragma once
+// Хост-сборка: crc32_le из ПЗУ = обычный CRC-32 (как zlib crc32)
+
+#include <stdint.h>
+
+uint32_t crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
@@ -0,0 +1,30 @@
+#pragma once
+// Хост-сборка: tinfl из ПЗУ поверх zlib inflate. Окно zlib держит само,
+// поэтому выходной буфер может быть кольцом, как у tinfl.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zlib.h>
+
+typedef enum {
+  TINFL_STATUS_BAD_PARAM = -3,
+  TINFL_STATUS_ADLER32_MISMATCH = -2,
+  TINFL_STATUS_FAILED = -1,
+  TINFL_STATUS_DONE = 0,
+  TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+  TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_FLAG_PARSE_ZLIB_HEADER 1
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+// Память под состояние прошивка берет из ps_malloc (обнуленной)
+typedef struct {
+  uint32_t magic;
+  z_stream z;
+} tinfl_decompressor;
+
+void tinfl_init(tinfl_decompressor *r);
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *in, size_t *inSize,
+                              uint8_t *outStart, uint8_t *outNext, size_t *outSize, const uint32_t flags);
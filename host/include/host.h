@@ -0,0 +1,33 @@
+#pragma once
+// Управление хост-сборкой: то, чего на плате нет - каталог данных вместо
+// флеша, сдвиг портов, таблица резолвера, обрыв WiFi. Вызывается из main()
+// хост-модема, тестов и замеров до setup() или из их потоков.
+
+#include <stdint.h>
+
+// Каталог для NVS (Preferences) и LittleFS; по умолчанию ./modem_data
+void hostSetDataDir(const char *dir);
+const char *hostDataDir();
+
+// LittleFS.begin(true) на чистом каталоге "форматирует" ms миллисекунд
+void hostSetFsFormatMs(unsigned ms);
+
+// Порты слушателей: offset > 0 - порт + offset, offset < 0 - свободный
+// порт от ядра. hostBoundPort() - где в итоге слушает порт прошивки.
+void hostSetPortOffset(int offset);
+uint16_t hostBoundPort(uint16_t firmwarePort);
+
+// Ведомая сторона псевдотерминала Serial (после Serial.begin())
+const char *hostSerialPath();
+
+// Резолвер: имена из таблицы отвечают без сети, delayMs - задержка ответа.
+// Запись без адреса (ip4 = 0) отвечает ошибкой.
+void hostResolverAdd(const char *name, uint32_t ip4, unsigned delayMs = 0);
+void hostResolverRemove(const char *name);
+unsigned hostResolverQueries(const char *name);
+
+// WiFi: обрыв связи (событие STA_DISCONNECTED) и восстановление
+void hostWifiDrop();
+
+// Перезагрузка: ESP.restart() вызывает обработчик, по умолчанию exit(0)
+void hostOnRestart(void (*handler)());
@@ -0,0 +1,17 @@
+#pragma once
+// Хост-сборка: сокеты POSIX. bind() - макрос, как в lwIP с
+// LWIP_COMPAT_SOCKETS: порт слушателя можно сдвинуть или выдать свободный
+// (hostSetPortOffset), чтобы тесты не мешали друг другу.
+
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+int lwip_bind(int s, const struct sockaddr *name, socklen_t namelen);
+#define bind(s, name, namelen) lwip_bind(s, name, namelen)
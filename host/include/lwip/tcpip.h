@@ -0,0 +1,2 @@
+#pragma once
+// Хост-сборка: стек один на процесс, LOCK_TCPIP_CORE не нужен
@@ -0,0 +1,5 @@
+#pragma once
+// Хост-сборка: только коды ошибок, сокеты прошивка ведет сама
+
+#define MBEDTLS_ERR_NET_RECV_FAILED -0x004C
+#define MBEDTLS_ERR_NET_SEND_FAILED -0x004E
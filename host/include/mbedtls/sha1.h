@@ -0,0 +1,6 @@
+#pragma once
+// Хост-сборка: SHA-1 из OpenSSL
+
+#include <stddef.h>
+
+int mbedtls_sha1_ret(const unsigned char *input, size_t ilen, unsigned char output[20]);
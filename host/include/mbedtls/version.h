@@ -0,0 +1,5 @@
+#pragma once
+// Хост-сборка: API как у mbedtls 2.28 из ESP-IDF 4.4 (ядро Arduino 2.x)
+
+#define MBEDTLS_VERSION_MAJOR 2
+#define MBEDTLS_VERSION_MINOR 28
@@ -0,0 +1,33 @@
+// Хост-модем: прошивка как процесс Linux. Терминал подключается к
+// псевдотерминалу, путь к нему печатается при старте.
+//
+//   modem_host [--data DIR] [--port-offset N]
+//
+// --port-offset сдвигает порты слушателей (6400, 80, 81): без root порты
+// ниже 1024 недоступны. -1 - свободные порты от ядра.
+
+#include <Arduino.h>
+#include <host.h>
+
+void setup();
+void loop();
+
+int main(int argc, char **argv) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--data") == 0) hostSetDataDir(argv[i + 1]);
+    else if (strcmp(argv[i], "--port-offset") == 0) hostSetPortOffset(atoi(argv[i + 1]));
+    else {
+      fprintf(stderr, "usage: %s [--data DIR] [--port-offset N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  Serial.begin(115200);
+  printf("%s\n", hostSerialPath());
+  fflush(stdout);
+
+  setup();
+  printf("listen %u, web %u, websocket %u\n", hostBoundPort(6400), hostBoundPort(80), hostBoundPort(81));
+  fflush(stdout);
+  for (;;) loop();
+}
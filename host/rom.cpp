@@ -0,0 +1,40 @@
+// Хост-сборка: функции ПЗУ ESP32-S3 - crc32_le и tinfl - поверх zlib
+
+#include <esp32s3/rom/crc.h>
+#include <esp32s3/rom/miniz.h>
+
+#include <string.h>
+
+uint32_t crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len) {
+  return crc32(crc, buf, len);
+}
+
+static const uint32_t TINFL_MAGIC = 0x4c464e54; // "TNFL"
+
+void tinfl_init(tinfl_decompressor *r) {
+  if (r->magic == TINFL_MAGIC) inflateEnd(&r->z);
+  memset(r, 0, sizeof(*r));
+  r->magic = inflateInit2(&r->z, MAX_WBITS) == Z_OK ? TINFL_MAGIC : 0;
+}
+
+// Выход пишется с outNext; ссылки назад zlib берет из своего окна
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *in, size_t *inSize,
+                              uint8_t *outStart, uint8_t *outNext, size_t *outSize, const uint32_t flags) {
+  if (r->magic != TINFL_MAGIC || !(flags & TINFL_FLAG_PARSE_ZLIB_HEADER)) {
+    *inSize = *outSize = 0;
+    return TINFL_STATUS_BAD_PARAM;
+  }
+  r->z.next_in = (Bytef *)in;
+  r->z.avail_in = *inSize;
+  r->z.next_out = outNext;
+  r->z.avail_out = *outSize;
+  int res = inflate(&r->z, Z_SYNC_FLUSH);
+  *inSize -= r->z.avail_in;
+  *outSize -= r->z.avail_out;
+
+  if (res == Z_STREAM_END) return TINFL_STATUS_DONE;
+  if (res == Z_DATA_ERROR) return TINFL_STATUS_FAILED;
+  if (res != Z_OK && res != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+  if (r->z.avail_out == 0) return TINFL_STATUS_HAS_MORE_OUTPUT;
+  return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
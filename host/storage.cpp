@@ -0,0 +1,226 @@
+// Хост-сборка: каталог данных, Preferences (NVS) и LittleFS в файлах
+
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <host.h>
+
+#include <mutex>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+fs::LittleFSFS LittleFS;
+
+static std::string dataDir = "modem_data";
+
+void hostSetDataDir(const char *dir) {
+  dataDir = dir;
+}
+
+const char *hostDataDir() {
+  return dataDir.c_str();
+}
+
+static void makeDir(const std::string &path) {
+  mkdir(path.c_str(), 0755);
+}
+
+// === Preferences ===
+
+// Формат файла: [длина ключа][ключ][длина значения, 4 байта][значение]...
+static std::mutex nvsLock;
+
+bool Preferences::begin(const char *name, bool readOnly) {
+  std::lock_guard<std::mutex> guard(nvsLock);
+  makeDir(dataDir);
+  path_ = dataDir + "/" + name + ".nvs";
+  readOnly_ = readOnly;
+  values_.clear();
+  open_ = true;
+
+  FILE *fp = fopen(path_.c_str(), "rb");
+  if (!fp) return true;
+  for (;;) {
+    uint8_t keyLen;
+    uint32_t valueLen;
+    char key[256];
+    if (fread(&keyLen, 1, 1, fp) != 1 || fread(key, 1, keyLen, fp) != keyLen) break;
+    if (fread(&valueLen, sizeof(valueLen), 1, fp) != 1) break;
+    std::vector<uint8_t> value(valueLen);
+    if (valueLen && fread(value.data(), 1, valueLen, fp) != valueLen) break;
+    values_[std::string(key, keyLen)] = value;
+  }
+  fclose(fp);
+  return true;
+}
+
+void Preferences::end() {
+  open_ = false;
+  values_.clear();
+}
+
+bool Preferences::save() {
+  std::lock_guard<std::mutex> guard(nvsLock);
+  std::string tmp = path_ + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "wb");
+  if (!fp) return false;
+  for (const auto &kv : values_) {
+    uint8_t keyLen = kv.first.size();
+    uint32_t valueLen = kv.second.size();
+    fwrite(&keyLen, 1, 1, fp);
+    fwrite(kv.first.data(), 1, keyLen, fp);
+    fwrite(&valueLen, sizeof(valueLen), 1, fp);
+    fwrite(kv.second.data(), 1, valueLen, fp);
+  }
+  bool ok = fclose(fp) == 0;
+  return ok && rename(tmp.c_str(), path_.c_str()) == 0;
+}
+
+bool Preferences::clear() {
+  if (!open_ || readOnly_) return false;
+  values_.clear();
+  return save();
+}
+
+const std::vector<uint8_t> *Preferences::find(const char *key) const {
+  if (!open_) return nullptr;
+  auto it = values_.find(key);
+  return it == values_.end() ? nullptr : &it->second;
+}
+
+size_t Preferences::put(const char *key, const void *buf, size_t len) {
+  if (!open_ || readOnly_ || strlen(key) > 15) return 0;
+  values_[key].assign((const uint8_t *)buf, (const uint8_t *)buf + len);
+  return save() ? len : 0;
+}
+
+// Как в ядре: буфер меньше значения - ошибка, ничего не копируется
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  const std::vector<uint8_t> *value = find(key);
+  if (!value || value->size() > maxLen) return 0;
+  memcpy(buf, value->data(), value->size());
+  return value->size();
+}
+
+size_t Preferences::putBytes(const char *key, const void *buf, size_t len) {
+  return put(key, buf, len);
+}
+
+// Длина с завершающим нулем, как nvs_get_str
+size_t Preferences::getString(const char *key, char *buf, size_t maxLen) {
+  const std::vector<uint8_t> *value = find(key);
+  if (!value || value->size() + 1 > maxLen) return 0;
+  memcpy(buf, value->data(), value->size());
+  buf[value->size()] = '\0';
+  return value->size() + 1;
+}
+
+size_t Preferences::putString(const char *key, const char *value) {
+  return put(key, value, strlen(value));
+}
+
+int32_t Preferences::getInt(const char *key, int32_t def) {
+  int32_t v;
+  return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : def;
+}
+
+size_t Preferences::putInt(const char *key, int32_t value) {
+  return put(key, &value, sizeof(value));
+}
+
+bool Preferences::getBool(const char *key, bool def) {
+  return getUChar(key, def) != 0;
+}
+
+size_t Preferences::putBool(const char *key, bool value) {
+  return putUChar(key, value);
+}
+
+uint8_t Preferences::getUChar(const char *key, uint8_t def) {
+  uint8_t v;
+  return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : def;
+}
+
+size_t Preferences::putUChar(const char *key, uint8_t value) {
+  return put(key, &value, sizeof(value));
+}
+
+// === LittleFS ===
+
+size_t File::write(const uint8_t *buf, size_t n) {
+  return fp_ ? fwrite(buf, 1, n, fp_) : 0;
+}
+
+int File::available() {
+  if (!fp_) return 0;
+  long pos = ftell(fp_);
+  return pos < 0 ? 0 : (int)(size() - pos);
+}
+
+int File::read() {
+  if (!fp_) return -1;
+  int c = fgetc(fp_);
+  return c == EOF ? -1 : c;
+}
+
+size_t File::read(uint8_t *buf, size_t n) {
+  return fp_ ? fread(buf, 1, n, fp_) : 0;
+}
+
+void File::flush() {
+  if (fp_) fflush(fp_);
+}
+
+size_t File::size() const {
+  struct stat st;
+  if (!fp_ || fstat(fileno(fp_), &st) != 0) return 0;
+  return st.st_size;
+}
+
+void File::close() {
+  if (fp_) fclose(fp_);
+  fp_ = nullptr;
+}
+
+static unsigned formatMs = 0;
+
+void hostSetFsFormatMs(unsigned ms) {
+  formatMs = ms;
+}
+
+namespace fs {
+
+// Каталога еще нет - "чистый флеш": begin(true) форматирует
+bool LittleFSFS::begin(bool formatOnFail) {
+  makeDir(dataDir);
+  root_ = dataDir + "/littlefs";
+  if (access(root_.c_str(), F_OK) != 0) {
+    if (!formatOnFail) return false;
+    usleep(formatMs * 1000);
+  }
+  makeDir(root_);
+  mounted_ = access(root_.c_str(), W_OK) == 0;
+  return mounted_;
+}
+
+bool LittleFSFS::format() {
+  return mounted_;
+}
+
+File LittleFSFS::open(const char *path, const char *mode) {
+  if (!mounted_) return File();
+  std::string full = root_ + path;
+  std::string how = std::string(mode) + "b";
+  return File(fopen(full.c_str(), how.c_str()));
+}
+
+bool LittleFSFS::exists(const char *path) {
+  return mounted_ && access((root_ + path).c_str(), F_OK) == 0;
+}
+
+bool LittleFSFS::remove(const char *path) {
+  return mounted_ && unlink((root_ + path).c_str()) == 0;
+}
+
+} // namespace fs
@@ -0,0 +1,218 @@
+// Хост-сборка: mbedtls_ssl_*, SHA-1 и base64 поверх OpenSSL. Транспорт -
+// свой BIO, который зовет колбэки set_bio прошивки.
+
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+#include <mbedtls/ssl.h>
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+
+#include <string.h>
+
+// === BIO ===
+
+static int bioWrite(BIO *bio, const char *buf, int len) {
+  mbedtls_ssl_context *ssl = (mbedtls_ssl_context *)BIO_get_data(bio);
+  BIO_clear_retry_flags(bio);
+  int res = ssl->f_send(ssl->p_bio, (const unsigned char *)buf, len);
+  if (res == MBEDTLS_ERR_SSL_WANT_WRITE || res == MBEDTLS_ERR_SSL_WANT_READ) {
+    BIO_set_retry_write(bio);
+    return -1;
+  }
+  return res;
+}
+
+static int bioRead(BIO *bio, char *buf, int len) {
+  mbedtls_ssl_context *ssl = (mbedtls_ssl_context *)BIO_get_data(bio);
+  BIO_clear_retry_flags(bio);
+  int res = ssl->f_recv(ssl->p_bio, (unsigned char *)buf, len);
+  if (res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    BIO_set_retry_read(bio);
+    return -1;
+  }
+  return res;
+}
+
+static long bioCtrl(BIO *bio, int cmd, long num, void *ptr) {
+  return cmd == BIO_CTRL_FLUSH ? 1 : 0;
+}
+
+static BIO_METHOD *bioMethod() {
+  static BIO_METHOD *method = nullptr;
+  if (!method) {
+    method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "mbedtls-bio");
+    BIO_meth_set_write(method, bioWrite);
+    BIO_meth_set_read(method, bioRead);
+    BIO_meth_set_ctrl(method, bioCtrl);
+  }
+  return method;
+}
+
+static bool attachSsl(mbedtls_ssl_context *ssl) {
+  ssl->host = SSL_new(ssl->conf->host);
+  if (!ssl->host) return false;
+  BIO *bio = BIO_new(bioMethod());
+  BIO_set_data(bio, ssl);
+  BIO_set_init(bio, 1);
+  SSL_set_bio(ssl->host, bio, bio);
+  SSL_set_connect_state(ssl->host);
+  SSL_set_mode(ssl->host, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  return true;
+}
+
+// Ошибка OpenSSL -> код mbedtls
+static int sslError(mbedtls_ssl_context *ssl, int res) {
+  int err = SSL_get_error(ssl->host, res);
+  ERR_clear_error();
+  switch (err) {
+    case SSL_ERROR_WANT_READ: return MBEDTLS_ERR_SSL_WANT_READ;
+    case SSL_ERROR_WANT_WRITE: return MBEDTLS_ERR_SSL_WANT_WRITE;
+    case SSL_ERROR_ZERO_RETURN: return MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+    default: return MBEDTLS_ERR_SSL_INVALID_RECORD;
+  }
+}
+
+// === КОНФИГУРАЦИЯ ===
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config *conf) {
+  memset(conf, 0, sizeof(*conf));
+}
+
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf, int endpoint, int transport, int preset) {
+  if (endpoint != MBEDTLS_SSL_IS_CLIENT) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  conf->host = SSL_CTX_new(TLS_client_method());
+  if (!conf->host) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  SSL_CTX_set_max_proto_version(conf->host, TLS1_2_VERSION);
+  SSL_CTX_set_session_cache_mode(conf->host, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_set_verify(conf->host, SSL_VERIFY_PEER, nullptr);
+  SSL_CTX_set_options(conf->host, SSL_OP_NO_TICKET);
+  return 0;
+}
+
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config *conf, int authmode) {
+  conf->authmode = authmode;
+  SSL_CTX_set_verify(conf->host, authmode == MBEDTLS_SSL_VERIFY_NONE ? SSL_VERIFY_NONE : SSL_VERIFY_PEER, nullptr);
+}
+
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config *conf, int (*f_rng)(void *, unsigned char *, size_t), void *p_rng) {}
+
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config *conf, int use_tickets) {
+  conf->tickets = use_tickets;
+  if (use_tickets) SSL_CTX_clear_options(conf->host, SSL_OP_NO_TICKET);
+  else SSL_CTX_set_options(conf->host, SSL_OP_NO_TICKET);
+}
+
+// === КОНТЕКСТ ===
+
+void mbedtls_ssl_init(mbedtls_ssl_context *ssl) {
+  memset(ssl, 0, sizeof(*ssl));
+}
+
+int mbedtls_ssl_setup(mbedtls_ssl_context *ssl, const mbedtls_ssl_config *conf) {
+  ssl->conf = conf;
+  return attachSsl(ssl) ? 0 : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+}
+
+// Новое соединение с той же конфигурацией; колбэки set_bio остаются
+int mbedtls_ssl_session_reset(mbedtls_ssl_context *ssl) {
+  if (ssl->host) SSL_free(ssl->host);
+  ssl->host = nullptr;
+  return attachSsl(ssl) ? 0 : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+}
+
+void mbedtls_ssl_free(mbedtls_ssl_context *ssl) {
+  if (ssl->host) SSL_free(ssl->host);
+  memset(ssl, 0, sizeof(*ssl));
+}
+
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context *ssl, const char *hostname) {
+  return SSL_set_tlsext_host_name(ssl->host, hostname) == 1 ? 0 : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+}
+
+void mbedtls_ssl_set_bio(mbedtls_ssl_context *ssl, void *p_bio, mbedtls_ssl_send_t *f_send,
+                         mbedtls_ssl_recv_t *f_recv, mbedtls_ssl_recv_timeout_t *f_recv_timeout) {
+  ssl->p_bio = p_bio;
+  ssl->f_send = f_send;
+  ssl->f_recv = f_recv;
+}
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl) {
+  int res = SSL_do_handshake(ssl->host);
+  return res == 1 ? 0 : sslError(ssl, res);
+}
+
+// Как mbedtls 2.x: 0 - транспорт закрыт без close_notify
+int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len) {
+  int res = SSL_read(ssl->host, buf, len);
+  if (res > 0) return res;
+  int err = SSL_get_error(ssl->host, res);
+  if (err == SSL_ERROR_SYSCALL || (err == SSL_ERROR_SSL && ERR_GET_REASON(ERR_peek_error()) == SSL_R_UNEXPECTED_EOF_WHILE_READING)) {
+    ERR_clear_error();
+    return 0;
+  }
+  return sslError(ssl, res);
+}
+
+int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len) {
+  int res = SSL_write(ssl->host, buf, len);
+  return res > 0 ? res : sslError(ssl, res);
+}
+
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context *ssl) {
+  return ssl->host ? SSL_pending(ssl->host) : 0;
+}
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl) {
+  if (!ssl->host || !SSL_is_init_finished(ssl->host)) return 0;
+  SSL_shutdown(ssl->host);
+  ERR_clear_error();
+  return 0;
+}
+
+// === СЕССИИ ===
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session *session) {
+  memset(session, 0, sizeof(*session));
+}
+
+void mbedtls_ssl_session_free(mbedtls_ssl_session *session) {
+  if (session->host) SSL_SESSION_free(session->host);
+  memset(session, 0, sizeof(*session));
+}
+
+int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl, mbedtls_ssl_session *session) {
+  SSL_SESSION *s = ssl->host ? SSL_get1_session(ssl->host) : nullptr;
+  if (!s) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  if (session->host) SSL_SESSION_free(session->host);
+  session->host = s;
+  unsigned int idLen = 0;
+  const unsigned char *id = SSL_SESSION_get_id(s, &idLen);
+  session->id_len = idLen < sizeof(session->id) ? idLen : sizeof(session->id);
+  memcpy(session->id, id, session->id_len);
+  SSL_SESSION_get_master_key(s, session->master, sizeof(session->master));
+  return 0;
+}
+
+int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session) {
+  if (!session->host) return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  return SSL_set_session(ssl->host, session->host) == 1 ? 0 : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+}
+
+// === SHA-1 / BASE64 ===
+
+int mbedtls_sha1_ret(const unsigned char *input, size_t ilen, unsigned char output[20]) {
+  return EVP_Digest(input, ilen, output, nullptr, EVP_sha1(), nullptr) == 1 ? 0 : -1;
+}
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen) {
+  size_t need = 4 * ((slen + 2) / 3) + 1;
+  if (dlen < need) {
+    *olen = need;
+    return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+  }
+  *olen = EVP_EncodeBlock(dst, src, slen);
+  return 0;
+}
@@ -0,0 +1,101 @@
+// Хост-сборка: WebServer - по одному запросу за handleClient()
+
+#include <WebServer.h>
+#include <lwip/sockets.h>
+
+#include <poll.h>
+
+#undef bind
+
+void WebServer::on(const char *uri, void (*handler)()) {
+  if (routeCount_ < MAX_ROUTES) routes_[routeCount_++] = {uri, handler};
+}
+
+void WebServer::begin() {
+  if (fd_ >= 0) return;
+  fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port_);
+  if (lwip_bind(fd_, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd_, 4) != 0) {
+    fprintf(stderr, "host: web port %d: %s\n", port_, strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+}
+
+bool WebServer::sendAll(const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t res = ::send(client_, buf, len, MSG_NOSIGNAL);
+    if (res <= 0) return false;
+    buf += res;
+    len -= res;
+  }
+  return true;
+}
+
+// Заголовок запроса ждем не дольше секунды, тело не читаем (только GET)
+void WebServer::handleClient() {
+  if (fd_ < 0) return;
+  client_ = accept(fd_, nullptr, nullptr);
+  if (client_ < 0) return;
+
+  char req[2048];
+  size_t len = 0;
+  unsigned long started = millis();
+  while (len < sizeof(req) - 1 && millis() - started < 1000) {
+    struct pollfd pfd = {client_, POLLIN, 0};
+    if (poll(&pfd, 1, 50) <= 0) continue;
+    ssize_t res = recv(client_, req + len, sizeof(req) - 1 - len, 0);
+    if (res <= 0) break;
+    len += res;
+    req[len] = '\0';
+    if (strstr(req, "\r\n\r\n")) break;
+  }
+  req[len] = '\0';
+
+  char method[8], uri[256];
+  if (sscanf(req, "%7s %255s", method, uri) == 2) {
+    char *query = strchr(uri, '?');
+    if (query) *query = '\0';
+    contentLength_ = 0;
+    chunked_ = false;
+    void (*handler)() = nullptr;
+    for (int i = 0; i < routeCount_; i++) {
+      if (strcmp(routes_[i].uri, uri) == 0) handler = routes_[i].handler;
+    }
+    if (handler) handler();
+    else send(404, "text/plain", "Not found");
+    if (chunked_) sendAll("0\r\n\r\n", 5);
+  }
+  close(client_);
+  client_ = -1;
+}
+
+void WebServer::send(int code, const char *type, const char *content) {
+  size_t bodyLen = strlen(content);
+  chunked_ = contentLength_ == CONTENT_LENGTH_UNKNOWN;
+  char head[256];
+  int n = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nConnection: close\r\n", code,
+                   code == 200 ? "OK" : "Not Found", type);
+  if (chunked_) n += snprintf(head + n, sizeof(head) - n, "Transfer-Encoding: chunked\r\n\r\n");
+  else n += snprintf(head + n, sizeof(head) - n, "Content-Length: %zu\r\n\r\n", contentLength_ ? contentLength_ : bodyLen);
+  sendAll(head, n);
+  if (bodyLen) sendContent(content, bodyLen);
+}
+
+void WebServer::sendContent(const char *buf, size_t len) {
+  if (!chunked_) {
+    sendAll(buf, len);
+    return;
+  }
+  if (len == 0) return; // конец ответа отправит handleClient()
+  char size[16];
+  int n = snprintf(size, sizeof(size), "%zX\r\n", len);
+  sendAll(size, n) && sendAll(buf, len) && sendAll("\r\n", 2);
+}
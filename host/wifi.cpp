@@ -0,0 +1,329 @@
+// Хост-сборка: WiFi, WiFiClient/WiFiServer на сокетах, bind() со сдвигом
+// портов, асинхронный резолвер
+
+#include <ESPmDNS.h>
+#include <WiFi.h>
+#include <host.h>
+#include <lwip/dns.h>
+#include <lwip/sockets.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <netdb.h>
+#include <poll.h>
+
+#undef bind
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+
+// === ПОРТЫ ===
+
+static std::mutex portLock;
+static int portOffset = 0;
+static std::map<uint16_t, uint16_t> boundPorts;
+
+void hostSetPortOffset(int offset) {
+  std::lock_guard<std::mutex> guard(portLock);
+  portOffset = offset;
+}
+
+uint16_t hostBoundPort(uint16_t firmwarePort) {
+  std::lock_guard<std::mutex> guard(portLock);
+  auto it = boundPorts.find(firmwarePort);
+  return it == boundPorts.end() ? 0 : it->second;
+}
+
+int lwip_bind(int s, const struct sockaddr *name, socklen_t namelen) {
+  if (name->sa_family != AF_INET || namelen < sizeof(sockaddr_in)) return bind(s, name, namelen);
+  sockaddr_in addr = *(const sockaddr_in *)name;
+  uint16_t wanted = ntohs(addr.sin_port);
+  int offset;
+  {
+    std::lock_guard<std::mutex> guard(portLock);
+    offset = portOffset;
+  }
+  if (wanted && offset > 0) addr.sin_port = htons(wanted + offset);
+  else if (wanted && offset < 0) addr.sin_port = 0;
+  int res = bind(s, (const sockaddr *)&addr, sizeof(addr));
+  if (res == 0 && wanted) {
+    socklen_t len = sizeof(addr);
+    getsockname(s, (sockaddr *)&addr, &len);
+    std::lock_guard<std::mutex> guard(portLock);
+    boundPorts[wanted] = ntohs(addr.sin_port);
+  }
+  return res;
+}
+
+static int listenOn(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (lwip_bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+    fprintf(stderr, "host: port %u: %s\n", port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+// === WiFiClient ===
+
+struct WiFiClient::Socket {
+  int fd;
+  explicit Socket(int fd) : fd(fd) {}
+  ~Socket() { close(fd); }
+};
+
+WiFiClient::WiFiClient(int fd) : sock_(std::make_shared<Socket>(fd)), connected_(true) {}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t n) {
+  if (!sock_) return 0;
+  size_t done = 0;
+  while (done < n) {
+    ssize_t res = send(sock_->fd, buf + done, n - done, MSG_NOSIGNAL);
+    if (res > 0) {
+      done += res;
+      continue;
+    }
+    if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK) break;
+    struct pollfd pfd = {sock_->fd, POLLOUT, 0};
+    if (poll(&pfd, 1, 1000) <= 0) break;
+  }
+  return done;
+}
+
+int WiFiClient::available() {
+  int n = 0;
+  if (!sock_ || ioctl(sock_->fd, FIONREAD, &n) != 0) return 0;
+  return n;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t n) {
+  if (!sock_) return -1;
+  return recv(sock_->fd, buf, n, MSG_DONTWAIT);
+}
+
+// Как в ядре: закрытие соединения видно по recv(MSG_PEEK) == 0
+uint8_t WiFiClient::connected() {
+  if (!sock_ || !connected_) return 0;
+  uint8_t c;
+  ssize_t res = recv(sock_->fd, &c, 1, MSG_DONTWAIT | MSG_PEEK);
+  if (res == 0) connected_ = false;
+  else if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINPROGRESS) connected_ = false;
+  return connected_;
+}
+
+void WiFiClient::stop() {
+  sock_.reset();
+  connected_ = false;
+}
+
+int WiFiClient::fd() const {
+  return sock_ ? sock_->fd : -1;
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+  if (!sock_) return -1;
+  int flag = nodelay;
+  return setsockopt(sock_->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+IPAddress WiFiClient::remoteIP() const {
+  sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  if (!sock_ || getpeername(sock_->fd, (sockaddr *)&addr, &len) != 0) return IPAddress();
+  return IPAddress(addr.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort() const {
+  sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  if (!sock_ || getpeername(sock_->fd, (sockaddr *)&addr, &len) != 0) return 0;
+  return ntohs(addr.sin_port);
+}
+
+// === WiFiServer ===
+
+void WiFiServer::begin() {
+  if (fd_ < 0) fd_ = listenOn(port_);
+}
+
+bool WiFiServer::hasClient() {
+  if (pending_ >= 0) return true;
+  if (fd_ < 0) return false;
+  pending_ = ::accept(fd_, nullptr, nullptr);
+  return pending_ >= 0;
+}
+
+WiFiClient WiFiServer::available() {
+  if (!hasClient()) return WiFiClient();
+  int fd = pending_;
+  pending_ = -1;
+  return WiFiClient(fd);
+}
+
+// === WiFi ===
+
+static std::mutex wifiLock;
+static WiFiEventFuncCb wifiCallback = nullptr;
+static wl_status_t wifiStatus = WL_IDLE_STATUS;
+static std::string wifiSsid;
+static uint8_t wifiBssid[6] = {0x02, 0x00, 0x00, 0x48, 0x53, 0x54};
+
+static void wifiEvent(WiFiEvent_t event) {
+  WiFiEventFuncCb cb;
+  {
+    std::lock_guard<std::mutex> guard(wifiLock);
+    cb = wifiCallback;
+  }
+  WiFiEventInfo_t info = {0};
+  if (cb) cb(event, info);
+}
+
+int WiFiClass::onEvent(WiFiEventFuncCb cb) {
+  std::lock_guard<std::mutex> guard(wifiLock);
+  wifiCallback = cb;
+  return 1;
+}
+
+// Ассоциация и DHCP - 20 мс, событие приходит из другого потока
+wl_status_t WiFiClass::begin(const char *ssid, const char *pass, int32_t channel, const uint8_t *bssid, bool connect) {
+  {
+    std::lock_guard<std::mutex> guard(wifiLock);
+    wifiSsid = ssid ? ssid : "";
+    wifiStatus = WL_DISCONNECTED;
+  }
+  std::thread([] {
+    delay(20);
+    {
+      std::lock_guard<std::mutex> guard(wifiLock);
+      if (wifiStatus != WL_DISCONNECTED) return;
+      wifiStatus = WL_CONNECTED;
+    }
+    wifiEvent(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+    wifiEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  }).detach();
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+  bool was;
+  {
+    std::lock_guard<std::mutex> guard(wifiLock);
+    was = wifiStatus == WL_CONNECTED;
+    wifiStatus = WL_IDLE_STATUS;
+  }
+  if (was) wifiEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  return true;
+}
+
+void hostWifiDrop() {
+  {
+    std::lock_guard<std::mutex> guard(wifiLock);
+    if (wifiStatus != WL_CONNECTED) return;
+    wifiStatus = WL_CONNECTION_LOST;
+  }
+  wifiEvent(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+}
+
+wl_status_t WiFiClass::status() {
+  std::lock_guard<std::mutex> guard(wifiLock);
+  return wifiStatus;
+}
+
+String WiFiClass::SSID() {
+  std::lock_guard<std::mutex> guard(wifiLock);
+  return String(wifiSsid);
+}
+
+IPAddress WiFiClass::localIP() {
+  return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+uint8_t *WiFiClass::BSSID() {
+  return status() == WL_CONNECTED ? wifiBssid : nullptr;
+}
+
+// === РЕЗОЛВЕР ===
+
+struct FakeHost {
+  uint32_t ip4;
+  unsigned delayMs;
+  unsigned queries;
+};
+
+static std::mutex resolverLock;
+static std::map<std::string, FakeHost> fakeHosts;
+
+void hostResolverAdd(const char *name, uint32_t ip4, unsigned delayMs) {
+  std::lock_guard<std::mutex> guard(resolverLock);
+  FakeHost &host = fakeHosts[name];
+  host.ip4 = ip4;
+  host.delayMs = delayMs;
+}
+
+void hostResolverRemove(const char *name) {
+  std::lock_guard<std::mutex> guard(resolverLock);
+  fakeHosts.erase(name);
+}
+
+unsigned hostResolverQueries(const char *name) {
+  std::lock_guard<std::mutex> guard(resolverLock);
+  auto it = fakeHosts.find(name);
+  return it == fakeHosts.end() ? 0 : it->second.queries;
+}
+
+// Всегда асинхронно: у lwIP ERR_OK бывает только из его кэша, а кэш здесь
+// и есть то, что проверяют тесты прошивки
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg) {
+  if (!hostname || !found) return ERR_ARG;
+  std::string name = hostname;
+  bool fake = false;
+  FakeHost host = {};
+  {
+    std::lock_guard<std::mutex> guard(resolverLock);
+    auto it = fakeHosts.find(name);
+    if (it != fakeHosts.end()) {
+      it->second.queries++;
+      host = it->second;
+      fake = true;
+    }
+  }
+
+  std::thread([name, fake, host, found, callback_arg] {
+    ip_addr_t result = {};
+    bool ok = false;
+    if (fake) {
+      delay(host.delayMs);
+      result.u_addr.ip4.addr = host.ip4;
+      ok = host.ip4 != 0;
+    } else {
+      addrinfo hints = {};
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_STREAM;
+      addrinfo *res = nullptr;
+      if (getaddrinfo(name.c_str(), nullptr, &hints, &res) == 0 && res) {
+        result.u_addr.ip4.addr = ((sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+        ok = true;
+      }
+      if (res) freeaddrinfo(res);
+    }
+    found(name.c_str(), ok ? &result : nullptr, callback_arg);
+  }).detach();
+  return ERR_INPROGRESS;
+}
@@ -0,0 +1,81 @@
+#pragma once
+/*
+   Формат записи сессии (AT$CAP) - общий для прошивки и разбора на ПК.
+   Не зависит от Arduino.
+
+   Файл: заголовок CAP_FILE_HEADER_SIZE байт ("WMCAP", версия, 0, 0),
+   дальше записи подряд:
+     тег      1 байт: бит 7 - направление (1 = от терминала в сеть),
+                       биты 0-2 - номер сессии
+     дельта   varint (LEB128): мкс от предыдущей записи
+     длина    varint: байт данных
+     данные
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define CAP_FILE_HEADER_SIZE 8
+#define CAP_VERSION 1
+#define CAP_HDR_MAX (1 + 5 + 5)  // тег и два varint по 32 бита
+#define CAP_OUTBOUND 0x80
+#define CAP_SESSION_MASK 0x07
+
+struct CaptureRecord {
+  bool outbound;
+  uint8_t session;
+  uint32_t deltaUs;
+  uint32_t length;
+};
+
+inline void captureFileHeader(uint8_t *out) {
+  memcpy(out, "WMCAP", 5);
+  out[5] = CAP_VERSION;
+  out[6] = 0;
+  out[7] = 0;
+}
+
+inline bool captureCheckHeader(const uint8_t *p) {
+  return memcmp(p, "WMCAP", 5) == 0 && p[5] == CAP_VERSION;
+}
+
+inline size_t captureEncodeVarint(uint8_t *out, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+// Заголовок записи в out (не меньше CAP_HDR_MAX байт), возвращает длину
+inline size_t captureEncodeHeader(uint8_t *out, const CaptureRecord &rec) {
+  size_t n = 0;
+  out[n++] = (rec.outbound ? CAP_OUTBOUND : 0) | (rec.session & CAP_SESSION_MASK);
+  n += captureEncodeVarint(out + n, rec.deltaUs);
+  n += captureEncodeVarint(out + n, rec.length);
+  return n;
+}
+
+// Разбор заголовка записи. 0 - данных пока не хватает (или varint битый,
+// тогда n >= CAP_HDR_MAX)
+inline size_t captureDecodeHeader(const uint8_t *p, size_t n, CaptureRecord &rec) {
+  if (n == 0) return 0;
+  rec.outbound = p[0] & CAP_OUTBOUND;
+  rec.session = p[0] & CAP_SESSION_MASK;
+  size_t pos = 1;
+  uint32_t *fields[2] = {&rec.deltaUs, &rec.length};
+  for (uint32_t *field : fields) {
+    uint32_t v = 0;
+    for (int shift = 0;; shift += 7) {
+      if (pos >= n || shift > 28) return 0;
+      uint8_t b = p[pos++];
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+    }
+    *field = v;
+  }
+  return pos;
+}
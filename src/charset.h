@@ -0,0 +1,233 @@
+#pragma once
+/*
+   Перекодировка между кодировкой терминала и сетью: PETSCII, ATASCII,
+   CP437 -> UTF-8 для современных терминалов.
+   Однобайтные таблицы собираются при компиляции, перекодируются сразу
+   целые буферы насоса данных. Не зависит от Arduino.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+enum Charset : uint8_t {
+  CS_NONE = 0,
+  CS_PETSCII = 1,     // Commodore, режим со строчными буквами
+  CS_ATASCII = 2,     // Atari 8-bit
+  CS_CP437_UTF8 = 3,  // сеть в CP437 (ANSI-графика), терминал в UTF-8
+  CS_COUNT
+};
+
+// Значение таблицы >= CS_DROP - байт выбрасывается
+#define CS_DROP 0x100
+
+// Таблица из 256 значений f(0x00) .. f(0xFF)
+#define CS_ROW(f, r) f(r + 0x0), f(r + 0x1), f(r + 0x2), f(r + 0x3), f(r + 0x4), f(r + 0x5), \
+                     f(r + 0x6), f(r + 0x7), f(r + 0x8), f(r + 0x9), f(r + 0xA), f(r + 0xB), \
+                     f(r + 0xC), f(r + 0xD), f(r + 0xE), f(r + 0xF)
+#define CS_TABLE(f) { CS_ROW(f, 0x00), CS_ROW(f, 0x10), CS_ROW(f, 0x20), CS_ROW(f, 0x30), \
+                      CS_ROW(f, 0x40), CS_ROW(f, 0x50), CS_ROW(f, 0x60), CS_ROW(f, 0x70), \
+                      CS_ROW(f, 0x80), CS_ROW(f, 0x90), CS_ROW(f, 0xA0), CS_ROW(f, 0xB0), \
+                      CS_ROW(f, 0xC0), CS_ROW(f, 0xD0), CS_ROW(f, 0xE0), CS_ROW(f, 0xF0) }
+
+// --- PETSCII ---
+// В режиме со строчными буквами 0x41-0x5A - строчные, 0xC1-0xDA (и
+// 0x61-0x7A) - заглавные. DEL (0x14) - забой, строку переводит CR.
+
+constexpr uint16_t petsciiToAscii(int c) {
+  return c == 0x14 ? 0x08 :
+         (c >= 0x41 && c <= 0x5A) ? c + 0x20 :
+         (c >= 0x61 && c <= 0x7A) ? c - 0x20 :
+         (c >= 0xC1 && c <= 0xDA) ? c - 0x80 :
+         c == 0xA0 ? 0x20 :
+         c;
+}
+
+constexpr uint16_t asciiToPetscii(int c) {
+  return (c == 0x08 || c == 0x7F) ? 0x14 :
+         c == 0x0A ? CS_DROP :
+         (c >= 0x41 && c <= 0x5A) ? c + 0x80 :
+         (c >= 0x61 && c <= 0x7A) ? c - 0x20 :
+         c;
+}
+
+// --- ATASCII ---
+// Печатные символы совпадают с ASCII, конец строки - 0x9B.
+
+constexpr uint16_t atasciiToAscii(int c) {
+  return c == 0x9B ? 0x0D :
+         c == 0x7E ? 0x08 :
+         c == 0x7F ? 0x09 :
+         c == 0xFD ? 0x07 :
+         c;
+}
+
+constexpr uint16_t asciiToAtascii(int c) {
+  return c == 0x0D ? 0x9B :
+         c == 0x0A ? CS_DROP :
+         c == 0x08 ? 0x7E :
+         c == 0x09 ? 0x7F :
+         c == 0x07 ? 0xFD :
+         c;
+}
+
+static constexpr uint16_t csPetsciiIn[256] = CS_TABLE(petsciiToAscii);
+static constexpr uint16_t csPetsciiOut[256] = CS_TABLE(asciiToPetscii);
+static constexpr uint16_t csAtasciiIn[256] = CS_TABLE(atasciiToAscii);
+static constexpr uint16_t csAtasciiOut[256] = CS_TABLE(asciiToAtascii);
+
+// --- CP437 ---
+// Управляющие коды оставляем как есть (ANSI-графике нужны ESC, CR, LF),
+// 0x7F-0xFF - символы IBM PC.
+
+static constexpr uint16_t cp437High[128] = {
+  0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+  0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+  0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+  0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+  0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+  0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+  0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+  0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0,
+};
+
+constexpr uint16_t cp437ToUnicode(int c) {
+  return c < 0x7F ? c : c == 0x7F ? 0x2302 : cp437High[c - 0x80];
+}
+
+// Готовая UTF-8 последовательность для каждого байта CP437
+struct Utf8Seq {
+  uint8_t len;
+  uint8_t b[3];
+};
+
+constexpr Utf8Seq utf8Encode(uint16_t cp) {
+  return cp < 0x80 ? Utf8Seq{1, {(uint8_t)cp, 0, 0}} :
+         cp < 0x800 ? Utf8Seq{2, {(uint8_t)(0xC0 | (cp >> 6)), (uint8_t)(0x80 | (cp & 0x3F)), 0}} :
+         Utf8Seq{3, {(uint8_t)(0xE0 | (cp >> 12)), (uint8_t)(0x80 | ((cp >> 6) & 0x3F)), (uint8_t)(0x80 | (cp & 0x3F))}};
+}
+
+constexpr Utf8Seq cp437Utf8(int c) { return utf8Encode(cp437ToUnicode(c)); }
+
+static constexpr Utf8Seq csCp437Utf8[256] = CS_TABLE(cp437Utf8);
+
+static_assert(csPetsciiIn[0xC1] == 'A' && csPetsciiOut['a'] == 0x41, "PETSCII table");
+static_assert(csCp437Utf8[0xDB].len == 3 && csCp437Utf8[0xDB].b[0] == 0xE2, "CP437 table");
+
+// Однобайтная перекодировка без ветвлений: выброшенные байты просто
+// не сдвигают выход
+inline size_t csMapBuffer(const uint16_t *table, const uint8_t *in, size_t n, uint8_t *out) {
+  size_t j = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint16_t t = table[in[i]];
+    out[j] = (uint8_t)t;
+    j += t < CS_DROP;
+  }
+  return j;
+}
+
+class CharsetTranslator {
+public:
+  void reset() {
+    utfCode = 0;
+    utfNeed = 0;
+  }
+
+  // Один символ командного режима (входные таблицы ничего не выбрасывают)
+  static uint8_t fromTerminalByte(Charset cs, uint8_t c) {
+    if (cs == CS_PETSCII) return csPetsciiIn[c];
+    if (cs == CS_ATASCII) return csAtasciiIn[c];
+    return c;
+  }
+
+  // Терминал -> сеть. Выход не длиннее входа: out должен вмещать n байт.
+  // UTF-8 собирается с учетом последовательностей, разрезанных между буферами.
+  size_t fromTerminal(Charset cs, const uint8_t *in, size_t n, uint8_t *out) {
+    switch (cs) {
+      case CS_PETSCII: return csMapBuffer(csPetsciiIn, in, n, out);
+      case CS_ATASCII: return csMapBuffer(csAtasciiIn, in, n, out);
+      case CS_CP437_UTF8: return utf8ToCp437(in, n, out);
+      default:
+        memcpy(out, in, n);
+        return n;
+    }
+  }
+
+  // Сеть -> терминал. Берет из in столько, сколько влезет в outSize,
+  // в consumed возвращает число взятых байт. CP437 раскрывается до 3 байт.
+  static size_t toTerminal(Charset cs, const uint8_t *in, size_t n, uint8_t *out, size_t outSize, size_t &consumed) {
+    if (cs == CS_CP437_UTF8) return cp437ToUtf8(in, n, out, outSize, consumed);
+    consumed = n < outSize ? n : outSize;
+    switch (cs) {
+      case CS_PETSCII: return csMapBuffer(csPetsciiOut, in, consumed, out);
+      case CS_ATASCII: return csMapBuffer(csAtasciiOut, in, consumed, out);
+      default:
+        memcpy(out, in, consumed);
+        return consumed;
+    }
+  }
+
+private:
+  uint32_t utfCode = 0;
+  uint8_t utfNeed = 0;
+
+  static size_t cp437ToUtf8(const uint8_t *in, size_t n, uint8_t *out, size_t outSize, size_t &consumed) {
+    size_t i = 0, j = 0;
+    while (i < n) {
+      // Участок ASCII копируем целиком
+      size_t run = 0;
+      size_t maxRun = n - i < outSize - j ? n - i : outSize - j;
+      while (run < maxRun && in[i + run] < 0x7F) run++;
+      memcpy(out + j, in + i, run);
+      i += run;
+      j += run;
+      if (i == n) break;
+      if (in[i] < 0x7F) break; // выход заполнен
+
+      const Utf8Seq &seq = csCp437Utf8[in[i]];
+      if (j + seq.len > outSize) break;
+      for (uint8_t k = 0; k < seq.len; k++) out[j++] = seq.b[k];
+      i++;
+    }
+    consumed = i;
+    return j;
+  }
+
+  static uint8_t unicodeToCp437(uint32_t cp) {
+    if (cp < 0x7F) return cp;
+    if (cp == 0x2302) return 0x7F;
+    for (int k = 0; k < 128; k++) {
+      if (cp437High[k] == cp) return 0x80 + k;
+    }
+    return '?';
+  }
+
+  size_t utf8ToCp437(const uint8_t *in, size_t n, uint8_t *out) {
+    size_t j = 0;
+    for (size_t i = 0; i < n; i++) {
+      uint8_t c = in[i];
+      if (utfNeed) {
+        if ((c & 0xC0) == 0x80) {
+          utfCode = (utfCode << 6) | (c & 0x3F);
+          if (--utfNeed == 0) out[j++] = unicodeToCp437(utfCode);
+          continue;
+        }
+        utfNeed = 0; // оборванная последовательность - разбираем c заново
+      }
+      if (c < 0x80) {
+        out[j++] = c;
+      } else if ((c & 0xE0) == 0xC0) {
+        utfCode = c & 0x1F;
+        utfNeed = 1;
+      } else if ((c & 0xF0) == 0xE0) {
+        utfCode = c & 0x0F;
+        utfNeed = 2;
+      } else if ((c & 0xF8) == 0xF0) {
+        utfCode = c & 0x07;
+        utfNeed = 3;
+      }
+      // одиночные байты продолжения выбрасываем
+    }
+    return j;
+  }
+};
@@ -9,6 +9,21 @@
 #include <WebServer.h>
 #include <ESPmDNS.h>
 #include <Preferences.h>
+#include <LittleFS.h>
+#include <lwip/dns.h>
+#include <lwip/sockets.h>
+#include <lwip/tcpip.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/sha1.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/version.h>
+#include <esp32s3/rom/crc.h>
+#include <esp32s3/rom/miniz.h>
+#include "modem_core.h"
+#include "charset.h"
+#include "capture.h"
+#include "trace.h"
 
 // тач пины
 #define TOUCH1 8
@@ -49,57 +64,367 @@
 // Настройки по умолчанию
 #define DEFAULT_BAUD 115200
 #define LISTEN_PORT 6400
+#define LISTEN_BACKLOG 4       // очередь SYN в lwIP
+#define LISTEN_QUEUE 2         // принятых звонков ждут RING/ATA
+#define LISTEN_PENDING_MS 60000UL  // дольше звонок не ждет ответа
+#define LISTEN_ACCEPT_MAX 8    // accept() за один проход loop()
+#define LISTEN_RATE 2          // звонков в секунду в среднем (ведро токенов)
+#define LISTEN_BURST 8         // емкость ведра
+#define LISTEN_PEERS 16        // адресов в таблице ограничения
+#define LISTEN_PER_IP 4        // звонков с одного адреса за окно
+#define LISTEN_WINDOW_MS 10000UL
 #define MAX_CMD_LENGTH 256
-#define TX_BUF_SIZE 256
+#define TX_BUF_SIZE 2048   // компьютер -> сеть (степень двойки)
+#define RX_BUF_SIZE 2048   // сеть -> компьютер (степень двойки)
+#define PUMP_CHUNK 256     // сколько байт забираем за один вызов read()
+#define SERIAL_IN_SIZE 1024   // USB -> задачи (степень двойки)
+#define SERIAL_OUT_SIZE 4096  // задачи -> USB (степень двойки)
 
+// Пороги управления потоком: выше HIGH - останавливаем источник,
+// ниже LOW - снова пускаем (гистерезис, чтобы не дергаться на границе)
+#define TX_HIGH_WATER (TX_BUF_SIZE * 3 / 4)
+#define TX_LOW_WATER (TX_BUF_SIZE / 4)
+#define RX_HIGH_WATER (RX_BUF_SIZE * 3 / 4)
+#define RX_LOW_WATER (RX_BUF_SIZE / 4)
+#define SERIAL_IN_HIGH_WATER (SERIAL_IN_SIZE * 3 / 4)
+#define SERIAL_IN_LOW_WATER (SERIAL_IN_SIZE / 4)
+#define XON 0x11
+#define XOFF 0x13
+#define MAX_HOST_LENGTH 64
+#define MAX_DIAL_LENGTH (MAX_HOST_LENGTH + 6)  // host:port
+#define MAX_SSID_LENGTH 32
+#define MAX_PASS_LENGTH 64
+#define MAX_BUSY_LENGTH 80
+#define TIME_STR_SIZE 10  // "hh:mm:ss"
+#define IP_STR_SIZE 16
+#define MAX_SESSIONS 4     // одновременных TCP соединений
+#define TLS_MAX_LINKS 2    // одновременных TLS звонков (буферы записей mbedtls ~20 КБ)
+#define TLS_CACHE_SIZE 4   // хостов в кэше TLS сессий
+#define TLS_DEFAULT_PORT 992  // telnets
+#define WIFI_ATTEMPT_MS 10000   // одна попытка подключения
+#define WIFI_BACKOFF_MIN 500     // первая пауза перед повтором, мс
+#define WIFI_BACKOFF_MAX 60000   // предел экспоненциальной паузы, мс
+#define NET_TASK_CORE 0       // ядро стека WiFi
+#define SERIAL_TASK_CORE 1
+#define NET_TASK_PRIO 5        // выше loop() (1)
+#define SERIAL_TASK_PRIO 5
+#define WEB_TASK_CORE 0
+#define WEB_TASK_PRIO 1        // только когда насос простаивает
+#define WEB_CHUNK 512          // размер куска chunked ответа
+#define WS_PORT 81             // WebSocket веб-терминала
+#define WS_MAX_VIEWERS 4
+#define WS_FEED_SIZE 4096      // общий буфер зеркала потока (степень двойки)
+#define WS_FRAME_MAX 1024      // данных в одном кадре
+#define WS_FLUSH_MIN 5         // интервал сборки кадра, мс
+#define WS_FLUSH_MAX 80
+#define WS_STALL_MS 3000       // сколько ждем зрителя, не принимающего кадр
+#define WS_HANDSHAKE_MS 1000
+#define WS_IN_MAX 256          // входящий кадр от браузера
+#define CAPTURE_FILE "/capture.wmc"
+#define CAP_BUF_SIZE 4096      // половина двойного буфера записи
+#define CAP_FLUSH_MS 1000      // недописанная половина уходит на флеш не реже
+#define CAPTURE_TASK_PRIO 1
+#define REPLAY_BUF_SIZE 512
+#define TRACE_RING_SIZE 16384  // события насоса для ATHEX (степень двойки)
+#define TRACE_TAIL_SIZE 8192   // последний текст трассировки для /trace (степень двойки)
+#define TRACE_TASK_PRIO 1
+#define FS_TASK_PRIO 1         // монтирование LittleFS, один раз после загрузки
+#define TRACE_UART_BAUD 921600 // Serial1, пины UART1 по умолчанию
+#define TRACE_FILE "/trace.txt"
+#define TRACE_FILE_MAX (512 * 1024UL)
+#define SCROLLBACK_SIZE (256 * 1024)  // история приема в PSRAM (степень двойки)
+#define SCROLLBACK_SMALL (16 * 1024)  // без PSRAM - во внутренней памяти
+#define XFER_IDLE_MS 3000      // тишина, после которой передача файла считается законченной
+#define PACE_TICK_US 1000      // период таймера ведра токенов
+#define DNS_CACHE_SIZE 8
+#define DNS_PREFETCH_MAX (DNS_CACHE_SIZE / 2) // прогреваемых имен: остальное - ручным звонкам
+#define WARM_MAX 2             // прогретых соединений к быстрым номерам
+#define WARM_CHECK_MS 500      // период проверки пула
+#define WARM_IDLE_MS 120000UL  // дольше не держим - BBS сама рвет простаивающих
+#define WARM_COOLDOWN_MS 60000UL  // пауза перед повторным прогревом номера
+#define WARM_HOST_GAP_MS 180000UL // прогревающих звонков на один адрес - не чаще
+#define WARM_HOSTS 4              // адресов в учете WARM_HOST_GAP_MS
+#define DNS_TTL_DEFAULT 60     // сек, AT$DNSTTL; lwIP не отдает TTL ответа наружу
 
 // Глобальные переменные
 WebServer webServer(80);
-WiFiClient tcpClient;
-WiFiServer tcpServer(LISTEN_PORT);
 Preferences preferences;
 
-String cmd = "";
-bool cmdMode = true;
-bool callConnected = false;
+char cmdLine[MAX_CMD_LENGTH + 1];
+size_t cmdLen = 0;
+volatile bool cmdMode = true;
 bool telnet = false;
 bool verboseResults = true;
 bool echo = true;
-bool autoAnswer = false;
-bool petTranslate = false;
-String ssid = "*******";
-String password = "******";
-String busyMsg = "SORRY, SYSTEM IS BUSY. PLEASE TRY AGAIN LATER.";
-String speedDials[10];
+uint8_t charset = CS_NONE; // ATPETn: кодировка терминала
+CharsetTranslator terminalCharset;
+const char *const charsetNames[CS_COUNT] = {"NONE", "PETSCII", "ATASCII", "CP437 > UTF-8"};
+bool paceLine = false;     // выдавать данные со скоростью currentBaudRate
+uint8_t flowControl = 3;   // AT&K: 0 = нет, 3 = RTS/CTS (USB), 4 = XON/XOFF
+// AT$WS. Ввод из браузера идет в сессию без пароля, поэтому только по
+// явному AT$WS=2; по умолчанию и после AT&F - только просмотр
+enum WsMode { WS_OFF, WS_VIEW, WS_INTERACTIVE };
+uint8_t wsMode = WS_VIEW;
+bool mccpEnabled = true;   // AT$MCCP: соглашаться на сжатие telnet (MCCP2)
+uint8_t warmSize = 0;      // AT$WARM: держать прогретыми n самых частых быстрых номеров
+uint16_t dialCounts[10];   // сколько раз звонили на каждый быстрый номер
+uint16_t dnsTtl = DNS_TTL_DEFAULT; // AT$DNSTTL: сколько секунд верить кэшу DNS, 0 = не кэшировать
+// Настройки и строки состояния - в статических буферах: на командном пути
+// и в насосе данных нет ни String, ни new. Кучу после загрузки берут
+// только сессии (WiFiClient), TLS и LittleFS.
+#define DEFAULT_BUSY_MSG "SORRY, SYSTEM IS BUSY. PLEASE TRY AGAIN LATER."
+char ssid[MAX_SSID_LENGTH + 1] = "*******";
+char password[MAX_PASS_LENGTH + 1] = "******";
+char busyMsg[MAX_BUSY_LENGTH + 1] = DEFAULT_BUSY_MSG;
+char speedDials[10][MAX_DIAL_LENGTH + 1];
+uint32_t heapAfterSetup = 0;  // свободная куча в конце загрузки, для ATI
+unsigned long bootOkUs = 0;   // от сброса до первого OK
+unsigned long bootLateUs = 0; // второй этап загрузки (bootFinish)
+bool bootDone = false;
 int currentBaudRate = DEFAULT_BAUD;
-unsigned long connectTime = 0;
+
+// S-регистры (нумерация как у Hayes)
+#define SREG_COUNT 13
+enum SRegister {
+  S_AUTOANSWER = 0,  // ответ после N звонков, 0 = выключено
+  S_RINGCOUNT = 1,   // счетчик звонков
+  S_ESCAPE = 2,      // символ перехода в командный режим
+  S_CR = 3,          // конец строки команды
+  S_LF = 4,
+  S_BS = 5,          // забой
+  S_WAITCARRIER = 7, // таймаут соединения, сек
+  S_GUARD = 12       // защитная пауза +++, 1/50 сек
+};
+const uint8_t sRegDefaults[SREG_COUNT] = {0, 0, '+', 13, 10, 8, 2, 30, 2, 6, 14, 95, 50};
+uint8_t sRegs[SREG_COUNT];
+
+// +++ Переход в командный режим
+int plusCount = 0;
+unsigned long plusTime = 0;
+
+// Статистика насоса данных (для сравнения пропускной способности)
+struct PumpStats {
+  uint32_t txBytes;      // отправлено в сеть
+  uint32_t txWrites;     // вызовов tcpClient.write() = TCP сегментов при NoDelay
+  uint32_t rxBytes;      // получено из сети
+  uint32_t rxReads;      // вызовов tcpClient.read()
+  uint32_t shortWrites;  // tcpClient.write() принял меньше, чем просили
+  uint32_t serialStalls; // serialOut полон - данные ждут в rx
+  uint32_t txPauses;     // tx выше порога - перестали брать данные с терминала
+  uint32_t rxPauses;     // rx выше порога - перестали читать сокет
+};
+
+// Метрики горячих путей. Каждую гистограмму пишет только одна задача,
+// ATI и /metrics читают снимок без блокировок.
+struct Metrics {
+  LatencyHistogram netLoop;       // проход netTask, мкс
+  LatencyHistogram mainLoop;      // проход loop(), мкс
+  LatencyHistogram dial;          // от ATD до CONNECT, мкс
+  LatencyHistogram tcpConnect;    // connect() до готовности сокета, мкс
+  LatencyHistogram tlsFull;       // полное рукопожатие TLS, мкс
+  LatencyHistogram tlsCached;     // рукопожатие с возобновлением сессии, мкс
+  LatencyHistogram netStall;      // сколько сокет не принимал данные, мкс
+  LatencyHistogram serialStall;   // сколько serialOut был полон, мкс
+  LatencyHistogram paceJitter;    // отклонение выдачи от скорости линии, мкс
+  uint32_t usbStalls;             // Serial.availableForWrite() == 0 в serialTask
+};
+Metrics metrics;
+
+struct TlsLink;
+
+// Одно TCP соединение - исходящее или входящее. К последовательному порту
+// подключена одна сессия (attached), остальные продолжают принимать данные
+// в свои буферы, чтобы удаленная сторона не простаивала.
+struct Session {
+  bool active;
+  bool inbound;
+  bool telnet;
+  WiFiClient client;
+  TlsLink *tlsLink;               // nullptr - открытый telnet
+  unsigned long tcpUs;            // время установки соединения при наборе
+  unsigned long tlsUs;
+  RingBuffer<TX_BUF_SIZE> tx;
+  RingBuffer<RX_BUF_SIZE> rx;
+  TelnetParser parser;
+  unsigned long connectTime;
+  PumpStats stats;
+  unsigned long netStallStart;    // мкс, 0 = не стоим
+  unsigned long serialStallStart;
+  bool txPaused;
+  bool rxPaused;
+  TransferDetector detector;
+  uint8_t transfer;               // TransferProto идущей передачи файла
+  unsigned long transferStart;    // мс
+  unsigned long transferLast;     // мс, последний байт передачи
+  uint32_t transferBytes;
+};
+Session sessions[MAX_SESSIONS];
+
+// Последняя законченная передача файла - для ATI
+struct TransferStats {
+  uint8_t proto;
+  uint32_t bytes;
+  unsigned long ms;
+  uint32_t count;
+};
+TransferStats lastTransfer;
+const char *const transferNames[] = {"NONE", "ZMODEM", "X/YMODEM"};
+int attached = -1; // -1 = нет соединения
+
+// Конвейер на два ядра: serialTask владеет USB, netTask - сокетами,
+// между ними - SPSC буферы. loop() остается командный режим и обслуживание.
+// serialIn читает netTask в режиме данных и loop() в командном; смена
+// владельца происходит только вместе с переключением cmdMode под sessionLock.
+SpscRing<SERIAL_IN_SIZE> serialIn;
+SpscRing<SERIAL_OUT_SIZE> serialOut;
+TaskHandle_t netTaskHandle = nullptr;
+TaskHandle_t serialTaskHandle = nullptr;
+SemaphoreHandle_t sessionLock = nullptr;
+volatile bool escapeDone = false; // +++ сработал в netTask, OK печатает loop()
+volatile bool dteStopped = false; // терминал прислал XOFF
+bool xoffSent = false;            // мы прислали терминалу XOFF
+uint32_t serialWrites = 0;        // вызовов Serial.write() в serialTask
+// Зеркало потока для веб-терминала: пишет netTask, читает webTask
+SpscRing<WS_FEED_SIZE> wsFeed;
+volatile int wsViewerCount = 0;
+uint32_t wsDropped = 0;           // не влезло в wsFeed
+uint32_t wsFrames = 0;
+uint32_t wsBytes = 0;
+unsigned long wsFlushMs = WS_FLUSH_MIN;  // текущий интервал сборки кадра
+
+// Запись сессии: netTask заполняет одну половину, captureTask пишет другую
+enum CaptureState { CAP_OFF, CAP_RECORDING, CAP_STOPPING };
+struct Capture {
+  volatile uint8_t state;
+  File file;
+  uint8_t buf[2][CAP_BUF_SIZE];
+  size_t len[2];
+  std::atomic<bool> ready[2];  // половина ждет записи на флеш
+  int active;                  // заполняемая половина
+  unsigned long lastRecord;    // micros() последней записи
+  unsigned long swapTime;
+  uint32_t records;
+  uint32_t bytes;
+  uint32_t dropped;            // не было свободной половины
+  uint32_t fileBytes;
+  unsigned long maxWriteUs;    // самая долгая запись на флеш
+};
+Capture capture;
+TaskHandle_t captureTaskHandle = nullptr;
+volatile bool fsMounted = false;  // ставит fsMountTask
+unsigned long fsMountMs = 0;
+
+// Трассировка ATHEX: netTask кладет события в кольцо, traceTask
+// форматирует и отправляет в выбранный вывод. Полное кольцо - событие
+// теряется, насос никогда не ждет.
+enum TraceSink { TRACE_OFF, TRACE_UART, TRACE_FILE_SINK, TRACE_WEB };
+struct Trace {
+  volatile uint8_t mode;       // TraceSink, меняет loop()
+  SpscRing<TRACE_RING_SIZE> ring;
+  uint32_t events;
+  uint32_t bytes;
+  uint32_t dropped;            // байт не влезло в кольцо
+  unsigned long producerUs;    // время netTask в traceRecord()
+  // дальше - только traceTask (хвост еще читает webTask под tailLock)
+  uint8_t sink;                // открытый вывод
+  File file;
+  uint32_t fileBytes;
+  uint32_t textBytes;
+  char tail[TRACE_TAIL_SIZE];
+  uint32_t tailPos;
+  SemaphoreHandle_t tailLock;
+};
+Trace trace;
+TaskHandle_t traceTaskHandle = nullptr;
+
+// Распаковка MCCP2 (telnet-опция 86)
+struct Mccp {
+  int owner = -1;                // сессия, которой отдан распаковщик
+  bool active;                   // идет поток zlib
+  tinfl_decompressor *inflator;  // выделяются один раз в bootFinish()
+  uint8_t *dict;                 // TINFL_LZ_DICT_SIZE, кольцевой
+  size_t dictOfs;
+  size_t pendOfs;                // распаковано, но еще не отдано разборщику
+  size_t pendLen;
+  bool moreOutput;
+  uint8_t in[PUMP_CHUNK];        // блок из сокета, ждущий разбора
+  size_t inPos;
+  size_t inLen;
+  uint32_t compressedBytes;
+  uint32_t inflatedBytes;
+  uint32_t streams;
+  uint32_t errors;
+  unsigned long cpuUs;           // время в tinfl_decompress
+};
+Mccp mccp;
+
+// Таблица сессий меняется из loop() и netTask - берем рекурсивный мьютекс
+class SessionLock {
+public:
+  SessionLock() { xSemaphoreTakeRecursive(sessionLock, portMAX_DELAY); }
+  ~SessionLock() { xSemaphoreGiveRecursive(sessionLock); }
+};
+
+// Состояние подключения к WiFi (см. wifiStep())
+enum WiFiState { WIFI_IDLE, WIFI_CONNECTING, WIFI_UP, WIFI_BACKOFF };
+struct WiFiManager {
+  WiFiState state;
+  bool wanted;                 // ATC1 или автоподключение при старте
+  bool fast;                   // текущая попытка - по сохраненным BSSID/каналу
+  bool haveFast;
+  uint8_t bssid[6];
+  int32_t channel;
+  unsigned long attemptStart;
+  unsigned long downSince;     // начало отсчета time-to-IP
+  unsigned long backoff;
+  unsigned long lastTimeToIp;  // мс
+  bool lastWasFast;
+  uint32_t reconnects;
+  volatile bool gotIp;         // выставляются из обработчика событий
+  volatile bool lostLink;
+};
+WiFiManager wifiMgr;
 
 // Доступные скорости
 const long baudRates[] = {300, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
 
 // Результаты AT команд
-const String resultCodes[] = {"OK", "CONNECT", "RING", "NO CARRIER", "ERROR", "", "NO DIALTONE", "BUSY", "NO ANSWER"};
+const char *const resultCodes[] = {"OK", "CONNECT", "RING", "NO CARRIER", "ERROR", "", "NO DIALTONE", "BUSY", "NO ANSWER"};
 enum ResultCode {A_OK,A_CONNECT, A_RING, A_NOCARRIER, A_ERROR, A_NONE, A_NODIALTONE, A_BUSY, A_NOANSWER};
 
-String connectTimeString() {
+// Строка копируется с обрезкой по размеру буфера
+void setText(char *dst, size_t size, const char *src) {
+  size_t n = strnlen(src, size - 1);
+  memcpy(dst, src, n);
+  dst[n] = 0;
+}
+
+// Адрес в буфер вызывающего (IP_STR_SIZE байт), без IPAddress::toString()
+const char *ipString(IPAddress ip, char *buffer) {
+  snprintf(buffer, IP_STR_SIZE, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return buffer;
+}
+
+// Время соединения в буфер вызывающего (TIME_STR_SIZE байт)
+const char *connectTimeString(unsigned long connectTime, char *buffer) {
   if (connectTime == 0) return "00:00:00";
-  unsigned long now = millis();
-  int secs = (now - connectTime) / 1000;
-  int mins = secs / 60;
-  int hours = mins / 60;
-  char buffer[10];
-  sprintf(buffer, "%02d:%02d:%02d", hours % 100, mins % 60, secs % 60);
-  return String(buffer);
+  // Беззнаковые: каждое поле - ровно две цифры, строка влезает в буфер
+  unsigned secs = (millis() - connectTime) / 1000;
+  unsigned mins = secs / 60;
+  unsigned hours = mins / 60;
+  snprintf(buffer, TIME_STR_SIZE, "%02u:%02u:%02u", hours % 100, mins % 60, secs % 60);
+  return buffer;
 }
 
-void sendResult(ResultCode result) {
+void sendResult(ResultCode result, unsigned long connectTime = 0) {
   Serial.print("\r\n");
   if (result == A_CONNECT) {
     Serial.print("CONNECT ");
     Serial.println(currentBaudRate);
   } else if (result == A_NOCARRIER) {
+    char timeStr[TIME_STR_SIZE];
     Serial.print("NO CARRIER (");
-    Serial.print(connectTimeString());
+    Serial.print(connectTimeString(connectTime, timeStr));
     Serial.println(")");
   } else {
     Serial.println(resultCodes[result]);
@@ -107,623 +432,3965 @@ void sendResult(ResultCode result) {
   Serial.print("\r\n");
 }
 
-void sendString(const String& msg) {
+void sendString(const char *msg) {
   Serial.print("\r\n");
   Serial.println(msg);
   Serial.print("\r\n");
 }
 
+bool callConnected() {
+  return attached >= 0;
+}
+
+Session *currentSession() {
+  return attached >= 0 ? &sessions[attached] : nullptr;
+}
+
 void updateLed() {
-  if (callConnected) {
+  if (callConnected()) {
     digitalWrite(LED_PIN, LOW);   // Горит при соединении
   } else if (WiFi.status() == WL_CONNECTED) {
     digitalWrite(LED_PIN, LOW);   // Горит при подключении к WiFi
+  } else if (wifiMgr.state == WIFI_CONNECTING) {
+    digitalWrite(LED_PIN, (millis() / 250) & 1); // Мигаем при подключении
   } else {
     digitalWrite(LED_PIN, HIGH);  // Не горит
   }
 }
 
-void loadSettings() {
-  preferences.begin("wifi-modem", true); // true = read-only
-  
-  ssid = preferences.getString("ssid", "******");
-  password = preferences.getString("pass", "******");
-  busyMsg = preferences.getString("busymsg", "SORRY, SYSTEM IS BUSY. PLEASE TRY AGAIN LATER.");
-  currentBaudRate = preferences.getInt("baud", DEFAULT_BAUD);
-  echo = preferences.getBool("echo", true);
-  autoAnswer = preferences.getBool("autoanswer", false);
-  telnet = preferences.getBool("telnet", false);
-  verboseResults = preferences.getBool("verbose", true);
-  petTranslate = preferences.getBool("petscii", false);
-  
-  // Загрузка быстрых номеров
-  for (int i = 0; i < 10; i++) {
-    char key[10];
-    sprintf(key, "speed%d", i);
-    speedDials[i] = preferences.getString(key, "");
+// === ЭМУЛЯЦИЯ СКОРОСТИ ЛИНИИ ===
+// USB CDC всегда работает на полной скорости. При AT$PACE=1 байты к
+// компьютеру выдаются по ведру токенов: аппаратный таймер раз в
+// PACE_TICK_US добавляет кредит на currentBaudRate/10 байт в секунду,
+// serialTask тратит его. Пока данные ждут, они копятся в serialOut и rx
+// сессии, а когда те полны, сессия перестает читать сокет и сервер
+// упирается в окно TCP - ничего не теряется.
+
+hw_timer_t *paceTimer = nullptr;
+volatile uint32_t paceRate = 0;        // байт/с = милли-байт за тик
+volatile uint32_t paceBurst = 0;       // предел кредита, милли-байт
+std::atomic<uint32_t> paceCredit(0);   // милли-байт
+unsigned long paceLastRelease = 0;     // мкс, 0 = очередь была пуста
+
+void IRAM_ATTR onPaceTick() {
+  paceCredit.fetch_add(paceRate * (PACE_TICK_US / 1000), std::memory_order_relaxed);
+  if (serialTaskHandle && !serialOut.empty()) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(serialTaskHandle, &woken);
+    portYIELD_FROM_ISR(woken);
   }
-  
-  preferences.end();
 }
 
-void saveSettings() {
-  preferences.begin("wifi-modem", false); // false = read-write
-  
-  preferences.putString("ssid", ssid);
-  preferences.putString("pass", password);
-  preferences.putString("busymsg", busyMsg);
-  preferences.putInt("baud", currentBaudRate);
-  preferences.putBool("echo", echo);
-  preferences.putBool("autoanswer", autoAnswer);
-  preferences.putBool("telnet", telnet);
-  preferences.putBool("verbose", verboseResults);
-  preferences.putBool("petscii", petTranslate);
-  
-  // Сохранение быстрых номеров
-  for (int i = 0; i < 10; i++) {
-    char key[10];
-    sprintf(key, "speed%d", i);
-    preferences.putString(key, speedDials[i]);
+void pacerConfigure() {
+  paceRate = currentBaudRate / 10; // 8N1: 10 бит на байт
+  // Не больше 10 мс линии подряд, но хотя бы один байт
+  paceBurst = max((uint32_t)1000, paceRate * 10);
+  paceCredit.store(0);
+  paceLastRelease = 0;
+
+  if (paceLine && !paceTimer) {
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+    paceTimer = timerBegin(1000000);
+    timerAttachInterrupt(paceTimer, &onPaceTick);
+    timerAlarm(paceTimer, PACE_TICK_US, true, 0);
+#else
+    paceTimer = timerBegin(0, 80, true); // 1 МГц
+    timerAttachInterrupt(paceTimer, &onPaceTick, true);
+    timerAlarmWrite(paceTimer, PACE_TICK_US, true);
+    timerAlarmEnable(paceTimer);
+#endif
+  } else if (!paceLine && paceTimer) {
+    timerEnd(paceTimer);
+    paceTimer = nullptr;
   }
-  
-  preferences.end();
-  Serial.println("Settings saved to NVRAM");
 }
 
-void factoryReset() {
-  preferences.begin("wifi-modem", false);
-  preferences.clear();
-  preferences.end();
-  
-  ssid = "";
-  password = "";
-  busyMsg = "SORRY, SYSTEM IS BUSY. PLEASE TRY AGAIN LATER.";
-  currentBaudRate = DEFAULT_BAUD;
-  echo = true;
-  autoAnswer = false;
-  telnet = false;
-  verboseResults = true;
-  petTranslate = false;
-  
-  for (int i = 0; i < 10; i++) {
-    speedDials[i] = "";
+// Сколько байт можно выдать сейчас
+size_t pacerAllowance() {
+  uint32_t credit = paceCredit.load(std::memory_order_relaxed);
+  if (credit > paceBurst) {
+    paceCredit.fetch_sub(credit - paceBurst, std::memory_order_relaxed);
+    credit = paceBurst;
   }
-  speedDials[0] = "bbs.fozztexx.com:23";
-  speedDials[1] = "cottonwoodbbs.dyndns.org:6502";
-  
-  Serial.println("Factory defaults restored");
+  return credit / 1000;
 }
 
-void connectWiFi() {
-  if (ssid.length() == 0) {
-    Serial.println("ERROR: SSID not configured. Use AT$SSID=your_ssid");
-    return;
+// История приема подключенной сессии. В режиме данных сюда копируется
+// все, что ушло на терминал, в командном - все, что пришло: это
+// отставание выдается на ATO. Пишет только netTask (под sessionLock).
+struct Scrollback {
+  uint8_t *buf;
+  uint32_t mask;           // размер - 1
+  int owner;               // сессия, -1 - нет
+  uint32_t written;        // позиция головы: всего записано
+  uint32_t shown;          // до этой позиции терминал уже все видел
+  bool full;               // отставание заняло всю историю
+  uint32_t peakBacklog;
+  uint32_t fullStalls;     // сколько раз упирались и держали данные в rx
+  uint32_t replayed;       // байт отставания выдано после ATO
+};
+Scrollback scrollback;
+
+// Списываем выданное и меряем, насколько интервал отличается от идеального
+void pacerRelease(size_t bytes) {
+  paceCredit.fetch_sub(bytes * 1000, std::memory_order_relaxed);
+  unsigned long now = micros();
+  if (paceLastRelease && paceRate) {
+    long ideal = (long)(bytes * 1000000ULL / paceRate);
+    long actual = now - paceLastRelease;
+    metrics.paceJitter.record(actual > ideal ? actual - ideal : ideal - actual);
   }
-  
-  Serial.print("CONNECTING TO ");
-  Serial.println(ssid);
-  
-  WiFi.begin(ssid.c_str(), password.c_str());
-  
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
-    digitalWrite(LED_PIN, !digitalRead(LED_PIN)); // Мигаем при подключении
+  paceLastRelease = serialOut.empty() ? 0 : now;
+}
+
+// === TLS ===
+// Telnet поверх TLS (ATDTS host:port). mbedtls работает прямо на
+// неблокирующем сокете сессии: ни рукопожатие, ни запись не ждут сеть.
+// Контексты с буферами записей создаются при первом TLS звонке и дальше
+// только сбрасываются. Сертификат не проверяется (MBEDTLS_SSL_VERIFY_NONE,
+// другого режима нет) - у BBS он почти всегда самоподписанный, TLS здесь
+// защищает канал от чтения, но не от подмены сервера.
+// Кэш сессий по host:port: повторный звонок предлагает серверу прошлую
+// сессию (session ID или ticket) и обходится без полного рукопожатия.
+// Сервер может отказаться - тогда рукопожатие полное, и возобновлением
+// считается только сессия с тем же мастер-ключом.
+
+// Поля сессии в mbedtls 3.x закрыты
+#if MBEDTLS_VERSION_MAJOR >= 3
+#define TLS_SESSION_MASTER(s) ((s).MBEDTLS_PRIVATE(master))
+#else
+#define TLS_SESSION_MASTER(s) ((s).master)
+#endif
+
+struct TlsLink {
+  bool used;
+  bool ready;           // mbedtls_ssl_setup() уже сделан
+  int fd;               // -1 - сокет закрыт, mbedtls его не трогает
+  size_t pendingWrite;  // после WANT_WRITE запись повторяется той же длины
+  mbedtls_ssl_context ssl;
+};
+
+struct TlsCacheEntry {
+  char host[MAX_HOST_LENGTH];
+  uint16_t port;
+  bool valid;
+  unsigned long lastUsed;
+  mbedtls_ssl_session session;
+};
+
+struct Tls {
+  mbedtls_ssl_config conf;
+  bool configured;
+  TlsLink links[TLS_MAX_LINKS];
+  TlsCacheEntry cache[TLS_CACHE_SIZE];
+  uint32_t handshakes;
+  uint32_t resumeOffered;  // рукопожатий с сессией из кэша
+  uint32_t resumed;        // из них сервер согласился
+  uint32_t failures;
+};
+Tls tls;
+
+static int tlsRandom(void *, unsigned char *buf, size_t len) {
+  while (len > 0) {
+    uint32_t r = esp_random();
+    size_t n = min(len, sizeof(r));
+    memcpy(buf, &r, n);
+    buf += n;
+    len -= n;
   }
-  
-  Serial.println();
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.print("CONNECTED TO ");
-    Serial.println(WiFi.SSID());
-    Serial.print("IP ADDRESS: ");
-    Serial.println(WiFi.localIP());
-    updateLed();
-    sendResult(A_OK);
-  } else {
-    Serial.println("CONNECTION FAILED");
-    updateLed();
-    sendResult(A_ERROR);
+  return 0;
+}
+
+static int tlsBioSend(void *ctx, const unsigned char *buf, size_t len) {
+  int res = send(((TlsLink *)ctx)->fd, buf, len, MSG_DONTWAIT);
+  if (res >= 0) return res;
+  return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+static int tlsBioRecv(void *ctx, unsigned char *buf, size_t len) {
+  int res = recv(((TlsLink *)ctx)->fd, buf, len, MSG_DONTWAIT);
+  if (res >= 0) return res; // 0 - сервер закрыл соединение
+  return errno == EAGAIN || errno == EWOULDBLOCK ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+void tlsInit() {
+  mbedtls_ssl_config_init(&tls.conf);
+  tls.configured = mbedtls_ssl_config_defaults(&tls.conf, MBEDTLS_SSL_IS_CLIENT,
+                                               MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) == 0;
+  mbedtls_ssl_conf_authmode(&tls.conf, MBEDTLS_SSL_VERIFY_NONE);
+  mbedtls_ssl_conf_rng(&tls.conf, tlsRandom, nullptr);
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+  mbedtls_ssl_conf_session_tickets(&tls.conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+  for (TlsLink &link : tls.links) {
+    mbedtls_ssl_init(&link.ssl);
+    link.fd = -1;
   }
+  for (TlsCacheEntry &entry : tls.cache) mbedtls_ssl_session_init(&entry.session);
 }
 
-void disconnectWiFi() {
-  WiFi.disconnect();
-  Serial.println("WIFI DISCONNECTED");
-  updateLed();
-  sendResult(A_OK);
+// Свободный контекст для звонка на host; nullptr - все заняты или нет памяти
+TlsLink *tlsAcquire(int fd, const char *host) {
+  if (!tls.configured) return nullptr;
+  for (TlsLink &link : tls.links) {
+    if (link.used) continue;
+    if (!link.ready) {
+      if (mbedtls_ssl_setup(&link.ssl, &tls.conf) != 0) {
+        mbedtls_ssl_free(&link.ssl);
+        mbedtls_ssl_init(&link.ssl);
+        return nullptr;
+      }
+      link.ready = true;
+    }
+    if (mbedtls_ssl_set_hostname(&link.ssl, host) != 0) return nullptr; // SNI
+    link.used = true;
+    link.fd = fd;
+    link.pendingWrite = 0;
+    mbedtls_ssl_set_bio(&link.ssl, &link, tlsBioSend, tlsBioRecv, nullptr);
+    return &link;
+  }
+  return nullptr;
 }
 
-void showNetworkInfo() {
-  Serial.println("=== NETWORK STATUS ===");
-  
-  Serial.print("WIFI: ");
-  switch (WiFi.status()) {
-    case WL_CONNECTED: Serial.println("CONNECTED"); break;
-    case WL_NO_SSID_AVAIL: Serial.println("SSID NOT FOUND"); break;
-    case WL_CONNECT_FAILED: Serial.println("CONNECTION FAILED"); break;
-    case WL_IDLE_STATUS: Serial.println("IDLE"); break;
-    case WL_DISCONNECTED: Serial.println("DISCONNECTED"); break;
-    default: Serial.println("UNKNOWN"); break;
+// Отпустить контекст; close_notify - только пока сокет открыт, без ожидания
+void tlsRelease(TlsLink *link) {
+  if (link->fd >= 0) mbedtls_ssl_close_notify(&link->ssl);
+  mbedtls_ssl_session_reset(&link->ssl);
+  link->fd = -1;
+  link->used = false;
+}
+
+// Один шаг рукопожатия: 1 - готово, 0 - ждем сеть, -1 - ошибка
+int tlsHandshakeStep(TlsLink *link) {
+  int res = mbedtls_ssl_handshake(&link->ssl);
+  if (res == 0) return 1;
+  if (res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE) return 0;
+  return -1;
+}
+
+TlsCacheEntry *tlsCacheFind(const char *host, uint16_t port) {
+  for (TlsCacheEntry &entry : tls.cache) {
+    if (entry.valid && entry.port == port && strcasecmp(entry.host, host) == 0) return &entry;
   }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.print("SSID: "); Serial.println(WiFi.SSID());
-    Serial.print("IP: "); Serial.println(WiFi.localIP());
-    Serial.print("RSSI: "); Serial.print(WiFi.RSSI()); Serial.println(" dBm");
+  return nullptr;
+}
+
+// Прошлая сессия с этим сервером, если есть. true - предложена
+bool tlsCacheOffer(TlsLink *link, const char *host, uint16_t port) {
+  TlsCacheEntry *entry = tlsCacheFind(host, port);
+  if (!entry) return false;
+  entry->lastUsed = millis();
+  return mbedtls_ssl_set_session(&link->ssl, &entry->session) == 0;
+}
+
+// После рукопожатия, до tlsCacheStore(): сервер принял предложенную
+// сессию, если мастер-ключ совпал с кэшем
+bool tlsResumed(TlsLink *link, const char *host, uint16_t port) {
+  TlsCacheEntry *entry = tlsCacheFind(host, port);
+  if (!entry) return false;
+  mbedtls_ssl_session now;
+  mbedtls_ssl_session_init(&now);
+  bool same = mbedtls_ssl_get_session(&link->ssl, &now) == 0 &&
+              memcmp(TLS_SESSION_MASTER(now), TLS_SESSION_MASTER(entry->session),
+                     sizeof(TLS_SESSION_MASTER(now))) == 0;
+  mbedtls_ssl_session_free(&now);
+  return same;
+}
+
+// После рукопожатия: запоминаем сессию, вытесняя самую старую запись
+void tlsCacheStore(TlsLink *link, const char *host, uint16_t port) {
+  TlsCacheEntry *entry = tlsCacheFind(host, port);
+  if (!entry) {
+    entry = &tls.cache[0];
+    for (TlsCacheEntry &e : tls.cache) {
+      if (!e.valid) {
+        entry = &e;
+        break;
+      }
+      if (e.lastUsed < entry->lastUsed) entry = &e;
+    }
   }
-  
-  Serial.print("CALL STATUS: ");
-  if (callConnected) {
-    Serial.print("CONNECTED TO ");
-    Serial.println(tcpClient.remoteIP());
-    Serial.print("DURATION: ");
-    Serial.println(connectTimeString());
+  mbedtls_ssl_session_free(&entry->session);
+  mbedtls_ssl_session_init(&entry->session);
+  entry->valid = mbedtls_ssl_get_session(&link->ssl, &entry->session) == 0;
+  setText(entry->host, sizeof(entry->host), host);
+  entry->port = port;
+  entry->lastUsed = millis();
+}
+
+int tlsCacheCount() {
+  int n = 0;
+  for (const TlsCacheEntry &entry : tls.cache) {
+    if (entry.valid) n++;
+  }
+  return n;
+}
+
+// Ввод-вывод сессии: сокет напрямую или через TLS.
+// После client.stop() fd() = -1, так что mbedtls не тронет чужой сокет.
+static TlsLink *sessionTls(Session &ses) {
+  ses.tlsLink->fd = ses.client.fd();
+  return ses.tlsLink;
+}
+
+// Сколько можно прочитать; для TLS - оценка, точное число скажет netRead()
+int netAvailable(Session &ses) {
+  if (!ses.tlsLink) return ses.client.available();
+  TlsLink *link = sessionTls(ses);
+  int avail = mbedtls_ssl_get_bytes_avail(&link->ssl);
+  if (avail > 0) return avail;
+  if (link->fd < 0) return 0;
+  uint8_t b;
+  return recv(link->fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) > 0 ? RX_BUF_SIZE : 0;
+}
+
+// 0 - данных пока нет (запись TLS пришла не целиком)
+int netRead(Session &ses, uint8_t *buf, size_t n) {
+  if (!ses.tlsLink) return ses.client.read(buf, n);
+  int res = mbedtls_ssl_read(&sessionTls(ses)->ssl, buf, n);
+  if (res > 0) return res;
+  if (res != MBEDTLS_ERR_SSL_WANT_READ && res != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    ses.client.stop(); // close_notify или испорченная запись - обрыв
+  }
+  return 0;
+}
+
+// Сколько байт принято; 0 - буфер сокета полон
+size_t netSend(Session &ses, const uint8_t *p, size_t len) {
+  if (!ses.tlsLink) {
+    int res = send(ses.client.fd(), p, len, MSG_DONTWAIT);
+    return res > 0 ? res : 0;
+  }
+  TlsLink *link = sessionTls(ses);
+  size_t done = 0;
+  while (done < len) {
+    size_t chunk = link->pendingWrite ? link->pendingWrite : len - done;
+    int res = mbedtls_ssl_write(&link->ssl, p + done, chunk);
+    if (res == MBEDTLS_ERR_SSL_WANT_WRITE || res == MBEDTLS_ERR_SSL_WANT_READ) {
+      link->pendingWrite = chunk;
+      break;
+    }
+    link->pendingWrite = 0;
+    if (res <= 0) {
+      ses.client.stop();
+      break;
+    }
+    done += res;
+  }
+  return done;
+}
+
+// === СЕССИИ ===
+
+int sessionCount() {
+  int n = 0;
+  for (const Session &ses : sessions) {
+    if (ses.active) n++;
+  }
+  return n;
+}
+
+// Номер занятого слота или -1, если все заняты
+int sessionOpen(const WiFiClient &client, bool inbound, TlsLink *tlsLink = nullptr) {
+  for (int i = 0; i < MAX_SESSIONS; i++) {
+    Session &ses = sessions[i];
+    if (ses.active) continue;
+    ses.active = true;
+    ses.inbound = inbound;
+    ses.telnet = telnet;
+    ses.client = client;
+    ses.client.setNoDelay(true); // Try to disable naggle
+    ses.tlsLink = tlsLink;
+    ses.tcpUs = ses.tlsUs = 0;
+    ses.tx.clear();
+    ses.rx.clear();
+    ses.parser.reset();
+    ses.connectTime = millis();
+    memset(&ses.stats, 0, sizeof(ses.stats));
+    ses.netStallStart = ses.serialStallStart = 0;
+    ses.txPaused = ses.rxPaused = false;
+    ses.detector.reset();
+    ses.transfer = XFER_NONE;
+    return i;
+  }
+  return -1;
+}
+
+void mccpRelease(int id) {
+  if (mccp.owner != id) return;
+  mccp.owner = -1;
+  mccp.active = false;
+  mccp.inPos = mccp.inLen = 0;
+  mccp.pendLen = 0;
+  mccp.moreOutput = false;
+}
+
+void sessionClose(int id) {
+  mccpRelease(id);
+  if (scrollback.owner == id) {
+    // История остается для AT$HIST, невыданное отставание - уже некому
+    scrollback.owner = -1;
+    scrollback.shown = scrollback.written;
+  }
+  Session &ses = sessions[id];
+  if (ses.tlsLink) {
+    tlsRelease(sessionTls(ses));
+    ses.tlsLink = nullptr;
+  }
+  ses.client.stop();
+  ses.client = WiFiClient();
+  ses.active = false;
+  if (id == attached) attached = -1;
+}
+
+// Подключить сессию к последовательному порту и перейти в режим данных
+void sessionAttach(int id) {
+  if (scrollback.owner != id) {
+    scrollback.owner = id;
+    scrollback.shown = scrollback.written;
+  }
+  attached = id;
+  plusCount = 0;
+  cmdMode = false;
+  sendResult(A_CONNECT);
+  Serial.flush();
+}
+
+// === НАСОС ДАННЫХ ===
+
+// Байты, прошедшие через сокет, в кольцо трассировки (netTask).
+// Вызывается только при trace.mode != TRACE_OFF.
+void traceRecord(Session &ses, bool outbound, bool telnet, const uint8_t *p, size_t n) {
+  unsigned long started = micros();
+  uint8_t rec[sizeof(TraceEvent) + TRACE_MAX_DATA];
+  TraceEvent ev;
+  ev.us = started;
+  ev.flags = (outbound ? TRACE_OUTBOUND : 0) | (telnet ? TRACE_TELNET : 0) |
+             ((&ses - sessions) & TRACE_SESSION_MASK);
+  while (n > 0) {
+    ev.len = min(n, (size_t)TRACE_MAX_DATA);
+    size_t size = sizeof(ev) + ev.len;
+    if (trace.ring.space() < size) {
+      trace.dropped += n;
+      break;
+    }
+    memcpy(rec, &ev, sizeof(ev));
+    memcpy(rec + sizeof(ev), p, ev.len);
+    trace.ring.write(rec, size);
+    trace.events++;
+    trace.bytes += ev.len;
+    p += ev.len;
+    n -= ev.len;
+  }
+  trace.producerUs += micros() - started;
+}
+
+// Отправка накопленного tx в сеть крупными блоками
+void flushNetTx(Session &ses) {
+  if (!ses.client.connected()) {
+    ses.tx.clear();
+    return;
+  }
+  while (!ses.tx.empty()) {
+    size_t len;
+    const uint8_t *p = ses.tx.readPtr(len);
+    // Неблокирующая отправка: полный буфер сокета - это не ошибка, а
+    // сигнал придержать данные в tx (WiFiClient::write() тут ждал бы)
+    size_t sent = netSend(ses, p, len);
+    ses.stats.txWrites++;
+    if (sent > 0 && trace.mode) traceRecord(ses, true, ses.telnet, p, sent);
+    if (sent > 0) {
+      ses.tx.consume(sent);
+      ses.stats.txBytes += sent;
+      if (ses.netStallStart) {
+        metrics.netStall.record(micros() - ses.netStallStart);
+        ses.netStallStart = 0;
+      }
+    }
+    if (sent < len) {
+      // буфер TCP заполнен - доотправим в следующий раз
+      ses.stats.shortWrites++;
+      if (!ses.netStallStart) ses.netStallStart = micros() | 1;
+      break;
+    }
+  }
+}
+
+// Запись в текущую половину двойного буфера (netTask, под sessionLock).
+// Флеш пишет captureTask; если обе половины заняты - запись теряется.
+bool captureSwap() {
+  int other = capture.active ^ 1;
+  if (capture.ready[other]) return false;
+  capture.ready[capture.active] = true;
+  capture.active = other;
+  capture.len[other] = 0;
+  capture.swapTime = millis();
+  if (captureTaskHandle) xTaskNotifyGive(captureTaskHandle);
+  return true;
+}
+
+// Блок длиннее половины буфера делится на несколько записей
+void captureRecord(int session, bool outbound, const uint8_t *data, size_t n) {
+  if (capture.state != CAP_RECORDING) return;
+  while (n > 0) {
+    unsigned long now = micros();
+    CaptureRecord rec;
+    rec.outbound = outbound;
+    rec.session = session;
+    rec.deltaUs = capture.records ? now - capture.lastRecord : 0;
+    rec.length = min(n, (size_t)(CAP_BUF_SIZE - CAP_HDR_MAX));
+    uint8_t hdr[CAP_HDR_MAX];
+    size_t h = captureEncodeHeader(hdr, rec);
+    if (capture.len[capture.active] + h + rec.length > CAP_BUF_SIZE && !captureSwap()) {
+      capture.dropped += n;
+      return;
+    }
+    uint8_t *dst = capture.buf[capture.active] + capture.len[capture.active];
+    memcpy(dst, hdr, h);
+    memcpy(dst + h, data, rec.length);
+    capture.len[capture.active] += h + rec.length;
+    capture.lastRecord = now;
+    capture.records++;
+    capture.bytes += rec.length;
+    data += rec.length;
+    n -= rec.length;
+  }
+}
+
+// Передача файлов (ZMODEM, X/YMODEM): пока она идет, поток не
+// перекодируется и не проверяется на +++, блоки копируются целиком, а
+// telnet переводится в двоичный режим. Конец - пауза XFER_IDLE_MS.
+void transferBegin(Session &ses, TransferProto proto) {
+  ses.transfer = proto;
+  ses.transferStart = ses.transferLast = millis();
+  ses.transferBytes = 0;
+  plusCount = 0;
+  if (ses.telnet) ses.parser.requestBinary(ses.tx);
+}
+
+void transferEnd(Session &ses) {
+  lastTransfer.proto = ses.transfer;
+  lastTransfer.bytes = ses.transferBytes;
+  lastTransfer.ms = ses.transferLast - ses.transferStart;
+  lastTransfer.count++;
+  ses.transfer = XFER_NONE;
+  ses.detector.reset();
+}
+
+void transferCheck(Session &ses) {
+  if (ses.transfer && millis() - ses.transferLast > XFER_IDLE_MS) transferEnd(ses);
+}
+
+// Начало передачи ищем до перекодировки - заголовки ZMODEM ее не переживут.
+// Пробный проход идет по копии состояния, настоящее продвигает transferCount().
+void transferProbe(Session &ses, const uint8_t *p, size_t n, bool toNet) {
+  if (ses.transfer) return;
+  TransferDetector probe = ses.detector;
+  TransferProto proto = probe.feed(p, n, toNet);
+  if (proto != XFER_NONE) transferBegin(ses, proto);
+}
+
+void transferCount(Session &ses, const uint8_t *p, size_t n, bool toNet) {
+  if (n == 0) return;
+  if (ses.transfer) {
+    ses.transferBytes += n;
+    ses.transferLast = millis();
   } else {
-    Serial.println("NOT CONNECTED");
+    ses.detector.feed(p, n, toNet);
   }
-  
-  Serial.println("=====================");
 }
 
-void showSettings() {
-  Serial.println("=== CURRENT SETTINGS ===");
-  Serial.print("BAUD: "); Serial.println(currentBaudRate);
-  Serial.print("SSID: "); Serial.println(ssid);
-  Serial.print("PASS: "); Serial.println("********"); // Не показываем пароль
-  Serial.print("BUSY MSG: "); Serial.println(busyMsg);
-  Serial.print("ECHO: "); Serial.println(echo ? "ON" : "OFF");
-  Serial.print("VERBOSE: "); Serial.println(verboseResults ? "ON" : "OFF");
-  Serial.print("TELNET: "); Serial.println(telnet ? "ON" : "OFF");
-  Serial.print("PETSCII: "); Serial.println(petTranslate ? "ON" : "OFF");
-  Serial.print("AUTO ANSWER: "); Serial.println(autoAnswer ? "ON" : "OFF");
-  
-  Serial.println("SPEED DIAL:");
-  for (int i = 0; i < 10; i++) {
-    if (speedDials[i].length() > 0) {
-      Serial.printf("%d: %s\r\n", i, speedDials[i].c_str());
+// Блок в tx с удвоением 0xFF при telnet: участки без 0xFF копируются
+// целиком. Возвращает, сколько байт p взято; 0xFF берется только вместе
+// с парой.
+size_t txAppend(Session &ses, const uint8_t *p, size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    const uint8_t *iac = ses.telnet ? (const uint8_t *)memchr(p + done, T_IAC, n - done) : nullptr;
+    size_t run = iac ? (size_t)(iac - (p + done)) : n - done;
+    size_t put = ses.tx.write(p + done, run);
+    done += put;
+    if (put < run || !iac) break;
+    if (ses.tx.space() < 2) break;
+    ses.tx.put(T_IAC);
+    ses.tx.put(T_IAC);
+    done++;
+  }
+  return done;
+}
+
+// Сеть не успевает - не берем данные с терминала, serialIn заполнится
+// и serialTask остановит терминал
+static bool txFlowPaused(Session &ses) {
+  if (ses.txPaused && ses.tx.used() <= TX_LOW_WATER) ses.txPaused = false;
+  if (!ses.txPaused && ses.tx.used() >= TX_HIGH_WATER) {
+    ses.txPaused = true;
+    ses.stats.txPauses++;
+  }
+  return ses.txPaused;
+}
+
+// Данные от компьютера -> в сеть
+void pumpSerialToNet(Session &ses) {
+  // Запас в tx: удвоение 0xFF при telnet и WILL/DO BINARY, которые
+  // transferProbe() кладет туда в начале передачи
+  while (!txFlowPaused(ses) && ses.tx.space() >= 2 + TELNET_BINARY_REQ) {
+    size_t n;
+    const uint8_t *chunk = serialIn.readPtr(n);
+    if (n == 0) break;
+    if (n > PUMP_CHUNK) n = PUMP_CHUNK;
+    transferProbe(ses, chunk, n, true);
+    if (n > ses.tx.space() / 2) n = ses.tx.space() / 2;
+    transferCount(ses, chunk, n, true);
+
+    // Перекодировка всего блока сразу, результат не длиннее исходного
+    uint8_t xlat[PUMP_CHUNK];
+    size_t count = n;
+    const uint8_t *data = chunk;
+    if (charset != CS_NONE && !ses.transfer) {
+      count = terminalCharset.fromTerminal((Charset)charset, chunk, n, xlat);
+      data = xlat;
+    }
+    captureRecord(&ses - sessions, true, data, count);
+
+    // Без символа +++ (и всегда при передаче файла) блок уходит целиком.
+    // Место под него с удвоением 0xFF есть: n не больше половины tx, а
+    // перекодированный блок не длиннее исходного.
+    if (ses.transfer || !memchr(data, sRegs[S_ESCAPE], count)) {
+      if (count && !ses.transfer) plusCount = 0;
+      size_t sent = txAppend(ses, data, count);
+      // Без перекодировки недошедший хвост остается в serialIn
+      serialIn.consume(data == chunk ? sent : n);
+      continue;
+    }
+
+    size_t i = 0;
+    for (; i < count && ses.tx.space() >= 2; i++) {
+      uint8_t c = data[i];
+
+      if (c == sRegs[S_ESCAPE]) {
+        plusCount++;
+        if (plusCount >= 3) plusTime = millis();
+      } else {
+        plusCount = 0;
+      }
+
+      // В буфер (если не +++)
+      if (plusCount < 3) {
+        // Telnet escaping для 0xFF
+        if (ses.telnet && c == 0xFF) ses.tx.put(0xFF);
+        ses.tx.put(c);
+      }
     }
+    serialIn.consume(data == chunk ? i : n);
   }
-  Serial.println("=====================");
+  flushNetTx(ses);
 }
 
-void showHelp() {
-  Serial.println("=== AT COMMANDS ===");
-  Serial.println("AT              - Test command");
-  Serial.println("ATDT host:port  - Dial host (ATDT google.com:80)");
-  Serial.println("ATDS n          - Speed dial (n=0-9)");
-  Serial.println("ATH             - Hang up");
-  Serial.println("ATO             - Go online");
-  Serial.println("ATZ             - Reload settings");
-  Serial.println("AT&W            - Save settings");
-  Serial.println("AT&F            - Factory reset");
-  Serial.println("AT&V            - View settings");
-  Serial.println("AT?             - This help");
-  Serial.println("ATI             - Network info");
-  Serial.println("ATE0/ATE1       - Echo off/on");
-  Serial.println("ATV0/ATV1       - Verbose off/on");
-  Serial.println("ATS0=0/ATS0=1   - Auto answer off/on");
-  Serial.println("ATNET0/ATNET1   - Telnet off/on");
-  Serial.println("ATPET0/ATPET1   - PETSCII translate off/on");
-  Serial.println("ATC0/ATC1       - WiFi off/on");
-  Serial.println("AT$SSID=xxx     - Set WiFi SSID");
-  Serial.println("AT$PASS=xxx     - Set WiFi password");
-  Serial.println("AT$SB=nnnn      - Set baud rate");
-  Serial.println("AT$BM=message   - Set busy message");
-  Serial.println("AT&Zn=host:port - Set speed dial (n=0-9)");
-  Serial.println("AT$RB           - Reboot ESP32");
-  Serial.println("=================");
+// MCCP2: распаковщик один на все сессии (32 КБ словаря), его получает
+// первая сессия, согласившая сжатие. Распакованное отдаем разборщику
+// порциями по свободному месту в rx, так что буфер сессии не переполняется.
+void mccpBegin() {
+  tinfl_init(mccp.inflator);
+  mccp.dictOfs = 0;
+  mccp.pendLen = 0;
+  mccp.moreOutput = false;
+  mccp.active = true;
+  mccp.streams++;
+}
+
+bool mccpHasWork(int id) {
+  return mccp.owner == id && (mccp.pendLen || mccp.inPos < mccp.inLen || (mccp.active && mccp.moreOutput));
 }
 
-void hangUp() {
-  if (tcpClient.connected()) {
-    tcpClient.stop();
+// Отложенные байты владельца: сжатые - в распаковку, после конца потока
+// zlib - снова обычный telnet
+void mccpDrain(Session &ses) {
+  unsigned long started = micros();
+  while (ses.rx.space() > 0) {
+    if (mccp.pendLen) {
+      size_t n = min(mccp.pendLen, ses.rx.space());
+      ses.parser.parse(mccp.dict + mccp.pendOfs, n, ses.rx, ses.tx);
+      ses.parser.takeCompressStart(); // внутри сжатого потока не бывает
+      mccp.pendOfs += n;
+      mccp.pendLen -= n;
+      continue;
+    }
+    if (!mccp.active) {
+      if (mccp.inPos == mccp.inLen) break;
+      size_t n = min(mccp.inLen - mccp.inPos, ses.rx.space());
+      size_t used;
+      ses.parser.parse(mccp.in + mccp.inPos, n, ses.rx, ses.tx, &used);
+      mccp.inPos += used;
+      if (ses.parser.takeCompressStart()) mccpBegin();
+      continue;
+    }
+    if (mccp.inPos == mccp.inLen && !mccp.moreOutput) break;
+
+    // tinfl пишет в кольцевой словарь до его конца; следующий вызов - только
+    // когда все распакованное отдано, иначе он затрет неотданное
+    size_t inBytes = mccp.inLen - mccp.inPos;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - mccp.dictOfs;
+    tinfl_status status = tinfl_decompress(mccp.inflator, mccp.in + mccp.inPos, &inBytes, mccp.dict,
+                                           mccp.dict + mccp.dictOfs, &outBytes,
+                                           TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+    mccp.inPos += inBytes;
+    mccp.compressedBytes += inBytes;
+    mccp.inflatedBytes += outBytes;
+    mccp.pendOfs = mccp.dictOfs;
+    mccp.pendLen = outBytes;
+    mccp.dictOfs = (mccp.dictOfs + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+    mccp.moreOutput = status == TINFL_STATUS_HAS_MORE_OUTPUT;
+
+    if (status == TINFL_STATUS_DONE) {
+      mccp.active = false; // сервер закончил сжатие, хвост блока - обычный telnet
+    } else if (status < 0) {
+      // Испорченный поток не восстановить - рвем соединение
+      mccp.errors++;
+      mccpRelease(&ses - sessions);
+      ses.client.stop();
+      break;
+    } else if (inBytes == 0 && outBytes == 0) {
+      break;
+    }
+  }
+  mccp.cpuUs += micros() - started;
+  if (!ses.tx.empty()) flushNetTx(ses);
+}
+
+// Сжатые данные из сокета - только когда прошлый блок разобран
+void mccpReceive(Session &ses) {
+  int avail = netAvailable(ses);
+  if (avail <= 0) return;
+  int got = netRead(ses, mccp.in, min((size_t)avail, sizeof(mccp.in)));
+  if (got <= 0) return;
+  if (trace.mode) traceRecord(ses, false, false, mccp.in, got); // сжатый поток
+  ses.stats.rxReads++;
+  ses.stats.rxBytes += got;
+  mccp.inPos = 0;
+  mccp.inLen = got;
+  mccpDrain(ses);
+}
+
+// Данные из сети -> в буфер сессии (для всех сессий, не только текущей)
+static void sessionFill(Session &ses) {
+  // Терминал не успевает - не читаем сокет, сервер упрется в окно TCP
+  if (ses.rxPaused && ses.rx.used() <= RX_LOW_WATER) ses.rxPaused = false;
+  if (!ses.rxPaused && ses.rx.used() >= RX_HIGH_WATER) {
+    ses.rxPaused = true;
+    ses.stats.rxPauses++;
+  }
+  if (ses.rxPaused) return;
+
+  int id = &ses - sessions;
+  if (mccpHasWork(id)) {
+    mccpDrain(ses);
+    return;
+  }
+  if (mccp.owner == id && mccp.active) {
+    mccpReceive(ses);
+    return;
+  }
+
+  int avail = netAvailable(ses);
+  if (avail <= 0) return;
+  if (ses.telnet) {
+    // Разбор IAC только сокращает поток, так что блок влезет в rx
+    uint8_t chunk[PUMP_CHUNK];
+    size_t n = min((size_t)avail, min(sizeof(chunk), ses.rx.space()));
+    int got = n ? netRead(ses, chunk, n) : 0;
+    if (got > 0) {
+      if (trace.mode) traceRecord(ses, false, true, chunk, got);
+      ses.stats.rxReads++;
+      ses.stats.rxBytes += got;
+      ses.parser.acceptCompress = mccpEnabled && mccp.dict && mccp.inflator &&
+                                  (mccp.owner < 0 || mccp.owner == id);
+      size_t used;
+      ses.parser.parse(chunk, got, ses.rx, ses.tx, &used);
+      if (ses.parser.remoteEnabled(TO_COMPRESS2)) mccp.owner = id;
+      else mccpRelease(id);
+      if (ses.parser.takeCompressStart()) {
+        // Остаток блока - уже поток zlib
+        mccp.inPos = 0;
+        mccp.inLen = got - used;
+        memcpy(mccp.in, chunk + used, mccp.inLen);
+        mccpBegin();
+        mccpDrain(ses);
+      }
+      if (!ses.tx.empty()) flushNetTx(ses); // ответы на согласование опций
+    }
+  } else {
+    size_t len;
+    uint8_t *p = ses.rx.writePtr(len);
+    if (len > (size_t)avail) len = avail;
+    int got = len ? netRead(ses, p, len) : 0;
+    if (got > 0) {
+      if (trace.mode) traceRecord(ses, false, false, p, got);
+      ses.stats.rxReads++;
+      ses.stats.rxBytes += got;
+      ses.rx.commit(got);
+    }
+  }
+}
+
+// Запись сессии (AT$CAP) видит то, что дописано в rx: поток после telnet
+// и MCCP, до перекодировки терминала, у фоновых сессий тоже
+void sessionReceive(Session &ses) {
+  size_t before = ses.rx.used();
+  sessionFill(ses);
+  if (capture.state != CAP_RECORDING) return;
+  while (ses.rx.used() > before) {
+    size_t len;
+    const uint8_t *p = ses.rx.peekPtr(before, len);
+    captureRecord(&ses - sessions, false, p, len);
+    before += len;
+  }
+}
+
+// Вызывается из netTask: зеркало без ожидания, лишнее теряется
+void wsMirror(const uint8_t *data, size_t n) {
+  if (wsViewerCount <= 0 || n == 0) return;
+  size_t done = wsFeed.write(data, n);
+  wsDropped += n - done;
+}
+
+static void scrollbackCopy(uint32_t pos, uint8_t *out, size_t n) {
+  size_t ofs = pos & scrollback.mask;
+  size_t first = min(n, (size_t)(scrollback.mask + 1 - ofs));
+  memcpy(out, scrollback.buf + ofs, first);
+  memcpy(out + first, scrollback.buf, n - first);
+}
+
+// Не затирает отставание: вызывающий проверяет место
+static void scrollbackPut(const uint8_t *p, size_t n) {
+  size_t ofs = scrollback.written & scrollback.mask;
+  size_t first = min(n, (size_t)(scrollback.mask + 1 - ofs));
+  memcpy(scrollback.buf + ofs, p, first);
+  memcpy(scrollback.buf, p + first, n - first);
+  scrollback.written += n;
+}
+
+static uint32_t scrollbackBacklog() {
+  return scrollback.written - scrollback.shown;
+}
+
+// Командный режим: прием текущей сессии уходит в историю, и сервер не
+// упирается в окно TCP. Только когда отставание заняло всю историю,
+// данные остаются в rx и включается обычное управление потоком.
+void scrollbackAbsorb(Session &ses) {
+  if (!scrollback.buf || scrollback.owner != &ses - sessions) return;
+  while (!ses.rx.empty()) {
+    size_t room = scrollback.mask + 1 - scrollbackBacklog();
+    if (room == 0) {
+      if (!scrollback.full) scrollback.fullStalls++;
+      scrollback.full = true;
+      return;
+    }
+    size_t len;
+    const uint8_t *p = ses.rx.readPtr(len);
+    len = min(len, room);
+    scrollbackPut(p, len);
+    ses.rx.consume(len);
+  }
+  scrollback.full = false;
+  scrollback.peakBacklog = max(scrollback.peakBacklog, scrollbackBacklog());
+}
+
+// Кусок данных сессии -> в serialOut, сколько влезет в room
+static size_t pumpChunkToSerial(Session &ses, const uint8_t *p, size_t len, size_t room) {
+  size_t done;
+  transferProbe(ses, p, len, false);
+  if (charset == CS_NONE || ses.transfer) {
+    done = serialOut.write(p, min(len, room));
+    wsMirror(p, done);
+  } else {
+    // CP437 -> UTF-8 раскрывает байт до трех, берем столько, сколько влезет
+    uint8_t xlat[PUMP_CHUNK * 3];
+    size_t out = CharsetTranslator::toTerminal((Charset)charset, p, len, xlat,
+                                               min(sizeof(xlat), room), done);
+    serialOut.write(xlat, out);
+    wsMirror(xlat, out);
+  }
+  transferCount(ses, p, done, false);
+  return done;
+}
+
+// Буфер сессии -> в компьютер (через serialTask). Сначала отставание,
+// накопленное в истории за командный режим, потом rx.
+void pumpRxToSerial(Session &ses) {
+  // При эмуляции скорости держим в serialOut не больше секунды линии,
+  // остальное ждет в rx и дальше в окне TCP
+  size_t limit = paceLine ? max((size_t)64, (size_t)paceRate) : SERIAL_OUT_SIZE;
+  bool history = scrollback.buf && scrollback.owner == &ses - sessions;
+  bool moved = false;
+  for (;;) {
+    bool backlog = history && scrollbackBacklog() > 0;
+    size_t len;
+    const uint8_t *p;
+    if (backlog) {
+      size_t ofs = scrollback.shown & scrollback.mask;
+      p = scrollback.buf + ofs;
+      len = min((size_t)scrollbackBacklog(), (size_t)(scrollback.mask + 1 - ofs));
+    } else if (!ses.rx.empty()) {
+      p = ses.rx.readPtr(len);
+    } else {
+      break;
+    }
+    size_t used = serialOut.used();
+    size_t room = used < limit ? limit - used : 0;
+    size_t done = pumpChunkToSerial(ses, p, len, room);
+    if (backlog) {
+      scrollback.shown += done;
+      scrollback.replayed += done;
+    } else {
+      if (history && !ses.transfer) {
+        scrollbackPut(p, done);
+        scrollback.shown = scrollback.written;
+      }
+      ses.rx.consume(done);
+    }
+    moved |= done > 0;
+    if (done == 0) {
+      if (!ses.serialStallStart) {
+        ses.stats.serialStalls++;
+        ses.serialStallStart = micros() | 1;
+      }
+      break;
+    }
+  }
+  if (moved && ses.serialStallStart && serialOut.space()) {
+    metrics.serialStall.record(micros() - ses.serialStallStart);
+    ses.serialStallStart = 0;
+  }
+  if (moved && serialTaskHandle) xTaskNotifyGive(serialTaskHandle);
+}
+
+void showPumpStats(const Session &ses) {
+  const PumpStats &st = ses.stats;
+  unsigned long secs = (millis() - ses.connectTime) / 1000;
+  if (secs == 0) secs = 1;
+  if (ses.tcpUs) {
+    Serial.printf("CONNECT: TCP %lu US", ses.tcpUs);
+    if (ses.tlsLink) Serial.printf(", TLS HANDSHAKE %lu US", ses.tlsUs);
+    Serial.print("\r\n");
+  }
+  Serial.printf("TX: %lu BYTES, %lu WRITES, %lu B/S, %lu PKT/KB\r\n",
+                (unsigned long)st.txBytes, (unsigned long)st.txWrites,
+                (unsigned long)st.txBytes / secs,
+                st.txBytes ? (unsigned long)(st.txWrites * 1024ULL / st.txBytes) : 0UL);
+  Serial.printf("RX: %lu BYTES, %lu READS, %lu B/S\r\n",
+                (unsigned long)st.rxBytes, (unsigned long)st.rxReads,
+                (unsigned long)st.rxBytes / secs);
+  Serial.printf("STALLS: %lu SHORT TCP WRITES, %lu SERIAL FULL\r\n",
+                (unsigned long)st.shortWrites, (unsigned long)st.serialStalls);
+  Serial.printf("FLOW: %lu TX PAUSES, %lu RX PAUSES\r\n",
+                (unsigned long)st.txPauses, (unsigned long)st.rxPauses);
+}
+
+void showHistogram(const char *name, const LatencyHistogram &h) {
+  if (h.count == 0) return;
+  Serial.printf("%-13s N=%lu AVG=%lu P50<=%lu P99<=%lu MAX=%lu US\r\n", name,
+                (unsigned long)h.count, (unsigned long)(h.sum / h.count),
+                (unsigned long)h.percentile(50), (unsigned long)h.percentile(99),
+                (unsigned long)h.maxValue);
+}
+
+void showMetrics() {
+  Serial.println("=== LATENCY ===");
+  showHistogram("NET LOOP:", metrics.netLoop);
+  showHistogram("MAIN LOOP:", metrics.mainLoop);
+  showHistogram("DIAL:", metrics.dial);
+  showHistogram("TCP CONNECT:", metrics.tcpConnect);
+  showHistogram("TLS FULL:", metrics.tlsFull);
+  showHistogram("TLS RESUMED:", metrics.tlsCached);
+  showHistogram("NET STALL:", metrics.netStall);
+  showHistogram("SERIAL STALL:", metrics.serialStall);
+  showHistogram("PACE JITTER:", metrics.paceJitter);
+  Serial.printf("USB STALLS: %lu\r\n", (unsigned long)metrics.usbStalls);
+}
+
+void showWebTerminal() {
+  static const char *const modes[] = {"OFF", "VIEW ONLY", "INTERACTIVE"};
+  Serial.printf("WEB TERMINAL: %s, %d VIEWERS, %lu FRAMES, %lu BYTES, %lu DROPPED, FLUSH %lu MS\r\n",
+                modes[wsMode], (int)wsViewerCount, (unsigned long)wsFrames, (unsigned long)wsBytes,
+                (unsigned long)wsDropped, wsFlushMs);
+}
+
+void showTransfer() {
+  Session *ses = currentSession();
+  if (ses && ses->transfer) {
+    Serial.printf("TRANSFER: %s IN PROGRESS, %lu BYTES\r\n", transferNames[ses->transfer],
+                  (unsigned long)ses->transferBytes);
+  }
+  if (lastTransfer.count) {
+    unsigned long ms = lastTransfer.ms ? lastTransfer.ms : 1;
+    Serial.printf("LAST TRANSFER: %s, %lu BYTES IN %lu MS, %lu B/S (%lu TOTAL)\r\n",
+                  transferNames[lastTransfer.proto], (unsigned long)lastTransfer.bytes, lastTransfer.ms,
+                  (unsigned long)(lastTransfer.bytes * 1000ULL / ms), (unsigned long)lastTransfer.count);
+  }
+}
+
+void showMccp() {
+  if (!mccp.streams) {
+    Serial.printf("MCCP: %s, NOT USED\r\n", mccpEnabled ? "ON" : "OFF");
+    return;
+  }
+  uint32_t ratio = mccp.compressedBytes ? (uint64_t)mccp.inflatedBytes * 100 / mccp.compressedBytes : 0;
+  Serial.printf("MCCP: %s, %lu STREAMS, %lu -> %lu BYTES, RATIO %lu.%02lu, CPU %lu US, %lu ERRORS\r\n",
+                mccp.active ? "ACTIVE" : "IDLE", (unsigned long)mccp.streams,
+                (unsigned long)mccp.compressedBytes, (unsigned long)mccp.inflatedBytes,
+                (unsigned long)(ratio / 100), (unsigned long)(ratio % 100), mccp.cpuUs,
+                (unsigned long)mccp.errors);
+}
+
+void showTls() {
+  Serial.println("TLS CERTIFICATES: NOT VERIFIED (VERIFY_NONE)");
+  if (!tls.handshakes && !tls.failures) return;
+  Serial.printf("TLS: %lu HANDSHAKES, %lu RESUMED OF %lu OFFERED, %lu FAILED, %d HOSTS CACHED\r\n",
+                (unsigned long)tls.handshakes, (unsigned long)tls.resumed, (unsigned long)tls.resumeOffered,
+                (unsigned long)tls.failures, tlsCacheCount());
+}
+
+void showSessions() {
+  for (int i = 0; i < MAX_SESSIONS; i++) {
+    const Session &ses = sessions[i];
+    if (!ses.active) continue;
+    char ipStr[IP_STR_SIZE], timeStr[TIME_STR_SIZE];
+    Serial.printf("%d%c %s%s %s:%u %s RX BUF %u\r\n", i, i == attached ? '*' : ' ',
+                  ses.inbound ? "IN " : "OUT", ses.tlsLink ? " TLS" : "", ipString(ses.client.remoteIP(), ipStr),
+                  ses.client.remotePort(), connectTimeString(ses.connectTime, timeStr),
+                  (unsigned)ses.rx.used());
+  }
+}
+
+// === НАСТРОЙКИ ===
+// Все настройки - одна двоичная запись SETTINGS_KEY с версией и CRC:
+// при старте один запрос к NVS вместо двух десятков. storedSettings -
+// копия того, что лежит на флеше; запись идет, только если новая
+// запись от нее отличается, так что AT&W без изменений флеш не трогает.
+// Старые отдельные ключи читаются один раз и переносятся в запись.
+// Новые поля только дописываются в конец и по умолчанию равны нулю:
+// запись прошлой версии короче, недостающий хвост просто обнуляется.
+
+#define SETTINGS_KEY "cfg"
+#define SETTINGS_VERSION 1
+
+struct StoredSettings {
+  uint16_t version;
+  uint16_t size;
+  uint32_t crc;  // по всем байтам после этого поля
+  char ssid[MAX_SSID_LENGTH + 1];
+  char password[MAX_PASS_LENGTH + 1];
+  char busyMsg[MAX_BUSY_LENGTH + 1];
+  char speedDials[10][MAX_DIAL_LENGTH + 1];
+  int32_t baud;
+  int32_t channel;
+  uint8_t bssid[6];
+  uint8_t haveFast;
+  uint8_t echo;
+  uint8_t telnet;
+  uint8_t verbose;
+  uint8_t charset;
+  uint8_t pace;
+  uint8_t flow;
+  uint8_t ws;
+  uint8_t mccp;
+  uint8_t sRegs[SREG_COUNT];
+  uint8_t warmSize;
+  uint16_t dialCounts[10];
+  uint16_t dnsTtl;
+};
+StoredSettings storedSettings;  // version 0 - на флеше записи нет
+
+enum SettingsSource { SETTINGS_BLOB, SETTINGS_MIGRATED, SETTINGS_BAD_CRC };
+const char *const settingsSourceNames[] = {"RECORD", "MIGRATED FROM KEYS", "BAD RECORD, MIGRATED"};
+uint8_t settingsSource = SETTINGS_BLOB;
+unsigned long settingsLoadUs = 0;
+uint32_t settingsWrites = 0;    // записей на флеш с момента старта
+uint32_t settingsSkipped = 0;   // AT&W без изменений
+
+#define SETTINGS_HEADER_SIZE (offsetof(StoredSettings, crc) + sizeof(uint32_t))
+
+static uint32_t settingsCrc(const StoredSettings &st, size_t size = sizeof(StoredSettings)) {
+  return crc32_le(0, (const uint8_t *)&st + SETTINGS_HEADER_SIZE, size - SETTINGS_HEADER_SIZE);
+}
+
+// Текущие настройки -> запись. memset обнуляет и выравнивание, иначе
+// сравнение и CRC зависели бы от мусора в стеке
+static void settingsCapture(StoredSettings &st) {
+  memset(&st, 0, sizeof(st));
+  st.version = SETTINGS_VERSION;
+  st.size = sizeof(st);
+  setText(st.ssid, sizeof(st.ssid), ssid);
+  setText(st.password, sizeof(st.password), password);
+  setText(st.busyMsg, sizeof(st.busyMsg), busyMsg);
+  for (int i = 0; i < 10; i++) setText(st.speedDials[i], sizeof(st.speedDials[i]), speedDials[i]);
+  st.baud = currentBaudRate;
+  st.channel = wifiMgr.channel;
+  memcpy(st.bssid, wifiMgr.bssid, 6);
+  st.haveFast = wifiMgr.haveFast;
+  st.echo = echo;
+  st.telnet = telnet;
+  st.verbose = verboseResults;
+  st.charset = charset;
+  st.pace = paceLine;
+  st.flow = flowControl;
+  st.ws = wsMode;
+  st.mccp = mccpEnabled;
+  memcpy(st.sRegs, sRegs, SREG_COUNT);
+  st.warmSize = warmSize;
+  memcpy(st.dialCounts, dialCounts, sizeof(st.dialCounts));
+  st.dnsTtl = dnsTtl;
+  st.crc = settingsCrc(st);
+}
+
+static void settingsApply(const StoredSettings &st) {
+  setText(ssid, sizeof(ssid), st.ssid);
+  setText(password, sizeof(password), st.password);
+  setText(busyMsg, sizeof(busyMsg), st.busyMsg);
+  for (int i = 0; i < 10; i++) setText(speedDials[i], sizeof(speedDials[i]), st.speedDials[i]);
+  currentBaudRate = st.baud;
+  wifiMgr.channel = st.channel;
+  memcpy(wifiMgr.bssid, st.bssid, 6);
+  wifiMgr.haveFast = st.haveFast && st.channel > 0;
+  echo = st.echo;
+  telnet = st.telnet;
+  verboseResults = st.verbose;
+  charset = st.charset < CS_COUNT ? st.charset : (uint8_t)CS_NONE;
+  paceLine = st.pace;
+  flowControl = st.flow;
+  wsMode = st.ws <= WS_INTERACTIVE ? st.ws : (uint8_t)WS_VIEW;
+  mccpEnabled = st.mccp;
+  memcpy(sRegs, st.sRegs, SREG_COUNT);
+  warmSize = min(st.warmSize, (uint8_t)WARM_MAX);
+  memcpy(dialCounts, st.dialCounts, sizeof(dialCounts));
+  dnsTtl = st.dnsTtl;
+}
+
+static bool settingsChanged(const StoredSettings &st) {
+  return memcmp(&st, &storedSettings, sizeof(st)) != 0;
+}
+
+static bool settingsWrite(const StoredSettings &st) {
+  preferences.begin("wifi-modem", false);
+  bool ok = preferences.putBytes(SETTINGS_KEY, &st, sizeof(st)) == sizeof(st);
+  preferences.end();
+  if (!ok) return false;
+  storedSettings = st;
+  settingsWrites++;
+  return true;
+}
+
+// Отдельные ключи прошлых версий прошивки (preferences уже открыт)
+static void loadLegacySettings() {
+  if (!preferences.getString("ssid", ssid, sizeof(ssid))) setText(ssid, sizeof(ssid), "******");
+  if (!preferences.getString("pass", password, sizeof(password))) setText(password, sizeof(password), "******");
+  if (!preferences.getString("busymsg", busyMsg, sizeof(busyMsg))) setText(busyMsg, sizeof(busyMsg), DEFAULT_BUSY_MSG);
+  currentBaudRate = preferences.getInt("baud", DEFAULT_BAUD);
+  echo = preferences.getBool("echo", true);
+  memcpy(sRegs, sRegDefaults, SREG_COUNT);
+  if (preferences.getBytes("sregs", sRegs, SREG_COUNT) != SREG_COUNT) {
+    memcpy(sRegs, sRegDefaults, SREG_COUNT);
+    sRegs[S_AUTOANSWER] = preferences.getBool("autoanswer", false) ? 1 : 0;
+  }
+
+  // Точка доступа из прошлого подключения - для быстрого старта
+  wifiMgr.haveFast = preferences.getBytes("bssid", wifiMgr.bssid, 6) == 6;
+  wifiMgr.channel = preferences.getInt("channel", 0);
+  if (wifiMgr.channel <= 0) wifiMgr.haveFast = false;
+  telnet = preferences.getBool("telnet", false);
+  verboseResults = preferences.getBool("verbose", true);
+  // Раньше был только флаг PETSCII
+  charset = preferences.getUChar("charset", preferences.getBool("petscii", false) ? CS_PETSCII : CS_NONE);
+  if (charset >= CS_COUNT) charset = CS_NONE;
+  paceLine = preferences.getBool("pace", false);
+  flowControl = preferences.getUChar("flow", 3);
+  wsMode = WS_VIEW;
+  mccpEnabled = preferences.getBool("mccp", true);
+  dnsTtl = DNS_TTL_DEFAULT;
+  
+  // Загрузка быстрых номеров
+  for (int i = 0; i < 10; i++) {
+    char key[10];
+    sprintf(key, "speed%d", i);
+    if (!preferences.getString(key, speedDials[i], sizeof(speedDials[i]))) speedDials[i][0] = '\0';
+  }
+}
+
+void loadSettings() {
+  unsigned long started = micros();
+  StoredSettings st;
+  memset(&st, 0, sizeof(st));
+  preferences.begin("wifi-modem", true); // true = read-only
+  size_t got = preferences.getBytes(SETTINGS_KEY, &st, sizeof(st));
+  bool valid = got > SETTINGS_HEADER_SIZE && got == st.size && st.version >= 1 &&
+               st.version <= SETTINGS_VERSION && st.crc == settingsCrc(st, got);
+  if (valid) {
+    // Запись прошлой версии в памяти сразу дополняется до текущей
+    st.version = SETTINGS_VERSION;
+    st.size = sizeof(st);
+    st.crc = settingsCrc(st);
+    settingsApply(st);
+    storedSettings = st;
+    settingsSource = SETTINGS_BLOB;
+  } else {
+    loadLegacySettings();
+    settingsSource = got ? SETTINGS_BAD_CRC : SETTINGS_MIGRATED;
+  }
+  preferences.end();
+
+  if (!valid) {
+    settingsCapture(st);
+    settingsWrite(st);
+  }
+  sRegs[S_RINGCOUNT] = 0;
+  terminalCharset.reset();
+  pacerConfigure();
+  settingsLoadUs = micros() - started;
+}
+
+void saveSettings() {
+  StoredSettings st;
+  settingsCapture(st);
+  if (!settingsChanged(st)) {
+    settingsSkipped++;
+    Serial.println("Settings unchanged");
+  } else if (settingsWrite(st)) {
+    Serial.println("Settings saved to NVRAM");
+  } else {
+    Serial.println("ERROR: NVRAM write failed");
+  }
+}
+
+void factoryReset() {
+  preferences.begin("wifi-modem", false);
+  preferences.clear();
+  preferences.end();
+  memset(&storedSettings, 0, sizeof(storedSettings));
+  
+  ssid[0] = '\0';
+  password[0] = '\0';
+  setText(busyMsg, sizeof(busyMsg), DEFAULT_BUSY_MSG);
+  currentBaudRate = DEFAULT_BAUD;
+  echo = true;
+  memcpy(sRegs, sRegDefaults, SREG_COUNT);
+  wifiMgr.haveFast = false;
+  telnet = false;
+  verboseResults = true;
+  charset = CS_NONE;
+  terminalCharset.reset();
+  paceLine = false;
+  flowControl = 3;
+  wsMode = WS_VIEW;
+  mccpEnabled = true;
+  warmSize = 0;
+  memset(dialCounts, 0, sizeof(dialCounts));
+  dnsTtl = DNS_TTL_DEFAULT;
+  
+  for (int i = 0; i < 10; i++) {
+    speedDials[i][0] = '\0';
+  }
+  setText(speedDials[0], sizeof(speedDials[0]), "bbs.fozztexx.com:23");
+  setText(speedDials[1], sizeof(speedDials[1]), "cottonwoodbbs.dyndns.org:6502");
+  
+  pacerConfigure();
+  Serial.println("Factory defaults restored");
+}
+
+// === ЗАПИСЬ И ВОСПРОИЗВЕДЕНИЕ СЕССИЙ ===
+// AT$CAP=1 пишет потоки всех сессий в CAPTURE_FILE (формат - capture.h):
+// из сети - после telnet и MCCP, до перекодировки; в сеть - как отправлено.
+// Насос только копирует байты в память, стирание и запись флеша -
+// в отдельной задаче с низким приоритетом.
+
+// Недописанная половина уходит на флеш не реже CAP_FLUSH_MS
+// (netTask, под sessionLock)
+void captureStep() {
+  if (capture.state == CAP_OFF) return;
+  if (capture.len[capture.active] == 0) return;
+  if (capture.state == CAP_STOPPING || millis() - capture.swapTime >= CAP_FLUSH_MS) captureSwap();
+}
+
+bool captureStart() {
+  if (capture.state != CAP_OFF || !fsMounted) return false;
+  capture.file = LittleFS.open(CAPTURE_FILE, FILE_WRITE);
+  if (!capture.file) return false;
+  uint8_t hdr[CAP_FILE_HEADER_SIZE];
+  captureFileHeader(hdr);
+  capture.file.write(hdr, sizeof(hdr));
+  capture.active = 0;
+  capture.len[0] = capture.len[1] = 0;
+  capture.ready[0] = capture.ready[1] = false;
+  capture.records = capture.bytes = capture.dropped = 0;
+  capture.fileBytes = sizeof(hdr);
+  capture.maxWriteUs = 0;
+  capture.swapTime = millis();
+  capture.state = CAP_RECORDING;
+  return true;
+}
+
+void captureStop() {
+  if (capture.state != CAP_RECORDING) return;
+  capture.state = CAP_STOPPING; // остаток допишет и закроет captureTask
+  if (captureTaskHandle) xTaskNotifyGive(captureTaskHandle);
+}
+
+void captureTask(void *arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAP_FLUSH_MS));
+    // Готова не больше одной половины: следующая не отдается, пока
+    // предыдущая не записана, так что порядок записей сохраняется
+    for (int idx = 0; idx < 2; idx++) {
+      if (!capture.ready[idx]) continue;
+      unsigned long started = micros();
+      capture.file.write(capture.buf[idx], capture.len[idx]);
+      capture.file.flush();
+      unsigned long took = micros() - started;
+      if (took > capture.maxWriteUs) capture.maxWriteUs = took;
+      capture.fileBytes += capture.len[idx];
+      capture.ready[idx] = false;
+    }
+    if (capture.state == CAP_STOPPING && !capture.ready[0] && !capture.ready[1] &&
+        capture.len[capture.active] == 0) {
+      capture.file.close();
+      capture.state = CAP_OFF;
+    }
+  }
+}
+
+// Воспроизведение: записи "из сети" идут в serialOut с исходными паузами,
+// деленными на скорость (0 = без пауз). Работает из loop(), любая клавиша
+// прерывает.
+struct Replay {
+  bool active;
+  File file;
+  uint8_t speed;
+  int8_t session;          // -1 - все сессии
+  uint8_t buf[REPLAY_BUF_SIZE];
+  size_t pos, len;
+  bool haveRecord;
+  CaptureRecord rec;
+  uint32_t left;           // байт данных текущей записи еще не выдано
+  unsigned long lastUs;    // когда выдана предыдущая запись
+  unsigned long delayUs;   // пауза перед текущей записью
+  bool ended;              // файл кончился, ждем, пока хвост уйдет в USB
+};
+Replay replay;
+
+bool replaying() {
+  return replay.active;
+}
+
+bool replayStart(uint8_t speed, int session) {
+  if (replay.active || capture.state != CAP_OFF || !fsMounted) return false;
+  replay.file = LittleFS.open(CAPTURE_FILE, FILE_READ);
+  if (!replay.file) return false;
+  uint8_t hdr[CAP_FILE_HEADER_SIZE];
+  if (replay.file.read(hdr, sizeof(hdr)) != sizeof(hdr) || !captureCheckHeader(hdr)) {
+    replay.file.close();
+    return false;
+  }
+  replay.speed = speed;
+  replay.session = session;
+  replay.pos = replay.len = 0;
+  replay.haveRecord = false;
+  replay.ended = false;
+  replay.lastUs = micros();
+  replay.active = true;
+  return true;
+}
+
+void replayStop() {
+  replay.file.close();
+  replay.active = false;
+  serialIn.discard();
+  sendResult(A_OK);
+}
+
+// Дочитать файл в буфер, сохранив непрочитанный хвост
+bool replayFill() {
+  if (replay.pos > 0) {
+    memmove(replay.buf, replay.buf + replay.pos, replay.len - replay.pos);
+    replay.len -= replay.pos;
+    replay.pos = 0;
+  }
+  size_t got = replay.file.read(replay.buf + replay.len, sizeof(replay.buf) - replay.len);
+  replay.len += got;
+  return got > 0;
+}
+
+void replayStep() {
+  // OK - только после того, как записанное ушло в USB
+  if (replay.ended) {
+    if (serialOut.empty()) replayStop();
+    return;
+  }
+  while (replay.active) {
+    if (!replay.haveRecord) {
+      size_t h = captureDecodeHeader(replay.buf + replay.pos, replay.len - replay.pos, replay.rec);
+      if (h == 0) {
+        if (replay.len - replay.pos >= CAP_HDR_MAX || !replayFill()) {
+          replay.ended = true; // конец файла или битая запись
+          return;
+        }
+        continue;
+      }
+      replay.pos += h;
+      replay.left = replay.rec.length;
+      // Пауза считается и у пропущенных записей чужих сессий
+      replay.delayUs = replay.speed ? replay.rec.deltaUs / replay.speed : 0;
+      replay.haveRecord = true;
+    }
+
+    // Паузы считаем от момента прошлой записи, без накопления ошибки
+    unsigned long now = micros();
+    if (now - replay.lastUs < replay.delayUs) return;
+    replay.lastUs += replay.delayUs;
+    replay.delayUs = 0;
+    if (!replay.speed) replay.lastUs = now;
+
+    while (replay.left > 0) {
+      if (replay.pos == replay.len && !replayFill()) {
+        replay.ended = true;
+        return;
+      }
+      size_t n = min((size_t)replay.left, replay.len - replay.pos);
+      bool shown = replay.session < 0 || replay.rec.session == replay.session;
+      if (!replay.rec.outbound && shown) {
+        // В терминал - сколько влезет, остальное в следующий раз. В записи
+        // поток из сети, перекодируем как насос.
+        const uint8_t *p = replay.buf + replay.pos;
+        size_t room = serialOut.space();
+        if (charset == CS_NONE) {
+          n = serialOut.write(p, min(n, room));
+        } else {
+          uint8_t xlat[PUMP_CHUNK * 3];
+          size_t done;
+          size_t out = CharsetTranslator::toTerminal((Charset)charset, p, min(n, (size_t)PUMP_CHUNK), xlat,
+                                                     min(sizeof(xlat), room), done);
+          serialOut.write(xlat, out);
+          n = done;
+        }
+        if (n && serialTaskHandle) xTaskNotifyGive(serialTaskHandle);
+        if (n == 0) return;
+      }
+      replay.pos += n;
+      replay.left -= n;
+    }
+    replay.haveRecord = false;
+  }
+}
+
+// AT$HIST=n: последние n КБ истории приема на терминал. Как и
+// воспроизведение, идет из loop() кусками, любая клавиша прерывает.
+struct HistoryDump {
+  bool active;
+  uint32_t pos, end;       // позиции в истории
+};
+HistoryDump historyDump;
+
+bool historyDumping() {
+  return historyDump.active;
+}
+
+bool historyStart(uint32_t bytes) {
+  if (!scrollback.buf) return false;
+  SessionLock lock;
+  uint32_t stored = min(scrollback.written, scrollback.mask + 1);
+  if (bytes == 0 || bytes > stored) bytes = stored;
+  historyDump.end = scrollback.written;
+  historyDump.pos = historyDump.end - bytes;
+  historyDump.active = true;
+  return true;
+}
+
+void historyStop() {
+  historyDump.active = false;
+  serialIn.discard();
+  sendResult(A_OK);
+}
+
+void historyStep() {
+  uint8_t chunk[PUMP_CHUNK];
+  uint8_t xlat[PUMP_CHUNK * 3];
+  while ((int32_t)(historyDump.end - historyDump.pos) > 0) {
+    if (serialOut.space() < sizeof(xlat)) return;
+    size_t n;
+    {
+      SessionLock lock;
+      // netTask мог затереть начало, пока мы выдавали
+      uint32_t oldest = scrollback.written - min(scrollback.written, scrollback.mask + 1);
+      if ((int32_t)(historyDump.pos - oldest) < 0) historyDump.pos = oldest;
+      if ((int32_t)(historyDump.end - historyDump.pos) <= 0) break;
+      n = min((size_t)(historyDump.end - historyDump.pos), sizeof(chunk));
+      scrollbackCopy(historyDump.pos, chunk, n);
+    }
+    size_t done;
+    size_t out = CharsetTranslator::toTerminal((Charset)charset, chunk, n, xlat, sizeof(xlat), done);
+    serialOut.write(xlat, out);
+    historyDump.pos += n;
+    if (serialTaskHandle) xTaskNotifyGive(serialTaskHandle);
+  }
+  // OK - только после того, как история ушла в USB
+  if (serialOut.empty()) historyStop();
+}
+
+void showScrollback() {
+  if (!scrollback.buf) return;
+  Serial.printf("SCROLLBACK: %lu KB, %lu STORED, BACKLOG %lu (PEAK %lu), %lu REPLAYED, %lu FULL\r\n",
+                (unsigned long)(scrollback.mask + 1) / 1024,
+                (unsigned long)min(scrollback.written, scrollback.mask + 1),
+                (unsigned long)(scrollback.written - scrollback.shown),
+                (unsigned long)scrollback.peakBacklog, (unsigned long)scrollback.replayed,
+                (unsigned long)scrollback.fullStalls);
+}
+
+void showCapture() {
+  static const char *const states[] = {"OFF", "RECORDING", "STOPPING"};
+  Serial.printf("CAPTURE: %s, %lu RECORDS, %lu BYTES, %lu IN FILE, %lu DROPPED, MAX FLASH WRITE %lu US\r\n",
+                states[capture.state], (unsigned long)capture.records, (unsigned long)capture.bytes,
+                (unsigned long)capture.fileBytes, (unsigned long)capture.dropped, capture.maxWriteUs);
+}
+
+// === ТРАССИРОВКА (ATHEX) ===
+// ATHEX=1 - на Serial1, 2 - в TRACE_FILE, 3 - только в веб. Последние
+// TRACE_TAIL_SIZE байт текста при любом выводе отдает /trace. Формат
+// событий - trace.h.
+
+// Только когда в кольце уже есть n байт
+static void traceRingRead(uint8_t *out, size_t n) {
+  while (n > 0) {
+    size_t len;
+    const uint8_t *p = trace.ring.readPtr(len);
+    len = min(len, n);
+    memcpy(out, p, len);
+    trace.ring.consume(len);
+    out += len;
+    n -= len;
+  }
+}
+
+static void traceTailWrite(const char *text, size_t n) {
+  if (n > TRACE_TAIL_SIZE) {
+    text += n - TRACE_TAIL_SIZE;
+    n = TRACE_TAIL_SIZE;
+  }
+  xSemaphoreTake(trace.tailLock, portMAX_DELAY);
+  size_t ofs = trace.tailPos & (TRACE_TAIL_SIZE - 1);
+  size_t first = min(n, TRACE_TAIL_SIZE - ofs);
+  memcpy(trace.tail + ofs, text, first);
+  memcpy(trace.tail, text + first, n - first);
+  trace.tailPos += n;
+  xSemaphoreGive(trace.tailLock);
+}
+
+// ATHEX сменил вывод: закрываем старый, открываем новый
+static void traceSwitchSink(uint8_t mode) {
+  static bool uartStarted = false;
+  if (trace.sink == TRACE_FILE_SINK) trace.file.close();
+  if (mode == TRACE_FILE_SINK) {
+    trace.file = LittleFS.open(TRACE_FILE, FILE_WRITE);
+    trace.fileBytes = 0;
+  }
+  if (mode == TRACE_UART && !uartStarted) {
+    Serial1.begin(TRACE_UART_BAUD);
+    uartStarted = true;
+  }
+  trace.sink = mode;
+}
+
+static void traceOutput(const char *text, size_t n) {
+  trace.textBytes += n;
+  traceTailWrite(text, n);
+  if (trace.sink == TRACE_UART) {
+    Serial1.write((const uint8_t *)text, n);
+  } else if (trace.sink == TRACE_FILE_SINK && trace.file && trace.fileBytes + n <= TRACE_FILE_MAX) {
+    trace.fileBytes += trace.file.write((const uint8_t *)text, n);
+  }
+}
+
+void traceTask(void *arg) {
+  static char text[TRACE_TEXT_MAX];
+  static uint8_t data[TRACE_MAX_DATA];
+  TraceEvent ev;
+  bool haveEvent = false;  // заголовок прочитан, данные еще пишутся
+  unsigned long lastFlush = millis();
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(trace.mode ? 10 : 1000));
+    for (;;) {
+      if (!haveEvent) {
+        if (trace.ring.used() < sizeof(ev)) break;
+        traceRingRead((uint8_t *)&ev, sizeof(ev));
+        haveEvent = true;
+      }
+      if (trace.ring.used() < ev.len) break;
+      traceRingRead(data, ev.len);
+      haveEvent = false;
+      traceOutput(text, traceFormat(ev, data, text, sizeof(text)));
+    }
+    if (trace.mode != trace.sink) traceSwitchSink(trace.mode);
+    if (trace.sink == TRACE_FILE_SINK && trace.file && millis() - lastFlush >= 1000) {
+      trace.file.flush();
+      lastFlush = millis();
+    }
+  }
+}
+
+bool traceStart(uint8_t mode) {
+  if (mode == TRACE_FILE_SINK && !fsMounted) return false;
+  trace.mode = mode;
+  if (traceTaskHandle) xTaskNotifyGive(traceTaskHandle);
+  return true;
+}
+
+void showTrace() {
+  static const char *const modes[] = {"OFF", "SERIAL1", "FILE", "WEB"};
+  Serial.printf("TRACE: %s, %lu EVENTS, %lu BYTES, %lu DROPPED, %lu TEXT BYTES",
+                modes[trace.mode], (unsigned long)trace.events, (unsigned long)trace.bytes,
+                (unsigned long)trace.dropped, (unsigned long)trace.textBytes);
+  if (trace.sink == TRACE_FILE_SINK) Serial.printf(", %lu IN FILE", (unsigned long)trace.fileBytes);
+  Serial.print("\r\n");
+  // Цена трассировки для насоса - сравнивать с пропускной способностью в ATI
+  if (trace.bytes) {
+    Serial.printf("TRACE COST: %lu US IN NET TASK, %lu NS/BYTE\r\n", trace.producerUs,
+                  (unsigned long)(trace.producerUs * 1000ULL / trace.bytes));
+  }
+}
+
+// === КЭШ DNS ===
+// Небольшая таблица имя -> адрес с временем жизни. После подключения к
+// WiFi фоном прогреваются имена самых частых быстрых номеров (не больше
+// DNS_PREFETCH_MAX, чтобы прогрев не вытеснял сам себя и ручные звонки) и
+// прогреваются снова на 3/4 срока жизни, так что ATDS обычно обходится без
+// запроса к DNS. Трогается только из loop().
+// TTL ответа lwIP наружу не отдает, поэтому срок жизни задает AT$DNSTTL:
+// по умолчанию минута - BBS на динамических адресах переезжают быстро.
+
+struct DnsCacheEntry {
+  char host[MAX_HOST_LENGTH];
+  uint32_t addr;
+  unsigned long stored;
+  unsigned long lastUsed;
+};
+DnsCacheEntry dnsCache[DNS_CACHE_SIZE];
+uint32_t dnsHits = 0;
+uint32_t dnsMisses = 0;
+
+// Фоновый прогрев: один запрос за раз
+struct DnsPrefetch {
+  int entries[DNS_PREFETCH_MAX]; // быстрые номера, самые частые первыми
+  int count;
+  int next;                  // индекс в entries, -1 = не идет
+  unsigned long started;     // мс, начало последнего прохода
+  bool inFlight;
+  char host[MAX_HOST_LENGTH];
+  volatile bool done;
+  volatile uint32_t addr;
+};
+DnsPrefetch dnsPrefetch = {{}, 0, -1, 0, false, "", false, 0};
+
+static bool dnsEntryValid(const DnsCacheEntry &e) {
+  return e.host[0] && millis() - e.stored < dnsTtl * 1000UL;
+}
+
+// 0 = нет в кэше
+// count = false - служебный запрос (прогрев): не идет в статистику и не
+// освежает lastUsed, иначе прогрев держал бы запись в кэше вечно
+uint32_t dnsCacheLookup(const char *host, bool count = true) {
+  for (DnsCacheEntry &e : dnsCache) {
+    if (dnsEntryValid(e) && strcasecmp(e.host, host) == 0) {
+      if (count) {
+        e.lastUsed = millis();
+        dnsHits++;
+      }
+      return e.addr;
+    }
+  }
+  if (count) dnsMisses++;
+  return 0;
+}
+
+void dnsCacheStore(const char *host, uint32_t addr) {
+  if (addr == 0 || dnsTtl == 0 || strlen(host) >= MAX_HOST_LENGTH) return;
+  // То же имя, иначе пустая или просроченная запись, иначе самая старая
+  DnsCacheEntry *slot = nullptr;
+  for (DnsCacheEntry &e : dnsCache) {
+    if (e.host[0] && strcasecmp(e.host, host) == 0) {
+      slot = &e;
+      break;
+    }
+    if (!dnsEntryValid(e)) {
+      if (!slot || dnsEntryValid(*slot)) slot = &e;
+    } else if (!slot || (dnsEntryValid(*slot) && e.lastUsed - slot->lastUsed > 0x80000000UL)) {
+      slot = &e;
+    }
+  }
+  strcpy(slot->host, host);
+  slot->addr = addr;
+  slot->stored = slot->lastUsed = millis();
+}
+
+int dnsCacheCount() {
+  int n = 0;
+  for (const DnsCacheEntry &e : dnsCache) {
+    if (dnsEntryValid(e)) n++;
+  }
+  return n;
+}
+
+// Разбор "host:port" в фиксированный буфер
+// "S host:port" - звонок по TLS (ATDTS, так же можно записать быстрый номер)
+const char *dialTarget(const char *target, bool &secure) {
+  while (*target == ' ') target++;
+  secure = toupper(target[0]) == 'S' && target[1] == ' ';
+  return secure ? target + 2 : target;
+}
+
+bool splitHostPort(const char *target, char *host, size_t hostSize, uint16_t &port, uint16_t defaultPort = 23) {
+  while (*target == ' ') target++;
+  const char *colon = strchr(target, ':');
+  size_t len = colon ? (size_t)(colon - target) : strlen(target);
+  while (len > 0 && target[len - 1] == ' ') len--;
+  if (len == 0 || len >= hostSize) return false;
+  memcpy(host, target, len);
+  host[len] = 0;
+  port = colon ? atoi(colon + 1) : defaultPort;
+  return true;
+}
+
+// Вызывается из потока lwIP
+static void dnsPrefetchFound(const char *name, const ip_addr_t *addr, void *arg) {
+  dnsPrefetch.addr = addr ? ip4_addr_get_u32(ip_2_ip4(addr)) : 0;
+  dnsPrefetch.done = true;
+}
+
+// Имя хоста быстрого номера; false - номер пуст или записан адресом
+static bool speedDialName(int entry, char *host, size_t hostSize) {
+  bool secure;
+  uint16_t port;
+  IPAddress ip;
+  const char *target = dialTarget(speedDials[entry], secure);
+  return splitHostPort(target, host, hostSize, port) && !ip.fromString(host);
+}
+
+// Проход по именам самых частых быстрых номеров, без повторов
+void dnsPrefetchStart() {
+  char host[MAX_HOST_LENGTH], other[MAX_HOST_LENGTH];
+  dnsPrefetch.count = 0;
+  for (int i = 0; i < 10; i++) {
+    if (!speedDialName(i, host, sizeof(host))) continue;
+    bool seen = false;
+    for (int k = 0; k < dnsPrefetch.count && !seen; k++) {
+      seen = speedDialName(dnsPrefetch.entries[k], other, sizeof(other)) && strcasecmp(host, other) == 0;
+    }
+    if (seen) continue;
+    int pos = dnsPrefetch.count;
+    while (pos > 0 && dialCounts[dnsPrefetch.entries[pos - 1]] < dialCounts[i]) pos--;
+    if (pos >= DNS_PREFETCH_MAX) continue;
+    if (dnsPrefetch.count < DNS_PREFETCH_MAX) dnsPrefetch.count++;
+    for (int k = dnsPrefetch.count - 1; k > pos; k--) dnsPrefetch.entries[k] = dnsPrefetch.entries[k - 1];
+    dnsPrefetch.entries[pos] = i;
+  }
+  dnsPrefetch.next = 0;
+  dnsPrefetch.started = millis();
+}
+
+void dnsPrefetchStep() {
+  if (dnsPrefetch.inFlight) {
+    if (!dnsPrefetch.done) return;
+    dnsCacheStore(dnsPrefetch.host, dnsPrefetch.addr);
+    dnsPrefetch.inFlight = false;
+  }
+
+  // Повтор до того, как записи прошлого прохода истекут
+  if (dnsPrefetch.next < 0 && dnsTtl && wifiMgr.state == WIFI_UP &&
+      millis() - dnsPrefetch.started >= dnsTtl * 750UL) {
+    dnsPrefetchStart();
+  }
+
+  while (dnsPrefetch.next >= 0 && dnsPrefetch.next < dnsPrefetch.count) {
+    if (!speedDialName(dnsPrefetch.entries[dnsPrefetch.next++], dnsPrefetch.host, sizeof(dnsPrefetch.host))) continue;
+
+    dnsPrefetch.done = false;
+    ip_addr_t addr;
+#ifdef LOCK_TCPIP_CORE
+    LOCK_TCPIP_CORE();
+#endif
+    err_t err = dns_gethostbyname(dnsPrefetch.host, &addr, dnsPrefetchFound, nullptr);
+#ifdef UNLOCK_TCPIP_CORE
+    UNLOCK_TCPIP_CORE();
+#endif
+    if (err == ERR_OK) {
+      dnsCacheStore(dnsPrefetch.host, ip4_addr_get_u32(ip_2_ip4(&addr)));
+    } else if (err == ERR_INPROGRESS) {
+      dnsPrefetch.inFlight = true;
+      return;
+    }
+  }
+  dnsPrefetch.next = -1;
+}
+
+// === ПРОГРЕВ БЫСТРЫХ НОМЕРОВ ===
+// AT$WARM=n: к n самым частым быстрым номерам заранее открыто TCP
+// соединение. ATDS отдает его новой сессии сразу, без DNS и установки
+// TCP; для TLS номера остается только рукопожатие. Соединение
+// проверяется на обрыв и живет не дольше WARM_IDLE_MS, после чего номер
+// отдыхает WARM_COOLDOWN_MS, чтобы не заваливать BBS звонками. Для BBS
+// прогретое соединение - занятый узел: до 2 минут на звонок, который
+// может не состояться, и новый звонок примерно раз в 3 минуты. Поэтому
+// на один адрес (несколько быстрых номеров могут вести на одну BBS)
+// прогревающий звонок - не чаще WARM_HOST_GAP_MS; звонок, который
+// пригодился, счет сбрасывает. Пока идет звонок или набор, новые
+// соединения не открываются. Трогается только из loop().
+
+enum WarmState { WARM_FREE, WARM_CONNECTING, WARM_READY };
+
+struct WarmConn {
+  uint8_t state;
+  int8_t entry;            // номер быстрого набора
+  int fd;
+  uint32_t addr;
+  unsigned long since;     // мс: начало connect(), потом готовность
+  unsigned long startUs;
+};
+WarmConn warmPool[WARM_MAX];
+unsigned long warmRested[10];  // мс, когда номер отправили отдыхать (0 - не отдыхает)
+uint32_t warmHits = 0;
+uint32_t warmMisses = 0;
+uint32_t warmDropped = 0;      // закрыто сервером, по ошибке или простою
+uint32_t warmLimited = 0;      // прогрев отложен из-за WARM_HOST_GAP_MS
+unsigned long warmLastCheck = 0;
+
+// Последний прогревающий звонок на адрес
+struct WarmHost {
+  uint32_t addr;
+  unsigned long dialed;
+};
+WarmHost warmHosts[WARM_HOSTS];
+
+static WarmHost *warmHostFind(uint32_t addr) {
+  for (WarmHost &h : warmHosts) {
+    if (h.addr == addr) return &h;
+  }
+  return nullptr;
+}
+
+// Можно ли снова прогревать addr; true - звонок записан
+static bool warmHostAllow(uint32_t addr) {
+  WarmHost *h = warmHostFind(addr);
+  if (h && millis() - h->dialed < WARM_HOST_GAP_MS) {
+    warmLimited++;
+    return false;
+  }
+  if (!h) {
+    h = &warmHosts[0];
+    for (WarmHost &e : warmHosts) {
+      if (!e.addr) {
+        h = &e;
+        break;
+      }
+      if (millis() - e.dialed > millis() - h->dialed) h = &e;
+    }
+  }
+  h->addr = addr;
+  h->dialed = millis();
+  return true;
+}
+
+static void warmClose(WarmConn &w) {
+  if (w.state != WARM_FREE) close(w.fd);
+  w.state = WARM_FREE;
+}
+
+static void warmRest(WarmConn &w) {
+  warmRested[w.entry] = millis() | 1;
+  warmDropped++;
+  warmClose(w);
+}
+
+// Сервер не закрыл и не сбросил соединение. Присланное заранее
+// (заставка BBS) остается в сокете для сессии.
+static bool warmAlive(int fd) {
+  uint8_t b;
+  int res = recv(fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+  return res > 0 || (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+static WarmConn *warmFind(int entry) {
+  for (WarmConn &w : warmPool) {
+    if (w.state != WARM_FREE && w.entry == entry) return &w;
+  }
+  return nullptr;
+}
+
+// Самые частые быстрые номера по убыванию, не больше warmSize
+static int warmTargets(int *targets) {
+  int n = 0;
+  for (int i = 0; i < 10; i++) {
+    if (!dialCounts[i] || !speedDials[i][0]) continue;
+    int pos = n;
+    while (pos > 0 && dialCounts[targets[pos - 1]] < dialCounts[i]) pos--;
+    if (pos >= warmSize) continue;
+    if (n < warmSize) n++;
+    for (int k = n - 1; k > pos; k--) targets[k] = targets[k - 1];
+    targets[pos] = i;
+  }
+  return n;
+}
+
+static void warmConnect(WarmConn &w, int entry) {
+  bool secure;
+  char host[MAX_HOST_LENGTH];
+  uint16_t port;
+  const char *target = dialTarget(speedDials[entry], secure);
+  if (!splitHostPort(target, host, sizeof(host), port, secure ? TLS_DEFAULT_PORT : 23)) return;
+  IPAddress ip;
+  uint32_t addr = ip.fromString(host) ? (uint32_t)ip : dnsCacheLookup(host, false);
+  if (!addr) return; // имя разрешит dnsPrefetchStep()
+  if (!warmHostAllow(addr)) {
+    warmRested[entry] = millis() | 1;
+    return;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) return;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = addr;
+  sa.sin_port = htons(port);
+  if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 && errno != EINPROGRESS) {
+    close(fd);
+    warmRested[entry] = millis() | 1;
+    return;
+  }
+  w.state = WARM_CONNECTING;
+  w.entry = entry;
+  w.fd = fd;
+  w.addr = addr;
+  w.since = millis();
+  w.startUs = micros();
+}
+
+// Проверка одного соединения; false - закрыто
+static bool warmCheck(WarmConn &w) {
+  if (w.state == WARM_READY) {
+    if (warmAlive(w.fd) && millis() - w.since < WARM_IDLE_MS) return true;
+    warmRest(w);
+    return false;
+  }
+
+  fd_set wset;
+  FD_ZERO(&wset);
+  FD_SET(w.fd, &wset);
+  struct timeval tv = {0, 0};
+  if (select(w.fd + 1, NULL, &wset, NULL, &tv) <= 0) {
+    if (millis() - w.since <= sRegs[S_WAITCARRIER] * 1000UL) return true;
+    warmRest(w);
+    return false;
+  }
+  int sockErr = 0;
+  socklen_t len = sizeof(sockErr);
+  if (getsockopt(w.fd, SOL_SOCKET, SO_ERROR, &sockErr, &len) < 0 || sockErr != 0) {
+    warmRest(w);
+    return false;
+  }
+  w.state = WARM_READY;
+  w.since = millis();
+  metrics.tcpConnect.record(micros() - w.startUs);
+  return true;
+}
+
+void warmStep() {
+  if (millis() - warmLastCheck < WARM_CHECK_MS) return;
+  warmLastCheck = millis();
+
+  int targets[WARM_MAX];
+  int n = wifiMgr.state == WIFI_UP ? warmTargets(targets) : 0;
+  for (WarmConn &w : warmPool) {
+    if (w.state == WARM_FREE) continue;
+    bool wanted = false;
+    for (int k = 0; k < n; k++) wanted |= targets[k] == w.entry;
+    if (wanted) warmCheck(w);
+    else warmClose(w);
+  }
+
+  if (sessionCount() > 0) return;
+  for (int k = 0; k < n; k++) {
+    int entry = targets[k];
+    if (warmFind(entry)) continue;
+    if (warmRested[entry] && millis() - warmRested[entry] < WARM_COOLDOWN_MS) continue;
+    for (WarmConn &w : warmPool) {
+      if (w.state != WARM_FREE) continue;
+      warmConnect(w, entry);
+      break;
+    }
+  }
+}
+
+// Готовое соединение к быстрому номеру (сокет переходит к вызывающему)
+// или -1. Недозревшее или оборванное закрывается - наберем заново.
+int warmTake(int entry) {
+  if (!warmSize) return -1;
+  WarmConn *w = warmFind(entry);
+  if (w && w->state == WARM_READY && warmAlive(w->fd)) {
+    int fd = w->fd;
+    w->state = WARM_FREE;
+    warmHits++;
+    WarmHost *h = warmHostFind(w->addr);
+    if (h) h->addr = 0; // звонок пригодился - в счет не идет
+    return fd;
+  }
+  if (w) warmClose(*w);
+  warmMisses++;
+  return -1;
+}
+
+void showWarm() {
+  Serial.printf("WARM POOL: %d, %lu HITS, %lu MISSES, %lu DROPPED, %lu LIMITED\r\n", warmSize,
+                (unsigned long)warmHits, (unsigned long)warmMisses, (unsigned long)warmDropped,
+                (unsigned long)warmLimited);
+  for (const WarmConn &w : warmPool) {
+    if (w.state == WARM_FREE) continue;
+    Serial.printf("%d: %s %s %lu S\r\n", w.entry, speedDials[w.entry],
+                  w.state == WARM_READY ? "READY" : "CONNECTING", (millis() - w.since) / 1000);
+  }
+  Serial.print("DIAL COUNTS:");
+  for (int i = 0; i < 10; i++) {
+    if (dialCounts[i]) Serial.printf(" %d=%u", i, dialCounts[i]);
+  }
+  Serial.println();
+}
+
+// === ВХОДЯЩИЕ ЗВОНКИ ===
+// Слушающий сокет неблокирующий, listenerStep() работает в loop() без
+// SessionLock: accept() и отказы не задерживают netTask. Сканеры и
+// флуд отсекаются до всякой работы - сначала лимит на адрес, потом общее
+// ведро токенов; их соединения рвутся через RST, чтобы PCB lwIP
+// освобождался сразу, без TIME_WAIT. Кому не можем ответить - сообщение
+// "занято" одним send() без ожидания. Остальные ждут в короткой очереди,
+// из нее handleIncomingCall() звонит RING и отвечает.
+
+struct ListenPeer {
+  uint32_t addr;
+  unsigned long windowStart;  // мс
+  uint8_t count;
+};
+
+struct PendingCall {
+  int fd;
+  unsigned long since;        // мс
+};
+
+struct Listener {
+  int fd = -1;
+  PendingCall queue[LISTEN_QUEUE];
+  int queued;
+  ListenPeer peers[LISTEN_PEERS];
+  uint32_t tokens;            // тысячные доли звонка
+  unsigned long refillAt;     // мс
+  bool canAnswer;             // снимок handleIncomingCall() под SessionLock
+  unsigned long callSince;    // connectTime текущего звонка для "занято"
+  uint32_t accepted;
+  uint32_t answered;
+  uint32_t busy;
+  uint32_t queueFull;
+  uint32_t expired;
+  uint32_t rateLimited;       // лимит на адрес
+  uint32_t throttled;         // пустое ведро
+};
+Listener listener;
+
+void listenerBegin() {
+  listener.tokens = LISTEN_BURST * 1000;
+  listener.refillAt = millis();
+  listener.fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listener.fd < 0) return;
+  int one = 1;
+  setsockopt(listener.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = INADDR_ANY;
+  sa.sin_port = htons(LISTEN_PORT);
+  if (bind(listener.fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(listener.fd, LISTEN_BACKLOG) < 0) {
+    close(listener.fd);
+    listener.fd = -1;
+    return;
+  }
+  fcntl(listener.fd, F_SETFL, fcntl(listener.fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Разрыв через RST; без LWIP_SO_LINGER setsockopt не пройдет - тогда FIN
+static void listenerDrop(int fd) {
+  struct linger lg = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+  close(fd);
+}
+
+// "Занято": буфер свежего сокета пуст, текст уходит одним send()
+static void listenerBusy(int fd) {
+  char text[MAX_BUSY_LENGTH + 32], timeStr[TIME_STR_SIZE];
+  int n = snprintf(text, sizeof(text), "%s\r\nCURRENT CALL: %s\r\n", busyMsg,
+                   connectTimeString(listener.callSince, timeStr));
+  send(fd, text, min(n, (int)sizeof(text) - 1), MSG_DONTWAIT);
+  close(fd);
+}
+
+// Лимит на адрес: не больше LISTEN_PER_IP звонков за окно. Новый адрес
+// вытесняет запись с самым старым окном.
+static bool listenerPeerAllowed(uint32_t addr) {
+  unsigned long now = millis();
+  ListenPeer *slot = nullptr, *oldest = nullptr;
+  unsigned long oldestAge = 0;
+  for (ListenPeer &peer : listener.peers) {
+    if (peer.count && peer.addr == addr) {
+      slot = &peer;
+      break;
+    }
+    unsigned long age = peer.count ? now - peer.windowStart : ~0UL;
+    if (!oldest || age > oldestAge) {
+      oldest = &peer;
+      oldestAge = age;
+    }
+  }
+  if (!slot || now - slot->windowStart > LISTEN_WINDOW_MS) {
+    if (!slot) slot = oldest;
+    slot->addr = addr;
+    slot->windowStart = now;
+    slot->count = 0;
+  }
+  if (slot->count < 255) slot->count++;
+  return slot->count <= LISTEN_PER_IP;
+}
+
+static bool listenerTakeToken() {
+  unsigned long now = millis();
+  uint32_t elapsed = min((uint32_t)(now - listener.refillAt), (uint32_t)(LISTEN_BURST * 1000 / LISTEN_RATE));
+  listener.refillAt = now;
+  listener.tokens = min(listener.tokens + elapsed * LISTEN_RATE, (uint32_t)LISTEN_BURST * 1000);
+  if (listener.tokens < 1000) return false;
+  listener.tokens -= 1000;
+  return true;
+}
+
+static void listenerRemove(int i) {
+  listener.queued--;
+  memmove(listener.queue + i, listener.queue + i + 1, (listener.queued - i) * sizeof(PendingCall));
+}
+
+// Прием новых звонков; вызывается из loop() без SessionLock
+void listenerStep() {
+  if (listener.fd < 0) return;
+  for (int k = 0; k < LISTEN_ACCEPT_MAX; k++) {
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    int fd = accept(listener.fd, (struct sockaddr *)&sa, &len);
+    if (fd < 0) return;
+    listener.accepted++;
+    if (!listenerPeerAllowed(sa.sin_addr.s_addr)) {
+      listener.rateLimited++;
+      listenerDrop(fd);
+    } else if (!listenerTakeToken()) {
+      listener.throttled++;
+      listenerDrop(fd);
+    } else if (!listener.canAnswer) {
+      listener.busy++;
+      listenerBusy(fd);
+    } else if (listener.queued == LISTEN_QUEUE) {
+      listener.queueFull++;
+      listenerBusy(fd);
+    } else {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+      listener.queue[listener.queued++] = {fd, millis()};
+    }
+  }
+}
+
+void showListener() {
+  Serial.printf("LISTENER: PORT %d%s, %d WAITING, %lu CALLS, %lu ANSWERED\r\n", LISTEN_PORT,
+                listener.fd < 0 ? " FAILED" : "", listener.queued, (unsigned long)listener.accepted,
+                (unsigned long)listener.answered);
+  Serial.printf("REJECTED: %lu BUSY, %lu QUEUE FULL, %lu EXPIRED, %lu RATE LIMITED, %lu THROTTLED\r\n",
+                (unsigned long)listener.busy, (unsigned long)listener.queueFull,
+                (unsigned long)listener.expired, (unsigned long)listener.rateLimited,
+                (unsigned long)listener.throttled);
+}
+
+// === МЕНЕДЖЕР WIFI ===
+// Подключение идет в фоне: wifiStep() вызывается из loop() и реагирует на
+// флаги из обработчика событий. После первого успешного подключения BSSID
+// и канал сохраняются, и следующая попытка идет без сканирования эфира.
+// При обрыве - повтор с экспоненциальной паузой.
+
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) wifiMgr.gotIp = true;
+  else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) wifiMgr.lostLink = true;
+}
+
+static void wifiBegin() {
+  wifiMgr.gotIp = false;
+  wifiMgr.lostLink = false;
+  wifiMgr.fast = wifiMgr.haveFast;
+  wifiMgr.attemptStart = millis();
+  wifiMgr.state = WIFI_CONNECTING;
+  if (wifiMgr.fast) {
+    WiFi.begin(ssid, password, wifiMgr.channel, wifiMgr.bssid);
+  } else {
+    WiFi.begin(ssid, password);
+  }
+}
+
+static void wifiSaveFast() {
+  uint8_t *bssid = WiFi.BSSID();
+  int32_t channel = WiFi.channel();
+  if (!bssid) return;
+  if (wifiMgr.haveFast && wifiMgr.channel == channel && memcmp(wifiMgr.bssid, bssid, 6) == 0) return;
+
+  memcpy(wifiMgr.bssid, bssid, 6);
+  wifiMgr.channel = channel;
+  wifiMgr.haveFast = true;
+  // Только точка доступа: несохраненные AT-настройки на флеш не попадают
+  if (storedSettings.version != SETTINGS_VERSION) return;
+  StoredSettings st = storedSettings;
+  memcpy(st.bssid, wifiMgr.bssid, 6);
+  st.channel = wifiMgr.channel;
+  st.haveFast = true;
+  st.crc = settingsCrc(st);
+  settingsWrite(st);
+}
+
+void wifiStep() {
+  switch (wifiMgr.state) {
+    case WIFI_IDLE:
+      break;
+
+    case WIFI_CONNECTING:
+      if (wifiMgr.gotIp) {
+        wifiMgr.lastTimeToIp = millis() - wifiMgr.downSince;
+        wifiMgr.lastWasFast = wifiMgr.fast;
+        wifiMgr.backoff = WIFI_BACKOFF_MIN;
+        wifiMgr.state = WIFI_UP;
+        wifiSaveFast();
+        dnsPrefetchStart();
+        updateLed();
+        // Во время звонка терминал не засоряем
+        if (cmdMode) {
+          Serial.print("CONNECTED TO ");
+          Serial.println(WiFi.SSID());
+          Serial.print("IP ADDRESS: ");
+          Serial.println(WiFi.localIP());
+        }
+      } else if (millis() - wifiMgr.attemptStart > WIFI_ATTEMPT_MS ||
+                 (wifiMgr.lostLink && millis() - wifiMgr.attemptStart > WIFI_BACKOFF_MIN)) {
+        // Сохраненная точка не ответила - дальше со сканированием
+        if (wifiMgr.fast) wifiMgr.haveFast = false;
+        WiFi.disconnect();
+        wifiMgr.state = WIFI_BACKOFF;
+        wifiMgr.attemptStart = millis();
+        if (cmdMode && wifiMgr.backoff == WIFI_BACKOFF_MIN) Serial.println("WIFI CONNECTION FAILED, RETRYING");
+      }
+      break;
+
+    case WIFI_UP:
+      if (wifiMgr.lostLink) {
+        wifiMgr.lostLink = false;
+        if (WiFi.status() == WL_CONNECTED) break;
+        wifiMgr.downSince = millis();
+        wifiMgr.reconnects++;
+        wifiMgr.backoff = WIFI_BACKOFF_MIN;
+        wifiMgr.state = WIFI_BACKOFF;
+        wifiMgr.attemptStart = millis();
+        updateLed();
+      }
+      break;
+
+    case WIFI_BACKOFF:
+      if (millis() - wifiMgr.attemptStart >= wifiMgr.backoff) {
+        wifiMgr.backoff = min(wifiMgr.backoff * 2, (unsigned long)WIFI_BACKOFF_MAX);
+        wifiBegin();
+      }
+      break;
+  }
+}
+
+bool connectWiFi() {
+  if (ssid[0] == '\0') {
+    Serial.println("ERROR: SSID not configured. Use AT$SSID=your_ssid");
+    return false;
+  }
+  
+  Serial.print("CONNECTING TO ");
+  Serial.println(ssid);
+
+  wifiMgr.wanted = true;
+  wifiMgr.downSince = millis();
+  wifiMgr.backoff = WIFI_BACKOFF_MIN;
+  wifiBegin();
+  updateLed();
+  return true;
+}
+
+void disconnectWiFi() {
+  wifiMgr.wanted = false;
+  wifiMgr.state = WIFI_IDLE;
+  WiFi.disconnect();
+  Serial.println("WIFI DISCONNECTED");
+  updateLed();
+}
+
+// Куча: сколько свободно, минимум за все время и крупнейший блок.
+// Разница между свободным и крупнейшим блоком - фрагментация. Разница с
+// концом загрузки зависит от открытых сессий и TLS; при тех же сессиях
+// она должна возвращаться к прежней - иначе где-то утечка.
+void showHeap() {
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t largest = ESP.getMaxAllocHeap();
+  Serial.printf("HEAP: FREE %lu, MIN %lu, LARGEST BLOCK %lu, FRAG %lu%%\r\n",
+                (unsigned long)freeHeap, (unsigned long)ESP.getMinFreeHeap(), (unsigned long)largest,
+                freeHeap ? (unsigned long)(100 - largest * 100ULL / freeHeap) : 0UL);
+  if (heapAfterSetup) {
+    Serial.printf("HEAP SINCE BOOT: %ld BYTES, %d SESSIONS OPEN\r\n", (long)freeHeap - (long)heapAfterSetup,
+                  sessionCount());
+  }
+}
+
+void showBoot() {
+  Serial.printf("BOOT: OK AFTER %lu MS, SETTINGS %lu US (%s), LATE INIT %lu MS\r\n",
+                bootOkUs / 1000, settingsLoadUs, settingsSourceNames[settingsSource], bootLateUs / 1000);
+  if (fsMounted) Serial.printf("LITTLEFS: MOUNTED IN %lu MS\r\n", fsMountMs);
+  else Serial.println(fsMountMs ? "LITTLEFS: MOUNT FAILED" : "LITTLEFS: MOUNTING");
+  Serial.printf("NVRAM: %lu WRITES, %lu UNCHANGED SAVES SKIPPED\r\n",
+                (unsigned long)settingsWrites, (unsigned long)settingsSkipped);
+}
+
+void showNetworkInfo() {
+  Serial.println("=== NETWORK STATUS ===");
+  
+  Serial.print("WIFI: ");
+  switch (WiFi.status()) {
+    case WL_CONNECTED: Serial.println("CONNECTED"); break;
+    case WL_NO_SSID_AVAIL: Serial.println("SSID NOT FOUND"); break;
+    case WL_CONNECT_FAILED: Serial.println("CONNECTION FAILED"); break;
+    case WL_IDLE_STATUS: Serial.println("IDLE"); break;
+    case WL_DISCONNECTED: Serial.println("DISCONNECTED"); break;
+    default: Serial.println("UNKNOWN"); break;
+  }
+  
+  if (WiFi.status() == WL_CONNECTED) {
+    Serial.print("SSID: "); Serial.println(ssid);
+    Serial.print("IP: "); Serial.println(WiFi.localIP());
+    Serial.print("RSSI: "); Serial.print(WiFi.RSSI()); Serial.println(" dBm");
+  }
+  if (wifiMgr.lastTimeToIp) {
+    Serial.printf("TIME TO IP: %lu MS (%s), RECONNECTS: %lu\r\n", wifiMgr.lastTimeToIp,
+                  wifiMgr.lastWasFast ? "FAST" : "SCAN", (unsigned long)wifiMgr.reconnects);
+  }
+  Serial.printf("DNS CACHE: %d ENTRIES, %lu HITS, %lu MISSES, TTL %u S\r\n",
+                dnsCacheCount(), (unsigned long)dnsHits, (unsigned long)dnsMisses, dnsTtl);
+  
+  Serial.print("CALL STATUS: ");
+  Session *ses = currentSession();
+  if (ses) {
+    Serial.print("CONNECTED TO ");
+    Serial.println(ses->client.remoteIP());
+    char timeStr[TIME_STR_SIZE];
+    Serial.print("DURATION: ");
+    Serial.println(connectTimeString(ses->connectTime, timeStr));
+    showPumpStats(*ses);
+  } else {
+    Serial.println("NOT CONNECTED");
+  }
+  Serial.printf("SESSIONS: %d/%d\r\n", sessionCount(), MAX_SESSIONS);
+  Serial.printf("PIPELINE: NET CORE %d, SERIAL CORE %d, SERIAL WRITES %lu, OUT BUF %u\r\n",
+                NET_TASK_CORE, SERIAL_TASK_CORE, (unsigned long)serialWrites, (unsigned)serialOut.used());
+  showHeap();
+  showBoot();
+  showWebTerminal();
+  showCapture();
+  showMccp();
+  showTls();
+  showScrollback();
+  if (trace.mode || trace.events) showTrace();
+  if (warmSize || warmHits) showWarm();
+  showListener();
+  showTransfer();
+  showMetrics();
+  
+  Serial.println("=====================");
+}
+
+void showSettings() {
+  Serial.println("=== CURRENT SETTINGS ===");
+  Serial.print("BAUD: "); Serial.println(currentBaudRate);
+  Serial.print("SSID: "); Serial.println(ssid);
+  Serial.print("PASS: "); Serial.println("********"); // Не показываем пароль
+  Serial.print("BUSY MSG: "); Serial.println(busyMsg);
+  Serial.print("ECHO: "); Serial.println(echo ? "ON" : "OFF");
+  Serial.print("VERBOSE: "); Serial.println(verboseResults ? "ON" : "OFF");
+  Serial.print("TELNET: "); Serial.println(telnet ? "ON" : "OFF");
+  Serial.print("CHARSET: "); Serial.println(charsetNames[charset]);
+  Serial.print("LINE PACING: "); Serial.println(paceLine ? "ON" : "OFF");
+  Serial.print("FLOW CONTROL: ");
+  Serial.println(flowControl == 4 ? "XON/XOFF" : flowControl == 3 ? "RTS/CTS (USB)" : "NONE");
+  Serial.print("MCCP COMPRESSION: "); Serial.println(mccpEnabled ? "ON" : "OFF");
+  Serial.print("WARM SPEED DIALS: "); Serial.println(warmSize);
+  Serial.print("DNS CACHE TTL: "); Serial.print(dnsTtl); Serial.println(" S");
+  Serial.print("WEB TERMINAL: ");
+  Serial.println(wsMode == WS_INTERACTIVE ? "INTERACTIVE" : wsMode == WS_VIEW ? "VIEW ONLY" : "OFF");
+  Serial.print("AUTO ANSWER: ");
+  if (sRegs[S_AUTOANSWER]) Serial.printf("AFTER %d RINGS\r\n", sRegs[S_AUTOANSWER]);
+  else Serial.println("OFF");
+  Serial.print("S-REGISTERS:");
+  for (int i = 0; i < SREG_COUNT; i++) Serial.printf(" S%d=%d", i, sRegs[i]);
+  Serial.println();
+  
+  Serial.println("SPEED DIAL:");
+  for (int i = 0; i < 10; i++) {
+    if (speedDials[i][0]) {
+      Serial.printf("%d: %s\r\n", i, speedDials[i]);
+    }
+  }
+  Serial.println("=====================");
+}
+
+void showHelp() {
+  Serial.println("=== AT COMMANDS ===");
+  Serial.println("AT              - Test command");
+  Serial.println("ATDT host:port  - Dial host (ATDT google.com:80)");
+  Serial.println("ATDTS host:port - Dial over TLS (port 992 by default, cert not verified)");
+  Serial.println("ATDS n          - Speed dial (n=0-9)");
+  Serial.println("ATH             - Hang up");
+  Serial.println("ATO / ATOn      - Go online (to session n)");
+  Serial.println("AT$SL           - List sessions");
+  Serial.println("ATZ             - Reload settings");
+  Serial.println("AT&W            - Save settings");
+  Serial.println("AT&F            - Factory reset");
+  Serial.println("AT&V            - View settings");
+  Serial.println("AT&K0/3/4       - Flow control none/RTS-CTS/XON-XOFF");
+  Serial.println("AT?             - This help");
+  Serial.println("ATI             - Network info");
+  Serial.println("ATE0/ATE1       - Echo off/on");
+  Serial.println("ATV0/ATV1       - Verbose off/on");
+  Serial.println("ATS0=n          - Auto answer after n rings (0=off)");
+  Serial.println("ATS7=n          - Dial timeout, seconds");
+  Serial.println("ATSn=v / ATSn?  - Set/read S-register");
+  Serial.println("ATNET0/ATNET1   - Telnet off/on");
+  Serial.println("ATPETn          - Charset: 0=none 1=PETSCII 2=ATASCII 3=CP437>UTF-8");
+  Serial.println("ATC0/ATC1       - WiFi off/on");
+  Serial.println("AT$SSID=xxx     - Set WiFi SSID");
+  Serial.println("AT$PASS=xxx     - Set WiFi password");
+  Serial.println("AT$SB=nnnn      - Set baud rate");
+  Serial.println("AT$PACE=0/1     - Emulate line speed off/on");
+  Serial.println("AT$BM=message   - Set busy message");
+  Serial.println("AT$WS=n         - Web terminal: 0=off 1=view 2=interactive");
+  Serial.println("AT$MCCP=0/1     - Telnet compression (MCCP2) off/on");
+  Serial.println("AT$CAP=0/1      - Record session to flash off/on");
+  Serial.println("AT$PLAY=n[,s]   - Replay recording, n x speed (0=max), session s only");
+  Serial.println("AT$HIST=n       - Show last n KB of received data (0=all)");
+  Serial.println("ATHEX=n         - Trace link: 0=off 1=Serial1 2=file 3=web (/trace)");
+  Serial.println("AT$WARM=n       - Keep n most dialed speed dials connected (0=off)");
+  Serial.println("                  each holds a BBS node up to 2 min, redials ~3 min");
+  Serial.println("AT$DNSTTL=n     - Trust cached DNS answers n seconds (0=no cache)");
+  Serial.println("AT&Zn=host:port - Set speed dial (n=0-9)");
+  Serial.println("AT$RB           - Reboot ESP32");
+  Serial.println("Commands can be chained: ATE0V1S0=1&W");
+  Serial.println("=================");
+}
+
+// === НАБОР НОМЕРА ===
+// Набор идет конечным автоматом: DNS -> неблокирующий connect() ->
+// [рукопожатие TLS] -> CONNECT / NO ANSWER. dialStep() делает один шаг за проход loop(),
+// поэтому веб-сервер, входящие звонки и светодиод не замирают, а любая
+// клавиша прерывает набор, как у настоящего модема.
+
+enum DialState { DIAL_IDLE, DIAL_RESOLVING, DIAL_CONNECTING, DIAL_HANDSHAKE };
+
+struct Dialer {
+  DialState state;
+  char host[MAX_HOST_LENGTH];
+  uint16_t port;
+  int fd;
+  unsigned long started;
+  uint32_t generation;       // отсекает ответы DNS от прерванного набора
+  volatile bool dnsDone;
+  volatile uint32_t dnsAddr; // 0 = имя не найдено
+  bool secure;               // ATDTS
+  TlsLink *tlsLink;
+  bool resumeOffered;        // предложена сессия из кэша; принята ли - после рукопожатия
+  unsigned long stepStart;   // мкс, начало connect() или рукопожатия
+  unsigned long tcpUs;
+};
+Dialer dialer = {DIAL_IDLE, "", 0, -1, 0, 0, false, 0, false, nullptr, false, 0, 0};
+
+bool dialing() {
+  return dialer.state != DIAL_IDLE;
+}
+
+// Вызывается из потока lwIP
+static void dialDnsFound(const char *name, const ip_addr_t *addr, void *arg) {
+  if ((uint32_t)(uintptr_t)arg != dialer.generation) return;
+  dialer.dnsAddr = addr ? ip4_addr_get_u32(ip_2_ip4(addr)) : 0;
+  dialer.dnsDone = true;
+}
+
+static void dialFinish(ResultCode result) {
+  if (dialer.tlsLink) {
+    dialer.tlsLink->fd = -1; // рукопожатие не закончено - close_notify не нужен
+    tlsRelease(dialer.tlsLink);
+    dialer.tlsLink = nullptr;
+  }
+  if (dialer.fd >= 0) {
+    close(dialer.fd);
+    dialer.fd = -1;
+  }
+  dialer.state = DIAL_IDLE;
+  dialer.generation++;
+  sendResult(result);
+}
+
+static void dialConnect(uint32_t addr) {
+  dialer.fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (dialer.fd < 0) {
+    dialFinish(A_NOANSWER);
+    return;
+  }
+  fcntl(dialer.fd, F_SETFL, fcntl(dialer.fd, F_GETFL, 0) | O_NONBLOCK);
+
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = addr;
+  sa.sin_port = htons(dialer.port);
+  dialer.stepStart = micros();
+  int res = connect(dialer.fd, (struct sockaddr *)&sa, sizeof(sa));
+  if (res < 0 && errno != EINPROGRESS) {
+    dialFinish(A_NOANSWER);
+    return;
+  }
+  dialer.state = DIAL_CONNECTING;
+}
+
+static void dialConnected() {
+  // Дальше сокетом владеет WiFiClient, он ждет блокирующий режим
+  fcntl(dialer.fd, F_SETFL, fcntl(dialer.fd, F_GETFL, 0) & ~O_NONBLOCK);
+  // TLS работает через send/recv с MSG_DONTWAIT, режим сокета ему не важен
+  int id = sessionOpen(WiFiClient(dialer.fd), false, dialer.tlsLink);
+  if (id < 0) {
+    dialFinish(A_NOANSWER);
+    return;
+  }
+  sessions[id].tcpUs = dialer.tcpUs;
+  sessions[id].tlsUs = dialer.tlsLink ? micros() - dialer.stepStart : 0;
+  dialer.tlsLink = nullptr;
+  dialer.fd = -1;
+  dialer.state = DIAL_IDLE;
+  dialer.generation++;
+  metrics.dial.record((millis() - dialer.started) * 1000UL);
+  sessionAttach(id);
+}
+
+static void dialHandshake() {
+  int res = tlsHandshakeStep(dialer.tlsLink);
+  if (res == 0) return;
+  if (res < 0) {
+    tls.failures++;
+    dialFinish(A_NOANSWER);
+    return;
+  }
+  unsigned long us = micros() - dialer.stepStart;
+  bool resumed = dialer.resumeOffered && tlsResumed(dialer.tlsLink, dialer.host, dialer.port);
+  if (resumed) {
+    metrics.tlsCached.record(us);
+    tls.resumed++;
+  } else {
+    metrics.tlsFull.record(us);
+  }
+  tls.handshakes++;
+  tlsCacheStore(dialer.tlsLink, dialer.host, dialer.port);
+  dialConnected();
+}
+
+static void dialStartTls() {
+  dialer.tlsLink = tlsAcquire(dialer.fd, dialer.host);
+  if (!dialer.tlsLink) {
+    tls.failures++;
+    dialFinish(A_NOANSWER);
+    return;
+  }
+  dialer.resumeOffered = tlsCacheOffer(dialer.tlsLink, dialer.host, dialer.port);
+  if (dialer.resumeOffered) tls.resumeOffered++;
+  dialer.state = DIAL_HANDSHAKE;
+  dialer.stepStart = micros();
+  dialHandshake();
+}
+
+// speedIndex >= 0 - звонок на быстрый номер (ATDS), можно взять прогретое соединение
+void dialOut(const char *target, int speedIndex = -1) {
+  // Нужен свободный слот сессии; текущий звонок уходит в фон
+  if (dialing() || sessionCount() >= MAX_SESSIONS) {
+    sendResult(A_ERROR);
+    return;
+  }
+  target = dialTarget(target, dialer.secure);
+  if (!splitHostPort(target, dialer.host, sizeof(dialer.host), dialer.port,
+                     dialer.secure ? TLS_DEFAULT_PORT : 23)) {
+    sendResult(A_ERROR);
+    return;
+  }
+  Serial.print(dialer.secure ? "DIALING TLS " : "DIALING ");
+  Serial.print(dialer.host); Serial.print(":"); Serial.println(dialer.port);
+
+  dialer.started = millis();
+  dialer.dnsDone = false;
+  dialer.dnsAddr = 0;
+
+  if (speedIndex >= 0) {
+    int fd = warmTake(speedIndex);
+    if (fd >= 0) {
+      dialer.fd = fd;
+      dialer.tcpUs = 0;
+      if (dialer.secure) dialStartTls();
+      else dialConnected();
+      return;
+    }
+  }
+
+  IPAddress ip;
+  if (ip.fromString(dialer.host)) {
+    dialConnect((uint32_t)ip);
+    return;
+  }
+
+  uint32_t cached = dnsCacheLookup(dialer.host);
+  if (cached) {
+    dialConnect(cached);
+    return;
+  }
+
+  dialer.state = DIAL_RESOLVING;
+  ip_addr_t addr;
+#ifdef LOCK_TCPIP_CORE
+  LOCK_TCPIP_CORE();
+#endif
+  err_t err = dns_gethostbyname(dialer.host, &addr, dialDnsFound, (void *)(uintptr_t)dialer.generation);
+#ifdef UNLOCK_TCPIP_CORE
+  UNLOCK_TCPIP_CORE();
+#endif
+  if (err == ERR_OK) {
+    // уже в кэше lwIP
+    dnsCacheStore(dialer.host, ip4_addr_get_u32(ip_2_ip4(&addr)));
+    dialConnect(ip4_addr_get_u32(ip_2_ip4(&addr)));
+  } else if (err != ERR_INPROGRESS) {
+    dialFinish(A_NOANSWER);
+  }
+}
+
+// Любой байт с терминала во время набора - отбой
+void dialAbort() {
+  if (!dialing()) return;
+  serialIn.discard();
+  dialFinish(A_NOCARRIER);
+}
+
+void dialStep() {
+  if (!dialing()) return;
+
+  if (millis() - dialer.started > sRegs[S_WAITCARRIER] * 1000UL) {
+    dialFinish(A_NOANSWER);
+    return;
+  }
+
+  if (dialer.state == DIAL_RESOLVING) {
+    if (!dialer.dnsDone) return;
+    if (dialer.dnsAddr == 0) {
+      dialFinish(A_NOANSWER);
+    } else {
+      dnsCacheStore(dialer.host, dialer.dnsAddr);
+      dialConnect(dialer.dnsAddr);
+    }
+    return;
+  }
+
+  if (dialer.state == DIAL_HANDSHAKE) {
+    dialHandshake();
+    return;
+  }
+
+  // DIAL_CONNECTING: сокет готов на запись = рукопожатие завершилось
+  fd_set wset;
+  FD_ZERO(&wset);
+  FD_SET(dialer.fd, &wset);
+  struct timeval tv = {0, 0};
+  if (select(dialer.fd + 1, NULL, &wset, NULL, &tv) <= 0) return;
+
+  int sockErr = 0;
+  socklen_t len = sizeof(sockErr);
+  if (getsockopt(dialer.fd, SOL_SOCKET, SO_ERROR, &sockErr, &len) < 0 || sockErr != 0) {
+    dialFinish(A_NOANSWER);
+    return;
+  }
+  dialer.tcpUs = micros() - dialer.stepStart;
+  metrics.tcpConnect.record(dialer.tcpUs);
+  if (dialer.secure) dialStartTls();
+  else dialConnected();
+}
+
+void hangUp() {
+  Session *ses = currentSession();
+  unsigned long since = ses ? ses->connectTime : 0;
+  if (ses) sessionClose(attached);
+  cmdMode = true;
+  updateLed();
+  sendResult(A_NOCARRIER, since);
+}
+
+bool answerCall() {
+  if (!listener.queued) return false;
+  int fd = listener.queue[0].fd;
+  listenerRemove(0);
+  
+  // WiFiClient ждет блокирующий сокет
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+  int id = sessionOpen(WiFiClient(fd), true);
+  if (id < 0) return false;
+  listener.answered++;
+  sRegs[S_RINGCOUNT] = 0;
+  updateLed();
+  
+  // Порт занят текущим звонком - новая сессия ждет в фоне (ATO<n>)
+  if (!cmdMode || dialing()) return true;
+  sessionAttach(id);
+  return true;
+}
+
+void handleIncomingCall() {
+  // Решение для listenerStep(): некому ответить или нет свободного
+  // слота - новым звонкам сразу "занято"
+  Session *ses = currentSession();
+  listener.canAnswer = sessionCount() < MAX_SESSIONS && !dialing() &&
+                       (cmdMode || sRegs[S_AUTOANSWER]);
+  listener.callSince = ses ? ses->connectTime : 0;
+  
+  // Положившие трубку уходят из очереди молча, заждавшиеся - с "занято"
+  for (int i = 0; i < listener.queued;) {
+    const PendingCall &call = listener.queue[i];
+    bool alive = warmAlive(call.fd);
+    bool waited = millis() - call.since > LISTEN_PENDING_MS;
+    if (alive && !waited && listener.canAnswer) {
+      i++;
+      continue;
+    }
+    if (!alive) {
+      close(call.fd);
+    } else {
+      if (waited) listener.expired++;
+      else listener.busy++;
+      listenerBusy(call.fd);
+    }
+    listenerRemove(i);
+  }
+  if (!listener.queued) return;
+
+  // Воспроизведение и выдача истории занимают терминал: звонок ждет в
+  // очереди без RING
+  if (replaying() || historyDumping()) return;
+  
+  // В режиме данных RING в поток не печатаем - сразу в фоновую сессию
+  if (!cmdMode) {
+    answerCall();
+    return;
+  }
+  
+  // Звоним
+  static unsigned long lastRing = 0;
+  if (millis() - lastRing > 3000) {
+    sendResult(A_RING);
+    lastRing = millis();
+    if (sRegs[S_RINGCOUNT] < 255) sRegs[S_RINGCOUNT]++;
+  }
+  if (sRegs[S_AUTOANSWER] && sRegs[S_RINGCOUNT] >= sRegs[S_AUTOANSWER]) {
+    sRegs[S_RINGCOUNT] = 0;
+    answerCall();
+  }
+}
+
+// Прием из сети для всех сессий и обработка обрывов
+void sessionsPoll() {
+  for (int i = 0; i < MAX_SESSIONS; i++) {
+    Session &ses = sessions[i];
+    if (!ses.active) continue;
+    sessionReceive(ses);
+    if (!ses.tx.empty()) flushNetTx(ses);
+    
+    if (ses.client.connected() || netAvailable(ses) > 0) continue;
+    if (i != attached) {
+      sessionClose(i);
+    } else if ((cmdMode || ses.rx.empty()) && serialOut.empty()) {
+      // Сначала допечатаем хвост: NO CARRIER идет мимо serialOut и
+      // обогнал бы прощальный экран BBS, который serialTask еще отдает
+      hangUp();
+    }
+  }
+}
+
+// === AT КОМАНДЫ ===
+// Строка разбирается на месте в cmdLine без выделения памяти.
+// Каждый обработчик получает указатель сразу за именем команды, сдвигает
+// его за свои аргументы и возвращает код результата. A_OK - продолжаем
+// цепочку, A_NONE - команда сама вывела результат, A_ERROR - прерываем.
+
+typedef ResultCode (*AtHandler)(const char *&p);
+
+struct AtCommand {
+  const char *name;
+  AtHandler handler;
+};
+
+static bool atDigit(const char *&p, int &value) {
+  if (*p < '0' || *p > '9') return false;
+  value = *p++ - '0';
+  return true;
+}
+
+static bool atNumber(const char *&p, long &value) {
+  if (*p < '0' || *p > '9') return false;
+  value = 0;
+  while (*p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+  return true;
+}
+
+// Флаг вида X, X0, X1, X?
+static ResultCode atFlag(const char *&p, bool &flag) {
+  if (*p == '?') {
+    p++;
+    Serial.println(flag ? "1" : "0");
+    return A_OK;
+  }
+  int v = 0;
+  atDigit(p, v);
+  if (v > 1) return A_ERROR;
+  flag = v;
+  return A_OK;
+}
+
+// Остаток строки - строковый аргумент (после '=')
+static const char *atRest(const char *&p) {
+  const char *arg = p;
+  p += strlen(p);
+  return arg;
+}
+
+static ResultCode atAnswer(const char *&p) {
+  return answerCall() ? A_NONE : A_ERROR;
+}
+
+static ResultCode atWiFi(const char *&p) {
+  int v = 0;
+  atDigit(p, v);
+  if (v == 0) disconnectWiFi();
+  else if (v != 1 || !connectWiFi()) return A_ERROR;
+  return A_OK;
+}
+
+static ResultCode atDial(const char *&p) {
+  char mode = toupper(*p);
+  if (mode != 'T' && mode != 'P' && mode != 'I' && mode != 'S') return A_ERROR;
+  p++;
+  const char *arg = atRest(p);
+  if (mode == 'S') {
+    while (*arg == ' ') arg++;
+    int num = *arg - '0';
+    if (num < 0 || num > 9 || speedDials[num][0] == '\0') return A_ERROR;
+    if (dialCounts[num] < UINT16_MAX) dialCounts[num]++;
+    dialOut(speedDials[num], num);
+  } else {
+    dialOut(arg);
+  }
+  return A_NONE;
+}
+
+static ResultCode atEcho(const char *&p) { return atFlag(p, echo); }
+
+static ResultCode atVerbose(const char *&p) { return atFlag(p, verboseResults); }
+
+static ResultCode atHangUp(const char *&p) {
+  int v = 0;
+  atDigit(p, v);
+  if (v != 0) return A_ERROR;
+  hangUp();
+  return A_NONE;
+}
+
+static ResultCode atHelp(const char *&p) {
+  showHelp();
+  return A_OK;
+}
+
+static ResultCode atHex(const char *&p) {
+  if (*p == '=') p++;
+  if (*p == '?') {
+    p++;
+    showTrace();
+    return A_OK;
+  }
+  int v = 0;
+  atDigit(p, v);
+  if (v > TRACE_WEB || !traceStart(v)) return A_ERROR;
+  return A_OK;
+}
+
+static ResultCode atInfo(const char *&p) {
+  int v;
+  atDigit(p, v);
+  showNetworkInfo();
+  return A_OK;
+}
+
+static ResultCode atTelnet(const char *&p) { return atFlag(p, telnet); }
+
+static ResultCode atOnline(const char *&p) {
+  int id = attached;
+  atDigit(p, id);
+  if (id < 0 || id >= MAX_SESSIONS || !sessions[id].active) return A_ERROR;
+  sessionAttach(id);
+  return A_NONE;
+}
+
+static ResultCode atPetscii(const char *&p) {
+  if (*p == '?') {
+    p++;
+    Serial.println(charset);
+    return A_OK;
+  }
+  int v = 0;
+  atDigit(p, v);
+  if (v >= CS_COUNT) return A_ERROR;
+  charset = v;
+  terminalCharset.reset();
+  return A_OK;
+}
+
+static ResultCode atPace(const char *&p) {
+  if (*p == '=') p++;
+  ResultCode r = atFlag(p, paceLine);
+  pacerConfigure();
+  return r;
+}
+
+static ResultCode atRegister(const char *&p) {
+  long reg, value;
+  if (!atNumber(p, reg) || reg >= SREG_COUNT) return A_ERROR;
+  if (*p == '?') {
+    p++;
+    Serial.printf("%03d\r\n", sRegs[reg]);
+    return A_OK;
+  }
+  if (*p++ != '=') return A_ERROR;
+  if (!atNumber(p, value) || value > 255) return A_ERROR;
+  sRegs[reg] = value;
+  return A_OK;
+}
+
+static ResultCode atReset(const char *&p) {
+  int v;
+  atDigit(p, v);
+  loadSettings();
+  return A_OK;
+}
+
+static ResultCode atFactory(const char *&p) {
+  int v;
+  atDigit(p, v);
+  factoryReset();
+  return A_OK;
+}
+
+static ResultCode atFlow(const char *&p) {
+  int v = 0;
+  atDigit(p, v);
+  if (v != 0 && v != 3 && v != 4) return A_ERROR;
+  flowControl = v;
+  return A_OK;
+}
+
+static ResultCode atView(const char *&p) {
+  showSettings();
+  return A_OK;
+}
+
+static ResultCode atWrite(const char *&p) {
+  int v;
+  atDigit(p, v);
+  saveSettings();
+  return A_OK;
+}
+
+static ResultCode atSpeedDial(const char *&p) {
+  int num;
+  if (!atDigit(p, num)) return A_ERROR;
+  if (*p == '?') {
+    p++;
+    Serial.println(speedDials[num]);
+    return A_OK;
+  }
+  if (*p++ != '=') return A_ERROR;
+  setText(speedDials[num], sizeof(speedDials[num]), atRest(p));
+  Serial.print("SPEED DIAL ");
+  Serial.print(num);
+  Serial.print(" SET: ");
+  Serial.println(speedDials[num]);
+  return A_OK;
+}
+
+static ResultCode atBusyMsg(const char *&p) {
+  if (*p == '?') {
+    p++;
+    Serial.println(busyMsg);
+    return A_OK;
+  }
+  if (*p++ != '=') return A_ERROR;
+  setText(busyMsg, sizeof(busyMsg), atRest(p));
+  Serial.print("BUSY MESSAGE SET: ");
+  Serial.println(busyMsg);
+  return A_OK;
+}
+
+static ResultCode atPassword(const char *&p) {
+  if (*p == '?') {
+    p++;
+    Serial.println("********");
+    return A_OK;
+  }
+  if (*p++ != '=') return A_ERROR;
+  setText(password, sizeof(password), atRest(p));
+  Serial.println("PASSWORD SET");
+  return A_OK;
+}
+
+static ResultCode atSessions(const char *&p) {
+  showSessions();
+  return A_OK;
+}
+
+static ResultCode atReboot(const char *&p) {
+  Serial.println("REBOOTING...");
+  delay(100);
+  ESP.restart();
+  return A_NONE;
+}
+
+static ResultCode atBaud(const char *&p) {
+  if (*p == '?') {
+    p++;
+    Serial.println(currentBaudRate);
+    return A_OK;
+  }
+  long newBaud;
+  if (*p++ != '=' || !atNumber(p, newBaud)) return A_ERROR;
+  for (long rate : baudRates) {
+    if (rate == newBaud) {
+      currentBaudRate = newBaud;
+      pacerConfigure(); // темп линии меняется сразу
+      Serial.print("BAUD RATE WILL CHANGE TO ");
+      Serial.print(newBaud);
+      Serial.println(" AFTER REBOOT");
+      Serial.println("USE AT$RB TO REBOOT");
+      return A_OK;
+    }
+  }
+  return A_ERROR;
+}
+
+static ResultCode atSsid(const char *&p) {
+  if (*p == '?') {
+    p++;
+    Serial.println(ssid);
+    return A_OK;
+  }
+  if (*p++ != '=') return A_ERROR;
+  setText(ssid, sizeof(ssid), atRest(p));
+  wifiMgr.haveFast = false;
+  Serial.print("SSID SET TO: ");
+  Serial.println(ssid);
+  return A_OK;
+}
+
+static ResultCode atWebTerminal(const char *&p) {
+  if (*p == '=') p++;
+  if (*p == '?') {
+    p++;
+    Serial.println(wsMode);
+    return A_OK;
+  }
+  int v = 0;
+  atDigit(p, v);
+  if (v > WS_INTERACTIVE) return A_ERROR;
+  wsMode = v;
+  return A_OK;
+}
+
+static ResultCode atCapture(const char *&p) {
+  if (*p == '=') p++;
+  if (*p == '?') {
+    p++;
+    showCapture();
+    return A_OK;
+  }
+  int v = 0;
+  atDigit(p, v);
+  if (v == 1) return captureStart() ? A_OK : A_ERROR;
+  if (v != 0) return A_ERROR;
+  captureStop();
+  return A_OK;
+}
+
+static ResultCode atHistory(const char *&p) {
+  long kb = 0;
+  if (*p == '=') {
+    p++;
+    if (!atNumber(p, kb) || kb > (long)(SCROLLBACK_SIZE / 1024)) return A_ERROR;
+  }
+  if (!historyStart(kb * 1024)) return A_ERROR;
+  return A_NONE; // OK печатает historyStop()
+}
+
+static ResultCode atMccp(const char *&p) {
+  if (*p == '=') p++;
+  return atFlag(p, mccpEnabled);
+}
+
+// Прогрев занимает узел BBS до WARM_IDLE_MS и повторяется примерно раз в
+// WARM_IDLE_MS + WARM_COOLDOWN_MS (3 минуты), поэтому по умолчанию выключен
+static ResultCode atWarm(const char *&p) {
+  if (*p == '=') p++;
+  if (*p == '?') {
+    p++;
+    showWarm();
+    return A_OK;
+  }
+  int v = 0;
+  atDigit(p, v);
+  if (v > WARM_MAX) return A_ERROR;
+  warmSize = v;
+  return A_OK;
+}
+
+static ResultCode atDnsTtl(const char *&p) {
+  if (*p == '?') {
+    p++;
+    Serial.println(dnsTtl);
+    return A_OK;
+  }
+  long v;
+  if (*p++ != '=' || !atNumber(p, v) || v > 65535) return A_ERROR;
+  dnsTtl = v;
+  return A_OK;
+}
+
+static ResultCode atPlay(const char *&p) {
+  long speed = 1, session = -1;
+  if (*p == '=') {
+    p++;
+    if (!atNumber(p, speed) || speed > 255) return A_ERROR;
+    if (*p == ',') {
+      p++;
+      if (!atNumber(p, session) || session >= MAX_SESSIONS) return A_ERROR;
+    }
+  }
+  if (!replayStart(speed, session)) return A_ERROR;
+  return A_NONE; // OK печатает replayStop()
+}
+
+// Таблица отсортирована по имени (ASCII), порядок проверяется при компиляции
+static constexpr AtCommand atCommands[] = {
+  {"$BM",   atBusyMsg},
+  {"$CAP",  atCapture},
+  {"$DNSTTL", atDnsTtl},
+  {"$HIST", atHistory},
+  {"$MCCP", atMccp},
+  {"$PACE", atPace},
+  {"$PASS", atPassword},
+  {"$PLAY", atPlay},
+  {"$RB",   atReboot},
+  {"$SB",   atBaud},
+  {"$SL",   atSessions},
+  {"$SSID", atSsid},
+  {"$WARM", atWarm},
+  {"$WS",   atWebTerminal},
+  {"&F",    atFactory},
+  {"&K",    atFlow},
+  {"&V",    atView},
+  {"&W",    atWrite},
+  {"&Z",    atSpeedDial},
+  {"?",     atHelp},
+  {"A",     atAnswer},
+  {"C",     atWiFi},
+  {"D",     atDial},
+  {"E",     atEcho},
+  {"H",     atHangUp},
+  {"HELP",  atHelp},
+  {"HEX",   atHex},
+  {"I",     atInfo},
+  {"NET",   atTelnet},
+  {"O",     atOnline},
+  {"PET",   atPetscii},
+  {"S",     atRegister},
+  {"V",     atVerbose},
+  {"Z",     atReset},
+};
+static constexpr size_t AT_COMMAND_COUNT = sizeof(atCommands) / sizeof(atCommands[0]);
+
+static constexpr bool atNameLess(const char *a, const char *b) {
+  return *a == *b ? (*a != 0 && atNameLess(a + 1, b + 1)) : (uint8_t)*a < (uint8_t)*b;
+}
+static constexpr bool atTableSorted(size_t i) {
+  return i + 1 >= AT_COMMAND_COUNT ||
+         (atNameLess(atCommands[i].name, atCommands[i + 1].name) && atTableSorted(i + 1));
+}
+static_assert(atTableSorted(0), "atCommands must be sorted by name");
+
+// Самое длинное имя из таблицы, с которого начинается p
+static const AtCommand *atLookup(const char *p) {
+  char first = toupper(*p);
+  size_t lo = 0, hi = AT_COMMAND_COUNT;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if ((uint8_t)atCommands[mid].name[0] < (uint8_t)first) lo = mid + 1;
+    else hi = mid;
+  }
+  const AtCommand *best = nullptr;
+  size_t bestLen = 0;
+  for (size_t i = lo; i < AT_COMMAND_COUNT && atCommands[i].name[0] == first; i++) {
+    const char *n = atCommands[i].name;
+    size_t len = 0;
+    while (n[len] && toupper(p[len]) == n[len]) len++;
+    if (n[len] == 0 && len > bestLen) {
+      best = &atCommands[i];
+      bestLen = len;
+    }
+  }
+  return best;
+}
+
+void processCommand() {
+  cmdLine[cmdLen] = 0;
+  char *line = cmdLine;
+  while (*line == ' ') line++;
+  size_t len = strlen(line);
+  while (len > 0 && line[len - 1] == ' ') line[--len] = 0;
+  cmdLen = 0;
+  if (len == 0) return;
+
+  Serial.println();
+
+  if (toupper(line[0]) != 'A' || toupper(line[1]) != 'T') {
+    sendResult(A_ERROR);
+    return;
+  }
+
+  ResultCode result = A_OK;
+  const char *p = line + 2;
+  while (*p) {
+    if (*p == ' ') {
+      p++;
+      continue;
+    }
+    const AtCommand *c = atLookup(p);
+    if (!c) {
+      sendResult(A_ERROR);
+      return;
+    }
+    p += strlen(c->name);
+    ResultCode r = c->handler(p);
+    if (r == A_ERROR) {
+      sendResult(A_ERROR);
+      return;
+    }
+    if (r != A_OK) result = r;
+  }
+  if (result == A_OK) sendResult(A_OK);
+}
+
+// === ВЕБ-ИНТЕРФЕЙС ===
+// Веб-сервер крутится в своей задаче с низким приоритетом. Под замком
+// только снимается копия состояния, ответ уходит кусками (chunked) из
+// небольшого буфера на стеке - страница целиком в памяти не собирается.
+
+class WebStream {
+public:
+  WebStream(const char *type) {
+    webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    webServer.send(200, type, "");
+  }
+  ~WebStream() {
+    flush();
+    webServer.sendContent(""); // пустой кусок завершает ответ
+  }
+
+  void print(const char *s) {
+    while (*s) {
+      if (len == sizeof(buf)) flush();
+      buf[len++] = *s++;
+    }
+  }
+
+  void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char line[128];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    print(line);
+  }
+
+  void write(const char *data, size_t n) {
+    while (n > 0) {
+      if (len == sizeof(buf)) flush();
+      size_t part = min(n, sizeof(buf) - len);
+      memcpy(buf + len, data, part);
+      len += part;
+      data += part;
+      n -= part;
+    }
+  }
+
+  // Текст пользователя внутри HTML
+  void printHtml(const char *s) {
+    for (; *s; s++) {
+      switch (*s) {
+        case '<': print("&lt;"); break;
+        case '>': print("&gt;"); break;
+        case '&': print("&amp;"); break;
+        case '"': print("&quot;"); break;
+        case '\'': print("&#39;"); break;
+        default: write(s, 1);
+      }
+    }
+  }
+
+  // Строка в кавычках для JSON
+  void printJson(const char *s) {
+    print("\"");
+    for (; *s; s++) {
+      char esc[8] = {*s, 0};
+      if (*s == '"' || *s == '\\') snprintf(esc, sizeof(esc), "\\%c", *s);
+      else if ((uint8_t)*s < 0x20) snprintf(esc, sizeof(esc), "\\u%04x", *s);
+      print(esc);
+    }
+    print("\"");
+  }
+
+private:
+  char buf[WEB_CHUNK];
+  size_t len = 0;
+
+  void flush() {
+    if (len) webServer.sendContent(buf, len);
+    len = 0;
+  }
+};
+
+// Копия состояния модема для одного ответа
+struct StatusSnapshot {
+  bool wifiUp;
+  char ip[IP_STR_SIZE];
+  int rssi;
+  unsigned long timeToIp;
+  uint32_t reconnects;
+  bool inCall;
+  char peer[IP_STR_SIZE];
+  uint16_t peerPort;
+  char duration[TIME_STR_SIZE];
+  uint32_t txBytes;
+  uint32_t rxBytes;
+  int sessions;
+  bool dialing;
+  bool cmdMode;
+  uint32_t freeHeap;
+  uint32_t minHeap;
+};
+
+void takeStatusSnapshot(StatusSnapshot &st) {
+  SessionLock lock;
+  st.wifiUp = WiFi.status() == WL_CONNECTED;
+  ipString(WiFi.localIP(), st.ip);
+  st.rssi = st.wifiUp ? WiFi.RSSI() : 0;
+  st.timeToIp = wifiMgr.lastTimeToIp;
+  st.reconnects = wifiMgr.reconnects;
+  Session *ses = currentSession();
+  st.inCall = ses != nullptr;
+  st.peer[0] = '\0';
+  st.peerPort = 0;
+  st.txBytes = st.rxBytes = 0;
+  setText(st.duration, sizeof(st.duration), "00:00:00");
+  if (ses) {
+    ipString(ses->client.remoteIP(), st.peer);
+    st.peerPort = ses->client.remotePort();
+    connectTimeString(ses->connectTime, st.duration);
+    st.txBytes = ses->stats.txBytes;
+    st.rxBytes = ses->stats.rxBytes;
+  }
+  st.sessions = sessionCount();
+  st.dialing = dialing();
+  st.cmdMode = cmdMode;
+  st.freeHeap = ESP.getFreeHeap();
+  st.minHeap = ESP.getMinFreeHeap();
+}
+
+static const char webPageHead[] =
+  "<html><head><title>ESP32 WiFi Modem</title></head><body>"
+  "<h1>ESP32-S3 WiFi Modem</h1>"
+  "<p>Firmware: " FIRMWARE_VERSION "</p>"
+  "<p>Build: " BUILD_DATE "</p>"
+  "<hr><h2>WiFi Status</h2>";
+
+static const char webPageTail[] =
+  "<hr><p><a href='/reboot'>Reboot Modem</a></p>"
+  "</body></html>";
+
+void handleWebRoot() {
+  StatusSnapshot st;
+  takeStatusSnapshot(st);
+
+  WebStream out("text/html");
+  out.print(webPageHead);
+  if (st.wifiUp) {
+    out.print("<p>Connected to: ");
+    out.printHtml(ssid);
+    out.printf("</p><p>IP Address: %s</p><p>Signal: %d dBm</p>", st.ip, st.rssi);
+  } else {
+    out.print("<p>Not connected</p>");
+  }
+
+  out.print("<h2>Call Status</h2>");
+  if (st.inCall) {
+    out.printf("<p>Connected to: %s</p><p>Duration: %s</p>", st.peer, st.duration);
+    out.print("<p><a href='/term'>Terminal</a> | <a href='/ath'>Hang Up</a></p>");
+  } else {
+    out.print("<p>Not in a call</p>");
   }
-  callConnected = false;
-  connectTime = 0;
-  updateLed();
-  sendResult(A_NOCARRIER);
+  out.print(webPageTail);
 }
 
-void answerCall() {
-  if (!tcpServer.hasClient()) return;
-  
-  tcpClient = tcpServer.available();
-  tcpClient.setNoDelay(true);
-  
-  callConnected = true;
-  connectTime = millis();
-  cmdMode = false;
-  updateLed();
-  sendResult(A_CONNECT);
-  Serial.flush();
+void handleWebStatus() {
+  StatusSnapshot st;
+  takeStatusSnapshot(st);
+
+  WebStream out("application/json");
+  out.printf("{\"wifi\":{\"connected\":%s,\"ssid\":", st.wifiUp ? "true" : "false");
+  out.printJson(ssid);
+  out.printf(",\"ip\":\"%s\",\"rssi\":%d,\"timeToIpMs\":%lu,\"reconnects\":%lu},",
+             st.ip, st.rssi, st.timeToIp, (unsigned long)st.reconnects);
+  out.printf("\"call\":{\"active\":%s,\"peer\":\"%s\",\"port\":%u,\"duration\":\"%s\","
+             "\"txBytes\":%lu,\"rxBytes\":%lu},",
+             st.inCall ? "true" : "false", st.peer, st.peerPort, st.duration,
+             (unsigned long)st.txBytes, (unsigned long)st.rxBytes);
+  out.printf("\"sessions\":%d,\"maxSessions\":%d,\"dialing\":%s,\"commandMode\":%s,",
+             st.sessions, MAX_SESSIONS, st.dialing ? "true" : "false", st.cmdMode ? "true" : "false");
+  out.printf("\"settings\":{\"baud\":%d,\"echo\":%s,\"verbose\":%s,\"telnet\":%s,\"charset\":\"%s\","
+             "\"pace\":%s,\"flow\":%u,\"autoAnswer\":%u},",
+             currentBaudRate, echo ? "true" : "false", verboseResults ? "true" : "false",
+             telnet ? "true" : "false", charsetNames[charset], paceLine ? "true" : "false",
+             flowControl, sRegs[S_AUTOANSWER]);
+  out.printf("\"heap\":{\"free\":%lu,\"min\":%lu}}",
+             (unsigned long)st.freeHeap, (unsigned long)st.minHeap);
 }
 
-void handleIncomingCall() {
-  if (!tcpServer.hasClient()) return;
-  
-  if (callConnected) {
-    // Уже в разговоре - сообщаем "занято"
-    WiFiClient busyClient = tcpServer.available();
-    busyClient.println(busyMsg);
-    busyClient.println("CURRENT CALL: " + connectTimeString());
-    busyClient.stop();
-    return;
+// Prometheus-совместимый текстовый формат
+void printHistogram(WebStream &out, const char *name, const LatencyHistogram &h) {
+  uint64_t cumulative = 0;
+  out.printf("# TYPE %s histogram\n", name);
+  for (int b = 0; b < LatencyHistogram::BUCKETS; b++) {
+    if (h.buckets[b] == 0) continue;
+    cumulative += h.buckets[b];
+    out.printf("%s_bucket{le=\"%lu\"} %llu\n", name,
+               (unsigned long)LatencyHistogram::bucketLimit(b), (unsigned long long)cumulative);
   }
-  
-  if (autoAnswer) {
-    answerCall();
-  } else {
-    // Звоним
-    static unsigned long lastRing = 0;
-    if (millis() - lastRing > 3000) {
-      sendResult(A_RING);
-      lastRing = millis();
+  out.printf("%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)h.count);
+  out.printf("%s_sum %llu\n%s_count %lu\n", name, (unsigned long long)h.sum, name, (unsigned long)h.count);
+}
+
+void handleWebMetrics() {
+  Metrics m;
+  Listener calls;
+  PumpStats stats[MAX_SESSIONS];
+  bool active[MAX_SESSIONS];
+  {
+    SessionLock lock;
+    m = metrics;
+    calls = listener;
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+      active[i] = sessions[i].active;
+      stats[i] = sessions[i].stats;
     }
   }
-}
 
-void dialOut(String upCmd) {
-  // Can't place a call while in a call
-  if (callConnected) {
-    sendResult(A_ERROR);
-    return;
+  WebStream out("text/plain; version=0.0.4");
+  printHistogram(out, "modem_net_loop_us", m.netLoop);
+  printHistogram(out, "modem_main_loop_us", m.mainLoop);
+  printHistogram(out, "modem_dial_us", m.dial);
+  printHistogram(out, "modem_tcp_connect_us", m.tcpConnect);
+  printHistogram(out, "modem_tls_full_handshake_us", m.tlsFull);
+  printHistogram(out, "modem_tls_cached_handshake_us", m.tlsCached);
+  printHistogram(out, "modem_net_stall_us", m.netStall);
+  printHistogram(out, "modem_serial_stall_us", m.serialStall);
+  printHistogram(out, "modem_pace_jitter_us", m.paceJitter);
+  out.printf("modem_usb_stalls_total %lu\n", (unsigned long)m.usbStalls);
+  out.printf("modem_listener_calls_total %lu\nmodem_listener_answered_total %lu\n",
+             (unsigned long)calls.accepted, (unsigned long)calls.answered);
+  const char *const reasons[] = {"busy", "queue_full", "expired", "rate_limited", "throttled"};
+  const uint32_t rejected[] = {calls.busy, calls.queueFull, calls.expired, calls.rateLimited, calls.throttled};
+  for (int i = 0; i < 5; i++) {
+    out.printf("modem_listener_rejected_total{reason=\"%s\"} %lu\n", reasons[i], (unsigned long)rejected[i]);
   }
-  String host, port;
-  int portIndex;
-  // Dialing a stored number
-  if (upCmd.indexOf("ATDS") == 0) {
-    byte speedNum = upCmd.substring(4, 5).toInt();
-    portIndex = speedDials[speedNum].indexOf(':');
-    if (portIndex != -1) {
-      host = speedDials[speedNum].substring(0, portIndex);
-      port = speedDials[speedNum].substring(portIndex + 1);
-    } else {
-      port = "23";
-    }
-  } else {
-    // Dialing an ad-hoc number
-    int portIndex = cmd.indexOf(":");
-    if (portIndex != -1)
-    {
-      host = cmd.substring(4, portIndex);
-      port = cmd.substring(portIndex + 1, cmd.length());
-    }
-    else
-    {
-      host = cmd.substring(4, cmd.length());
-      port = "23"; // Telnet default
-    }
-  }
-  host.trim(); // remove leading or trailing spaces
-  port.trim();
-  Serial.print("DIALING "); Serial.print(host); Serial.print(":"); Serial.println(port);
-  char *hostChr = new char[host.length() + 1];
-  host.toCharArray(hostChr, host.length() + 1);
-  int portInt = port.toInt();
-  tcpClient.setNoDelay(true); // Try to disable naggle
-  if (tcpClient.connect(hostChr, portInt))
-  {
-    tcpClient.setNoDelay(true); // Try to disable naggle
-    sendResult(A_CONNECT);
-    connectTime = millis();
-    cmdMode = false;
-    Serial.flush();
-    callConnected = true;
-   // setCarrier(callConnected);
-    //if (tcpServerPort > 0) tcpServer.stop();
-  }
-  else
-  {
-    sendResult(A_NOANSWER);
-    callConnected = false;
-   // setCarrier(callConnected);
+  for (int i = 0; i < MAX_SESSIONS; i++) {
+    if (!active[i]) continue;
+    const PumpStats &st = stats[i];
+    out.printf("modem_session_tx_bytes{session=\"%d\"} %lu\nmodem_session_rx_bytes{session=\"%d\"} %lu\n",
+               i, (unsigned long)st.txBytes, i, (unsigned long)st.rxBytes);
+    out.printf("modem_session_short_writes{session=\"%d\"} %lu\nmodem_session_serial_stalls{session=\"%d\"} %lu\n",
+               i, (unsigned long)st.shortWrites, i, (unsigned long)st.serialStalls);
   }
-  delete hostChr;
 }
 
-void processCommand() {
-  cmd.trim();
-  if (cmd.length() == 0) return;
-  
-  String upCmd = cmd;
-  upCmd.toUpperCase();
-  Serial.println();
-  
-  // === БАЗОВЫЕ КОМАНДЫ ===
-  if (upCmd == "AT") sendResult(A_OK);
+// Последний текст трассировки ATHEX
+void handleWebTrace() {
+  static char copy[TRACE_TAIL_SIZE];
+  xSemaphoreTake(trace.tailLock, portMAX_DELAY);
+  size_t n = min(trace.tailPos, (uint32_t)TRACE_TAIL_SIZE);
+  size_t ofs = (trace.tailPos - n) & (TRACE_TAIL_SIZE - 1);
+  size_t first = min(n, TRACE_TAIL_SIZE - ofs);
+  memcpy(copy, trace.tail + ofs, first);
+  memcpy(copy + first, trace.tail, n - first);
+  xSemaphoreGive(trace.tailLock);
 
-  // === DIAL ===
-  else if ((upCmd.indexOf("ATDT") == 0) || (upCmd.indexOf("ATDP") == 0) || (upCmd.indexOf("ATDI") == 0) || (upCmd.indexOf("ATDS") == 0))
+  WebStream out("text/plain");
+  out.write(copy, n);
+}
+
+void handleWebHangup() {
   {
-    dialOut(upCmd);
-  }
-  
-  // === HANG UP ===
-  else if (upCmd == "ATH") {
+    SessionLock lock;
     hangUp();
   }
-  // === TELNET ===
-  else if (upCmd == "ATNET0") {
-    telnet = false;
-    sendResult(A_OK);
-  }
-  else if (upCmd == "ATNET1") {
-    telnet = true;
-    sendResult(A_OK);
-  }
-  else if (upCmd == "ATNET?") {
-    Serial.println(telnet ? "1" : "0");
-    sendResult(A_OK);
+  webServer.send(200, "text/plain", "Call disconnected");
+}
+
+void handleWebReboot() {
+  webServer.send(200, "text/plain", "Rebooting...");
+  delay(100);
+  ESP.restart();
+}
+
+// === ВЕБ-ТЕРМИНАЛ (WebSocket) ===
+// Браузер подключается к ws://модем:81/ и видит то же, что терминал на USB.
+// netTask только дописывает поток в общий wsFeed (без ожидания; не влезло -
+// считаем потерю). webTask собирает из него один кадр и рассылает всем
+// зрителям одни и те же байты - копия потока на каждого не делается.
+
+struct WsViewer {
+  bool active;
+  WiFiClient client;
+  size_t sent;               // сколько байт общего кадра уже ушло
+  unsigned long stallStart;  // с какого момента зритель не принимает кадр
+  uint8_t in[WS_IN_MAX];     // входящие кадры от браузера
+  size_t inLen;
+};
+WsViewer wsViewers[WS_MAX_VIEWERS];
+WiFiServer wsServer(WS_PORT);
+CharsetTranslator wsCharset;  // ввод из браузера перекодируется как с терминала
+
+// Общий кадр: заголовок + данные, отправляется всем зрителям
+uint8_t wsFrame[4 + WS_FRAME_MAX];
+size_t wsFrameLen = 0;
+unsigned long wsPendingSince = 0;       // когда в wsFeed появились данные
+
+static const char wsGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+void wsClose(WsViewer &v) {
+  v.client.stop();
+  v.active = false;
+  wsViewerCount--;
+}
+
+// Рукопожатие RFC 6455: ждем заголовки не дольше WS_HANDSHAKE_MS
+bool wsHandshake(WiFiClient &client) {
+  char req[512];
+  size_t len = 0;
+  unsigned long start = millis();
+  while (millis() - start < WS_HANDSHAKE_MS) {
+    int avail = client.available();
+    if (avail > 0) {
+      int got = client.read((uint8_t *)req + len, min((size_t)avail, sizeof(req) - 1 - len));
+      if (got > 0) len += got;
+      req[len] = '\0';
+      if (strstr(req, "\r\n\r\n")) break;
+      if (len == sizeof(req) - 1) return false;
+    } else if (!client.connected()) {
+      return false;
+    }
+    vTaskDelay(1);
   }
-  // === ANSWER CALL ===
-  else if (upCmd == "ATA") {
-    answerCall();
+  req[len] = '\0';
+
+  const char *key = strcasestr(req, "Sec-WebSocket-Key:");
+  if (!key) return false;
+  key += 18;
+  while (*key == ' ') key++;
+  size_t keyLen = strcspn(key, "\r\n");
+  if (keyLen == 0 || keyLen > 32) return false;
+
+  char concat[32 + sizeof(wsGuid)];
+  memcpy(concat, key, keyLen);
+  memcpy(concat + keyLen, wsGuid, sizeof(wsGuid));
+  uint8_t digest[20];
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+  mbedtls_sha1((const uint8_t *)concat, keyLen + sizeof(wsGuid) - 1, digest);
+#else
+  mbedtls_sha1_ret((const uint8_t *)concat, keyLen + sizeof(wsGuid) - 1, digest);
+#endif
+  char accept[32];
+  size_t acceptLen;
+  if (mbedtls_base64_encode((uint8_t *)accept, sizeof(accept) - 1, &acceptLen, digest, sizeof(digest)) != 0) return false;
+  accept[acceptLen] = '\0';
+
+  char resp[160];
+  int n = snprintf(resp, sizeof(resp),
+                   "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                   "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+  return client.write((const uint8_t *)resp, n) == (size_t)n;
+}
+
+void wsAccept() {
+  if (!wsServer.hasClient()) return;
+  WiFiClient client = wsServer.available();
+  int slot = -1;
+  for (int i = 0; i < WS_MAX_VIEWERS; i++) {
+    if (!wsViewers[i].active) {
+      slot = i;
+      break;
+    }
   }
-  // === HELP ===
-  else if (upCmd == "AT?" || upCmd == "ATHELP") {
-    showHelp();
-    sendResult(A_OK);
-  }   
-  // === RELOAD SETTINGS ===
-  else if (upCmd == "ATZ") {
-    loadSettings();
-    sendResult(A_OK);
+  if (wsMode == WS_OFF || slot < 0 || !wsHandshake(client)) {
+    client.stop();
+    return;
   }
-  // === WIFI CONTROL ===
-  else if (upCmd == "ATC0") {
-    disconnectWiFi();
-  }  
-  else if (upCmd == "ATC1") {
-    connectWiFi();
+  client.setNoDelay(true);
+  WsViewer &v = wsViewers[slot];
+  v.client = client;
+  // Новый зритель подключается к следующему кадру
+  v.sent = wsFrameLen;
+  v.stallStart = 0;
+  v.inLen = 0;
+  v.active = true;
+  wsViewerCount++;
+}
+
+// Ввод из браузера - в текущую сессию, как с терминала
+void wsInject(const uint8_t *data, size_t n) {
+  if (wsMode != WS_INTERACTIVE) return;
+  SessionLock lock;
+  Session *ses = currentSession();
+  if (cmdMode || !ses) return;
+  uint8_t xlat[WS_IN_MAX];
+  n = min(n, sizeof(xlat));
+  n = wsCharset.fromTerminal((Charset)charset, data, n, xlat);
+  for (size_t i = 0; i < n && ses->tx.space() >= 2; i++) {
+    if (ses->telnet && xlat[i] == 0xFF) ses->tx.put(0xFF);
+    ses->tx.put(xlat[i]);
   }
-  /**** Control local echo in command mode ****/
-  else if (upCmd.indexOf("ATE") == 0) {
-    if (upCmd.substring(3, 4) == "?") {
-      sendString(String(echo));
-      sendResult(A_OK);
-    }
-    else if (upCmd.substring(3, 4) == "0") {
-      echo = 0;
-      sendResult(A_OK);
-    }
-    else if (upCmd.substring(3, 4) == "1") {
-      echo = 1;
-      sendResult(A_OK);
-    }
-    else {
-      sendResult(A_ERROR);
-    }
+  if (netTaskHandle) xTaskNotifyGive(netTaskHandle);
+}
+
+// Кадры от браузера (всегда с маской). Неполный кадр ждет следующего чтения.
+void wsReceive(WsViewer &v) {
+  int avail = v.client.available();
+  if (avail > 0 && v.inLen < sizeof(v.in)) {
+    int got = v.client.read(v.in + v.inLen, min((size_t)avail, sizeof(v.in) - v.inLen));
+    if (got > 0) v.inLen += got;
   }
-  /**** Control verbosity ****/
-  else if (upCmd.indexOf("ATV") == 0) {
-    if (upCmd.substring(3, 4) == "?") {
-      sendString(String(verboseResults));
-      sendResult(A_OK);
+  while (v.inLen >= 6) {
+    uint8_t opcode = v.in[0] & 0x0F;
+    size_t len = v.in[1] & 0x7F;
+    size_t hdr = 6;
+    if (len == 126) {
+      len = (v.in[2] << 8) | v.in[3];
+      hdr = 8;
+    } else if (len == 127 || !(v.in[1] & 0x80)) {
+      wsClose(v); // огромный кадр или без маски - не по протоколу
+      return;
     }
-    else if (upCmd.substring(3, 4) == "0") {
-      verboseResults = 0;
-      sendResult(A_OK);
+    if (hdr + len > sizeof(v.in)) {
+      wsClose(v);
+      return;
     }
-    else if (upCmd.substring(3, 4) == "1") {
-      verboseResults = 1;
-      sendResult(A_OK);
+    if (v.inLen < hdr + len) break;
+
+    uint8_t *mask = v.in + hdr - 4;
+    uint8_t *payload = v.in + hdr;
+    for (size_t i = 0; i < len; i++) payload[i] ^= mask[i & 3];
+
+    if (opcode == 0x8) {
+      wsClose(v);
+      return;
     }
-    else {
-      sendResult(A_ERROR);
+    if (opcode == 0x1 || opcode == 0x2) {
+      wsInject(payload, len);
+    } else if (opcode == 0x9 && len <= 125) {
+      uint8_t pong[2 + 125] = {0x8A, (uint8_t)len};
+      memcpy(pong + 2, payload, len);
+      v.client.write(pong, 2 + len);
     }
+    memmove(v.in, v.in + hdr + len, v.inLen - hdr - len);
+    v.inLen -= hdr + len;
   }
- // === SET BAUD ===
-  else if (upCmd.indexOf("AT$SB=") == 0) {
-    long newBaud = cmd.substring(6).toInt();
-    bool found = false;
-    
-    for (long rate : baudRates) {
-      if (rate == newBaud) {
-        found = true;
-        break;
-      }
-    }
-    
-    if (found) {
-      currentBaudRate = newBaud;
-      Serial.print("BAUD RATE WILL CHANGE TO ");
-      Serial.print(newBaud);
-      Serial.println(" AFTER REBOOT");
-      Serial.println("USE AT$RB TO REBOOT");
-      sendResult(A_OK);
-    } else {
-      sendResult(A_ERROR);
-    }
+  if (!v.client.connected()) wsClose(v);
+}
+
+// Собрать следующий кадр из wsFeed. Интервал сборки подстраивается:
+// полные кадры (поток) - собираем реже и крупнее, мелкие (эхо набора) - чаще.
+bool wsBuildFrame() {
+  size_t avail = wsFeed.used();
+  if (avail == 0) {
+    wsPendingSince = 0;
+    return false;
   }
-  else if (upCmd == "AT$SB?") {
-    Serial.println(currentBaudRate);
-    sendResult(A_OK);
+  if (!wsPendingSince) wsPendingSince = millis() | 1;
+  if (avail < WS_FRAME_MAX && millis() - wsPendingSince < wsFlushMs) return false;
+
+  size_t payload = 0;
+  uint8_t *dst = wsFrame + 4;
+  while (payload < WS_FRAME_MAX) {
+    size_t len;
+    const uint8_t *p = wsFeed.readPtr(len);
+    if (len == 0) break;
+    len = min(len, (size_t)WS_FRAME_MAX - payload);
+    memcpy(dst + payload, p, len);
+    wsFeed.consume(len);
+    payload += len;
   }
-  /**** Display busy message ****/
-  else if (upCmd.indexOf("AT$BM?") == 0) {
-    sendString(busyMsg);
-    sendResult(A_OK);
+
+  // Заголовок прижимаем к данным: 2 байта до 125, иначе 4
+  size_t hdr = payload < 126 ? 2 : 4;
+  uint8_t *frame = dst - hdr;
+  frame[0] = 0x82; // FIN + двоичный кадр
+  if (hdr == 2) {
+    frame[1] = payload;
+  } else {
+    frame[1] = 126;
+    frame[2] = payload >> 8;
+    frame[3] = payload & 0xFF;
   }
-  // === NETWORK INFO ===
-  else if (upCmd == "ATI") {
-    showNetworkInfo();
-    sendResult(A_OK);
-  }  
-  // === VIEW SETTINGS ===
-  else if (upCmd == "AT&V") {
-    showSettings();
-    sendResult(A_OK);
+  if (frame != wsFrame) memmove(wsFrame, frame, hdr + payload);
+  wsFrameLen = hdr + payload;
+
+  if (payload >= WS_FRAME_MAX / 2) wsFlushMs = min(wsFlushMs * 2, (unsigned long)WS_FLUSH_MAX);
+  else wsFlushMs = max(wsFlushMs / 2, (unsigned long)WS_FLUSH_MIN);
+  wsPendingSince = wsFeed.empty() ? 0 : millis() | 1;
+  wsFrames++;
+  wsBytes += payload;
+  for (int i = 0; i < WS_MAX_VIEWERS; i++) wsViewers[i].sent = 0;
+  return true;
+}
+
+// Дослать общий кадр всем; кадр освобождается, когда его получили все
+void wsStep() {
+  wsAccept();
+  for (int i = 0; i < WS_MAX_VIEWERS; i++) {
+    WsViewer &v = wsViewers[i];
+    if (!v.active) continue;
+    if (wsMode == WS_OFF) wsClose(v); // AT$WS=0 отключает и текущих зрителей
+    else wsReceive(v);
   }
-  // === SAVE SETTINGS ===
-  else if (upCmd == "AT&W") {
-    saveSettings();
-    sendResult(A_OK);
-  }  
-  // === FACTORY RESET ===
-  else if (upCmd == "AT&F") {
-    factoryReset();
-    sendResult(A_OK);
+  if (wsViewerCount <= 0) {
+    wsFeed.discard();
+    wsFrameLen = 0;
+    return;
   }
- else if (upCmd.indexOf("AT&Z") == 0) {
-    if (upCmd.length() >= 5 && upCmd.charAt(4) == '=') {
-      int num = upCmd.charAt(3) - '0';
-      if (num >= 0 && num <= 9) {
-        speedDials[num] = cmd.substring(5);
-        Serial.print("SPEED DIAL ");
-        Serial.print(num);
-        Serial.print(" SET: ");
-        Serial.println(speedDials[num]);
-        sendResult(A_OK);
-      } else {
-        sendResult(A_ERROR);
-      }
-    } else if (upCmd.length() == 5 && upCmd.charAt(4) == '?') {
-      int num = upCmd.charAt(3) - '0';
-      if (num >= 0 && num <= 9) {
-        Serial.println(speedDials[num]);
-        sendResult(A_OK);
-      } else {
-        sendResult(A_ERROR);
+
+  if (wsFrameLen == 0 && !wsBuildFrame()) return;
+
+  bool pending = false;
+  for (int i = 0; i < WS_MAX_VIEWERS; i++) {
+    WsViewer &v = wsViewers[i];
+    if (!v.active || v.sent >= wsFrameLen) continue;
+    int res = send(v.client.fd(), wsFrame + v.sent, wsFrameLen - v.sent, MSG_DONTWAIT);
+    if (res > 0) {
+      v.sent += res;
+      v.stallStart = 0;
+    }
+    if (v.sent < wsFrameLen) {
+      // Медленный зритель держит кадр для всех - ограничиваем ожидание
+      if (!v.stallStart) v.stallStart = millis() | 1;
+      if (millis() - v.stallStart > WS_STALL_MS) {
+        wsClose(v);
+        continue;
       }
-    } else {
-      sendResult(A_ERROR);
+      pending = true;
     }
   }
-    
-  // === SET SSID ===
-  else if (upCmd.indexOf("AT$SSID=") == 0) {
-    ssid = cmd.substring(8);
-    Serial.print("SSID SET TO: ");
-    Serial.println(ssid);
-    sendResult(A_OK);
-  }
-  else if (upCmd == "AT$SSID?") {
-    Serial.println(ssid);
-    sendResult(A_OK);
-  }
-  
-  // === SET PASSWORD ===
-  else if (upCmd.indexOf("AT$PASS=") == 0) {
-    password = cmd.substring(8);
-    Serial.println("PASSWORD SET");
-    sendResult(A_OK);
-  }
-  else if (upCmd == "AT$PASS?") {
-    Serial.println("********");
-    sendResult(A_OK);
-  }
-  // === AUTO ANSWER ===
-  else if (upCmd == "ATS0=0") {
-    autoAnswer = false;
-    sendResult(A_OK);
-  }
-  else if (upCmd == "ATS0=1") {
-    autoAnswer = true;
-    sendResult(A_OK);
-  }
-  else if (upCmd == "ATS0?") {
-    Serial.println(autoAnswer ? "1" : "0");
-    sendResult(A_OK);
-  }
-  // === PETSCII ===
-  else if (upCmd == "ATPET0") {
-    petTranslate = false;
-    sendResult(A_OK);
-  }
-  else if (upCmd == "ATPET1") {
-    petTranslate = true;
-    sendResult(A_OK);
-  }
-  else if (upCmd == "ATPET?") {
-    Serial.println(petTranslate ? "1" : "0");
-    sendResult(A_OK);
-  }
-  else if (upCmd == "ATHEX=1") {
-  //  hex = true;
-    sendResult(A_OK);
-  }
+  if (!pending) wsFrameLen = 0;
+}
 
-  /**** Set HEX Translate Off ****/
-  else if (upCmd == "ATHEX=0") {
- //   hex = false;
-    sendResult(A_OK);
-  }  
-  // === GO ONLINE ===
-  else if (upCmd == "ATO") {
-    if (callConnected) {
-      cmdMode = false;
-      sendResult(A_CONNECT);
-    } else {
-      sendResult(A_ERROR);
-    }
-  }
-  // === SET BUSY MESSAGE ===
-  else if (upCmd.indexOf("AT$BM?") == 0) {
-    busyMsg = cmd.substring(47);
-    Serial.print("BUSY MESSAGE SET: ");
-    Serial.println(busyMsg);
-    sendResult(A_OK);
-  }
+// Браузер получает те же байты, что терминал, поэтому декодер страницы
+// следует ATPET: CP437 > UTF-8 (и без перекодировки - как у современных
+// BBS) - TextDecoder('utf-8'), PETSCII и ATASCII - таблица из прошивки.
+// Сменили ATPET - обновить страницу.
+static const char webTermHead[] =
+  "<html><head><title>ESP32 WiFi Modem Terminal</title></head>"
+  "<body style='background:#000;color:#ccc'>"
+  "<pre id='t' style='white-space:pre-wrap'></pre>"
+  "<script>";
 
-  // === REBOOT ===
-  else if (upCmd == "AT$RB") {
-    Serial.println("REBOOTING...");
-    delay(100);
-    ESP.restart();
+static const char webTermTableDecoder[] =
+  "var d={decode:function(b){b=new Uint8Array(b);var s='';"
+  "for(var i=0;i<b.length;i++)s+=String.fromCharCode(m[b[i]]);return s;}};";
+
+static const char webTermBody[] =
+  "var t=document.getElementById('t'),"
+  "w=new WebSocket('ws://'+location.hostname+':81/');"
+  "w.binaryType='arraybuffer';"
+  "w.onmessage=function(e){"
+  "t.textContent+=d.decode(e.data,{stream:true}).replace(/\\x1b\\[[0-9;?]*[A-Za-z]/g,'').replace(/\\r/g,'');"
+  "if(t.textContent.length>65536)t.textContent=t.textContent.slice(-32768);"
+  "window.scrollTo(0,document.body.scrollHeight);};"
+  "document.onkeypress=function(e){w.send(e.key=='Enter'?'\\r':e.key);e.preventDefault();};"
+  "document.onkeydown=function(e){if(e.key=='Backspace'){w.send('\\b');e.preventDefault();}};"
+  "</script></body></html>";
+
+void handleWebTerminal() {
+  WebStream out("text/html");
+  out.print(webTermHead);
+  const uint16_t *table = charset == CS_PETSCII ? csPetsciiIn : charset == CS_ATASCII ? csAtasciiIn : nullptr;
+  if (table) {
+    out.print("var m=[");
+    for (int i = 0; i < 256; i++) out.printf(i ? ",%u" : "%u", table[i]);
+    out.print("];");
+    out.print(webTermTableDecoder);
+  } else {
+    out.print("var d=new TextDecoder('utf-8');");
   }
-  
+  out.print(webTermBody);
+}
 
-  // === UNKNOWN COMMAND ===
-  else {
-    sendResult(A_ERROR);
+
+// === ЗАДАЧИ ===
+
+// Ядро 0 (рядом со стеком WiFi): прием всех сессий и насос текущей
+void netTask(void *arg) {
+  for (;;) {
+    unsigned long started = micros();
+    {
+      SessionLock lock;
+      sessionsPoll();
+      captureStep();
+      Session *ses = currentSession();
+      if (!cmdMode && ses) {
+        // Данные от компьютера -> в сеть
+        pumpSerialToNet(*ses);
+
+        // Данные из сети -> в компьютер
+        pumpRxToSerial(*ses);
+        transferCheck(*ses);
+
+        // +++ таймаут (S12, по умолчанию 1 секунда)
+        if (plusCount >= 3 && millis() - plusTime > sRegs[S_GUARD] * 20UL) {
+          plusCount = 0;
+          cmdMode = true;
+          escapeDone = true;
+        }
+      } else if (ses) {
+        // Командный режим: сервер продолжает слать, копим до ATO
+        scrollbackAbsorb(*ses);
+      }
+    }
+    metrics.netLoop.record(micros() - started);
+    // Будит serialTask при новых данных, сеть опрашиваем раз в тик
+    ulTaskNotifyTake(pdTRUE, 1);
   }
-  
-  cmd = "";
 }
 
-void handleWebRoot() {
-  String page = "<html><head><title>ESP32 WiFi Modem</title></head><body>";
-  page += "<h1>ESP32-S3 WiFi Modem</h1>";
-  page += "<p>Firmware: " + String(FIRMWARE_VERSION) + "</p>";
-  page += "<p>Build: " + String(BUILD_DATE) + "</p>";
-  page += "<hr>";
-  
-  page += "<h2>WiFi Status</h2>";
-  if (WiFi.status() == WL_CONNECTED) {
-    page += "<p>Connected to: " + String(WiFi.SSID()) + "</p>";
-    page += "<p>IP Address: " + WiFi.localIP().toString() + "</p>";
-    page += "<p>Signal: " + String(WiFi.RSSI()) + " dBm</p>";
-  } else {
-    page += "<p>Not connected</p>";
+// XON/XOFF от терминала действуют сразу и в поток не попадают
+size_t filterXonXoff(uint8_t *p, size_t n) {
+  size_t out = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (p[i] == XOFF) dteStopped = true;
+    else if (p[i] == XON) dteStopped = false;
+    else p[out++] = p[i];
   }
-  
-  page += "<h2>Call Status</h2>";
-  if (callConnected) {
-    page += "<p>Connected to: " + tcpClient.remoteIP().toString() + "</p>";
-    page += "<p>Duration: " + connectTimeString() + "</p>";
-    page += "<p><a href='/ath'>Hang Up</a></p>";
-  } else {
-    page += "<p>Not in a call</p>";
+  return out;
+}
+
+// Ядро 1: только USB, без разбора данных
+// При AT&K3 (и AT&K0) поток останавливает сам USB: пока serialIn полон,
+// мы не читаем конечную точку и хост ждет. AT&K4 добавляет XON/XOFF
+// для терминалов, которые иначе не умеют ждать.
+void serialTask(void *arg) {
+  for (;;) {
+    bool moved = false;
+    bool xonxoff = flowControl == 4;
+
+    int avail = Serial.available();
+    if (avail > 0) {
+      size_t len;
+      uint8_t *p = serialIn.writePtr(len);
+      if (len > (size_t)avail) len = avail;
+      size_t got = len ? Serial.read(p, len) : 0;
+      if (got > 0 && xonxoff) got = filterXonXoff(p, got);
+      if (got > 0) {
+        serialIn.commit(got);
+        moved = true;
+        if (!cmdMode) xTaskNotifyGive(netTaskHandle);
+      }
+    }
+
+    if (!xonxoff) {
+      dteStopped = false;
+      xoffSent = false;
+    } else if (!xoffSent && serialIn.used() >= SERIAL_IN_HIGH_WATER) {
+      Serial.write(XOFF);
+      xoffSent = true;
+    } else if (xoffSent && serialIn.used() <= SERIAL_IN_LOW_WATER) {
+      Serial.write(XON);
+      xoffSent = false;
+    }
+
+    int room = dteStopped ? 0 : Serial.availableForWrite();
+    if (room <= 0 && !serialOut.empty()) metrics.usbStalls++;
+    if (paceLine && room > 0) room = min((size_t)room, pacerAllowance());
+    while (room > 0) {
+      size_t len;
+      const uint8_t *p = serialOut.readPtr(len);
+      if (len == 0) break;
+      if (len > (size_t)room) len = room;
+      size_t done = Serial.write(p, len);
+      serialWrites++;
+      serialOut.consume(done);
+      if (paceLine) pacerRelease(done);
+      room -= done;
+      moved |= done > 0;
+      if (done < len) break;
+    }
+
+    if (!moved) ulTaskNotifyTake(pdTRUE, 1);
   }
-  
-  page += "<hr><p><a href='/reboot'>Reboot Modem</a></p>";
-  page += "</body></html>";
-  
-  webServer.send(200, "text/html", page);
 }
 
-void handleWebHangup() {
-  hangUp();
-  webServer.send(200, "text/plain", "Call disconnected");
+// Веб-интерфейс: низкий приоритет, насос данных его не ждет
+void webTask(void *arg) {
+  for (;;) {
+    webServer.handleClient();
+    wsStep();
+    vTaskDelay(pdMS_TO_TICKS(2));
+  }
 }
 
-void handleWebReboot() {
-  webServer.send(200, "text/plain", "Rebooting...");
-  delay(100);
-  ESP.restart();
+// Большие буферы - в PSRAM, если она есть
+void *allocLarge(size_t size) {
+  void *p = ps_malloc(size);
+  return p ? p : malloc(size);
 }
 
 void setup() {
@@ -731,29 +4398,32 @@ void setup() {
   pinMode(LED_PIN, OUTPUT);
   digitalWrite(LED_PIN, HIGH); // Выключить
   
-  // Serial для USB
+  // Serial для USB. Ждать порт не нужно: до открытия терминалом
+  // вывод просто не уходит, а AT должен отвечать сразу
   Serial.begin(115200);
-  delay(1000); // Дать время для инициализации USB
   
-  // Загрузка настроек
+  // Загрузка настроек: одна запись из NVS
   loadSettings();
   
-  // Настройка WiFi
+  // Настройка WiFi: переподключением занимается wifiStep()
   WiFi.mode(WIFI_STA);
+  WiFi.persistent(false);
+  WiFi.setAutoReconnect(false);
+  WiFi.onEvent(onWiFiEvent);
   
   // Web сервер
   webServer.on("/", handleWebRoot);
   webServer.on("/ath", handleWebHangup);
   webServer.on("/reboot", handleWebReboot);
+  webServer.on("/metrics", handleWebMetrics);
+  webServer.on("/api/status", handleWebStatus);
+  webServer.on("/term", handleWebTerminal);
+  webServer.on("/trace", handleWebTrace);
   webServer.begin();
   
   // TCP сервер для входящих вызовов
-  tcpServer.begin();
-  
-  // mDNS (если нужно)
-  if (!MDNS.begin("esp32-modem")) {
-    Serial.println("mDNS failed");
-  }
+  listenerBegin();
+  wsServer.begin();
   
   // Приветствие
   Serial.println();
@@ -765,127 +4435,136 @@ void setup() {
   Serial.println();
   
   // Попытка подключиться к WiFi если настроено
-  if (ssid.length() > 0) {
+  if (ssid[0]) {
     Serial.println("Auto-connecting to WiFi...");
     connectWiFi();
   }
   
   sendResult(A_OK);
- 
+  bootOkUs = micros();
+
+  // Конвейер: сеть и USB на разных ядрах
+  sessionLock = xSemaphoreCreateRecursiveMutex();
+  trace.tailLock = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(netTask, "net", 8192, nullptr, NET_TASK_PRIO, &netTaskHandle, NET_TASK_CORE);
+  xTaskCreatePinnedToCore(serialTask, "serial", 4096, nullptr, SERIAL_TASK_PRIO, &serialTaskHandle, SERIAL_TASK_CORE);
+  xTaskCreatePinnedToCore(captureTask, "capture", 4096, nullptr, CAPTURE_TASK_PRIO, &captureTaskHandle, SERIAL_TASK_CORE);
+  xTaskCreatePinnedToCore(traceTask, "trace", 4096, nullptr, TRACE_TASK_PRIO, &traceTaskHandle, SERIAL_TASK_CORE);
+  xTaskCreatePinnedToCore(webTask, "web", 6144, nullptr, WEB_TASK_PRIO, nullptr, WEB_TASK_CORE);
+}
+
+// LittleFS нужен только записи сессий и трассировке в файл. Первый
+// старт на чистом флеше форматирует его секундами, поэтому монтирование
+// идет в своей задаче с низким приоритетом; до конца AT$CAP/ATHEX=2
+// отвечают ERROR.
+void fsMountTask(void *arg) {
+  unsigned long started = millis();
+  bool ok = LittleFS.begin(true);
+  fsMountMs = max(millis() - started, 1UL);
+  fsMounted = ok;
+  vTaskDelete(nullptr);
+}
+
+// Второй этап загрузки - первым проходом loop(), уже после OK: то, что
+// командному режиму сразу не нужно
+void bootFinish() {
+  unsigned long started = micros();
+  xTaskCreatePinnedToCore(fsMountTask, "fs", 4096, nullptr, FS_TASK_PRIO, nullptr, SERIAL_TASK_CORE);
+
+  // Словарь и состояние распаковщика MCCP - один раз, по возможности в PSRAM
+  mccp.dict = (uint8_t *)allocLarge(TINFL_LZ_DICT_SIZE);
+  mccp.inflator = (tinfl_decompressor *)allocLarge(sizeof(tinfl_decompressor));
+  tlsInit();
+
+  // История приема: большая - только в PSRAM
+  size_t historySize = psramFound() ? SCROLLBACK_SIZE : SCROLLBACK_SMALL;
+  uint8_t *history = (uint8_t *)(psramFound() ? ps_malloc(historySize) : malloc(historySize));
+  if (history) {
+    SessionLock lock; // netTask уже работает
+    scrollback.mask = historySize - 1;
+    scrollback.owner = attached;
+    scrollback.buf = history;
+  }
+
+  // mDNS (если нужно)
+  if (!MDNS.begin("esp32-modem")) {
+    Serial.println("mDNS failed");
+  }
+
+  bootLateUs = micros() - started;
+  bootDone = true;
+  heapAfterSetup = ESP.getFreeHeap();
 }
 
 
 void loop() {
-  // Обработка веб-запросов
-  webServer.handleClient();
- // MDNS.update();
-  
-  // Проверка входящих вызовов
-  handleIncomingCall();
-  
-  // +++ Переход в командный режим
-  static int plusCount = 0;
-  static unsigned long plusTime = 0;
-  
+  if (!bootDone) bootFinish();
+  unsigned long loopStart = micros();
+
+  // Подключение к WiFi
+  wifiStep();
+  dnsPrefetchStep();
+
+  {
+    SessionLock lock;
+
+    // Проверка входящих вызовов
+    handleIncomingCall();
+
+    // Набор номера
+    dialStep();
+    if (!dialing()) warmStep();
+  }
+  listenerStep();
+
+  // +++ из netTask
+  if (escapeDone) {
+    escapeDone = false;
+    sendResult(A_OK);
+  }
+
   // Командный режим
-  if (cmdMode) {
-    if (Serial.available()) {
-      char c = Serial.read();
-      
-      // PETSCII преобразование
-      if (petTranslate && c > 127) c -= 128;
-      
-      // Enter = выполнить команду
-      if (c == '\r' || c == '\n') {
-        processCommand();
-      }
-      // Backspace
-      else if (c == 8 || c == 127) {
-        if (cmd.length() > 0) {
-          cmd.remove(cmd.length() - 1);
-          if (echo) {
-            Serial.write(8);
-            Serial.write(' ');
-            Serial.write(8);
-          }
-        }
-      }
-      // Обычный символ
-      else {
-        if (cmd.length() < MAX_CMD_LENGTH) {
-          cmd += c;
-          if (echo) Serial.write(c);
-        }
-      }
+  uint8_t c;
+  if (dialing()) {
+    if (!serialIn.empty()) {
+      SessionLock lock;
+      dialAbort();
     }
   }
-  // Режим передачи данных
-  else {
-    // Данные от компьютера -> в сеть
-    if (Serial.available()) {
-      // Проверка на +++
-      while (Serial.available()) {
-        char c = Serial.read();
-        
-        // PETSCII преобразование
-        if (petTranslate && c > 127) c -= 128;
-        
-        if (c == '+') {
-          plusCount++;
-          if (plusCount >= 3) plusTime = millis();
-        } else {
-          plusCount = 0;
-        }
-        
-        // Отправка в сеть (если не +++)
-        if (plusCount < 3 && tcpClient.connected()) {
-          // Telnet escaping для 0xFF
-          if (telnet && c == 0xFF) {
-            tcpClient.write(0xFF);
-          }
-          tcpClient.write(c);
-        }
-      }
-    }
+  else if (replaying()) {
+    if (!serialIn.empty()) replayStop();
+    else replayStep();
+  }
+  else if (historyDumping()) {
+    if (!serialIn.empty()) historyStop();
+    else historyStep();
+  }
+  else if (cmdMode && serialIn.get(c)) {
+    // Перекодировка терминала (PETSCII/ATASCII)
+    c = CharsetTranslator::fromTerminalByte((Charset)charset, c);
     
-    // Данные из сети -> в компьютер
-    if (tcpClient.available()) {
-      while (tcpClient.available() && Serial.availableForWrite() > 0) {
-        uint8_t c = tcpClient.read();
-        
-        // Обработка Telnet кодов
-        if (telnet && c == 0xFF) {
-          uint8_t cmd1 = tcpClient.read();
-          uint8_t cmd2 = tcpClient.read();
-          
-          // Отвечаем на запросы
-          if (cmd1 == 0xFD) { // DO
-            tcpClient.write(0xFF);
-            tcpClient.write(0xFC); // WONT
-            tcpClient.write(cmd2);
-          } else if (cmd1 == 0xFB) { // WILL
-            tcpClient.write(0xFF);
-            tcpClient.write(0xFD); // DO
-            tcpClient.write(cmd2);
-          }
-          continue;
+    // Enter = выполнить команду
+    if (c == sRegs[S_CR] || c == '\n') {
+      SessionLock lock;
+      processCommand();
+    }
+    // Backspace
+    else if (c == sRegs[S_BS] || c == 127) {
+      if (cmdLen > 0) {
+        cmdLen--;
+        if (echo) {
+          Serial.write(8);
+          Serial.write(' ');
+          Serial.write(8);
         }
-        
-        Serial.write(c);
       }
     }
-    
-    // Проверка на разрыв соединения
-    if (!tcpClient.connected() && callConnected) {
-      hangUp();
-      cmdMode = true;
-    }
-    
-    // +++ таймаут (1 секунда)
-    if (plusCount >= 3 && millis() - plusTime > 1000) {
-      cmdMode = true;
-      plusCount = 0;
-      sendResult(A_OK);
+    // Обычный символ
+    else {
+      if (cmdLen < MAX_CMD_LENGTH) {
+        cmdLine[cmdLen++] = c;
+        if (echo) Serial.write(c);
+      }
     }
   }
   
@@ -895,4 +4574,9 @@ void loop() {
     updateLed();
     lastLedUpdate = millis();
   }
+
+  metrics.mainLoop.record(micros() - loopStart);
+
+  // Данные идут через netTask/serialTask, здесь спешить некуда
+  if (serialIn.empty() || !cmdMode) delay(1);
 }
@@ -0,0 +1,515 @@
+#pragma once
+/*
+   Переносимое ядро модема: буферы и разбор telnet.
+   Не зависит от Arduino, собирается и на ESP32, и на обычном Linux,
+   чтобы горячие пути можно было проверять и мерить вне платы.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+// Кольцевой буфер фиксированного размера без выделения памяти.
+// head/tail идут без обнуления, индекс в массиве = счетчик & (N - 1).
+// writePtr()/readPtr() отдают непрерывный участок, чтобы read()/write()
+// работали сразу блоками, а не по байту.
+template <size_t N>
+class RingBuffer {
+  static_assert((N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+public:
+  size_t used() const { return head - tail; }
+  size_t space() const { return N - used(); }
+  bool empty() const { return head == tail; }
+  void clear() { head = tail = 0; }
+
+  uint8_t* writePtr(size_t &len) {
+    size_t off = head & (N - 1);
+    len = N - off;
+    if (len > space()) len = space();
+    return buf + off;
+  }
+  void commit(size_t n) { head += n; }
+
+  const uint8_t* readPtr(size_t &len) const {
+    size_t off = tail & (N - 1);
+    len = N - off;
+    if (len > used()) len = used();
+    return buf + off;
+  }
+  void consume(size_t n) { tail += n; }
+
+  // Непрерывный участок, начиная с skip байт после tail, без снятия
+  const uint8_t* peekPtr(size_t skip, size_t &len) const {
+    size_t off = (tail + skip) & (N - 1);
+    len = N - off;
+    if (len > used() - skip) len = used() - skip;
+    return buf + off;
+  }
+
+  void put(uint8_t c) { buf[head++ & (N - 1)] = c; }
+
+  size_t write(const uint8_t *data, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+      size_t len;
+      uint8_t *p = writePtr(len);
+      if (len == 0) break;
+      if (len > n - done) len = n - done;
+      memcpy(p, data + done, len);
+      commit(len);
+      done += len;
+    }
+    return done;
+  }
+
+private:
+  uint8_t buf[N];
+  size_t head = 0;
+  size_t tail = 0;
+};
+
+// Кольцевой буфер между двумя задачами: одна только пишет, другая только
+// читает. Писатель публикует head (release), читатель - tail, поэтому
+// блокировки не нужны. Интерфейс как у RingBuffer.
+template <size_t N>
+class SpscRing {
+  static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+public:
+  // Из третьего потока head и tail читаются не одновременно: tail первым,
+  // чтобы разность не ушла в минус, и не больше N, если tail устарел
+  size_t used() const {
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t h = head.load(std::memory_order_acquire);
+    return h - t < N ? h - t : N;
+  }
+  size_t space() const { return N - used(); }
+  bool empty() const { return used() == 0; }
+
+  // --- писатель ---
+  uint8_t* writePtr(size_t &len) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t free = N - (h - tail.load(std::memory_order_acquire));
+    size_t off = h & (N - 1);
+    len = N - off;
+    if (len > free) len = free;
+    return buf + off;
+  }
+  void commit(size_t n) { head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+  size_t write(const uint8_t *data, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+      size_t len;
+      uint8_t *p = writePtr(len);
+      if (len == 0) break;
+      if (len > n - done) len = n - done;
+      memcpy(p, data + done, len);
+      commit(len);
+      done += len;
+    }
+    return done;
+  }
+
+  // --- читатель ---
+  const uint8_t* readPtr(size_t &len) const {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t avail = head.load(std::memory_order_acquire) - t;
+    size_t off = t & (N - 1);
+    len = N - off;
+    if (len > avail) len = avail;
+    return buf + off;
+  }
+  void consume(size_t n) { tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+  bool get(uint8_t &c) {
+    size_t len;
+    const uint8_t *p = readPtr(len);
+    if (len == 0) return false;
+    c = *p;
+    consume(1);
+    return true;
+  }
+
+  void discard() { tail.store(head.load(std::memory_order_acquire), std::memory_order_release); }
+
+private:
+  uint8_t buf[N];
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+};
+
+// Telnet команды (RFC 854)
+#define T_SE   240
+#define T_NOP  241
+#define T_SB   250
+#define T_WILL 251
+#define T_WONT 252
+#define T_DO   253
+#define T_DONT 254
+#define T_IAC  255
+
+// Поддерживаемые опции
+#define TO_BINARY 0
+#define TO_ECHO   1
+#define TO_SGA    3
+#define TO_TTYPE  24
+#define TO_NAWS   31
+#define TO_COMPRESS2 86  // MCCP2: поток от сервера сжат zlib
+
+#define TELNET_SB_MAX 32
+#define TELNET_BINARY_REQ 6  // IAC WILL BINARY, IAC DO BINARY - requestBinary()
+
+// Потоковый разборщик telnet. Состояние хранится между блоками, так что
+// IAC-последовательность, разрезанная между TCP сегментами, не теряется.
+// Участки без 0xFF копируются целиком, побайтно разбираются только команды.
+// Пока сервер не в режиме BINARY, CR NUL доходит до терминала как CR.
+class TelnetParser {
+public:
+  const char *termType = "ANSI";
+  uint16_t cols = 80;
+  uint16_t rows = 24;
+  bool acceptCompress = false;  // соглашаться ли на MCCP2 (есть свободный распаковщик)
+
+  void reset() {
+    state = TS_DATA;
+    localOn = remoteOn = 0;
+    sbLen = 0;
+    compressStart = false;
+    afterCr = false;
+  }
+
+  // Сервер прислал IAC SB COMPRESS2 IAC SE: дальше идет поток zlib.
+  // Флаг сбрасывается при чтении.
+  bool takeCompressStart() {
+    bool started = compressStart;
+    compressStart = false;
+    return started;
+  }
+
+  bool localEnabled(uint8_t opt) const { return localOn & optBit(opt); }
+  bool remoteEnabled(uint8_t opt) const { return remoteOn & optBit(opt); }
+
+  // Разбирает блок из сети. Данные пользователя -> out (должно быть
+  // свободно не меньше n байт), ответы серверу -> reply.
+  // С началом сжатия разбор останавливается: в consumed - сколько байт
+  // было обычным telnet, остальное - уже поток zlib.
+  template <class Out, class Reply>
+  size_t parse(const uint8_t *in, size_t n, Out &out, Reply &reply, size_t *consumed = nullptr) {
+    size_t produced = 0;
+    size_t i = 0;
+    while (i < n) {
+      if (state == TS_DATA) {
+        const uint8_t *iac = (const uint8_t *)memchr(in + i, T_IAC, n - i);
+        size_t run = iac ? (size_t)(iac - (in + i)) : n - i;
+        if (run) {
+          if (remoteOn & optBit(TO_BINARY)) {
+            out.write(in + i, run);
+            produced += run;
+          } else {
+            produced += writeNvt(in + i, run, out);
+          }
+          i += run;
+        }
+        if (iac) {
+          state = TS_IAC;
+          i++;
+        }
+        continue;
+      }
+
+      uint8_t c = in[i++];
+      switch (state) {
+        case TS_IAC:
+          if (c == T_IAC) {            // экранированный 0xFF
+            out.put(T_IAC);
+            produced++;
+            afterCr = false;
+            state = TS_DATA;
+          } else if (c >= T_WILL) {
+            verb = c;
+            state = TS_OPT;
+          } else if (c == T_SB) {
+            sbLen = 0;
+            state = TS_SB;
+          } else {                     // NOP, GA и прочие - пропускаем
+            state = TS_DATA;
+          }
+          break;
+        case TS_OPT:
+          negotiate(verb, c, reply);
+          state = TS_DATA;
+          break;
+        case TS_SB:
+          if (c == T_IAC) state = TS_SB_IAC;
+          else if (sbLen < TELNET_SB_MAX) sb[sbLen++] = c;
+          break;
+        case TS_SB_IAC:
+          if (c == T_SE) {
+            subnegotiate(reply);
+            state = TS_DATA;
+            if (compressStart && consumed) {
+              *consumed = i;
+              return produced;
+            }
+          } else {
+            if (c == T_IAC && sbLen < TELNET_SB_MAX) sb[sbLen++] = c;
+            state = TS_SB;
+          }
+          break;
+        default:
+          state = TS_DATA;
+          break;
+      }
+    }
+    if (consumed) *consumed = n;
+    return produced;
+  }
+
+  // Просим двоичный режим в обе стороны (для передачи файлов). Бит ставим
+  // сразу, так что согласие сервера не вызовет повторного ответа.
+  template <class Reply>
+  void requestBinary(Reply &reply) {
+    uint8_t bit = optBit(TO_BINARY);
+    if (!(localOn & bit)) {
+      localOn |= bit;
+      send3(reply, T_WILL, TO_BINARY);
+    }
+    if (!(remoteOn & bit)) {
+      remoteOn |= bit;
+      send3(reply, T_DO, TO_BINARY);
+    }
+  }
+
+  // Размер окна изменился - сообщаем серверу, если NAWS согласован
+  template <class Reply>
+  void sendWindowSize(Reply &reply) {
+    if (!localEnabled(TO_NAWS)) return;
+    uint8_t msg[13];
+    size_t len = 0;
+    msg[len++] = T_IAC; msg[len++] = T_SB; msg[len++] = TO_NAWS;
+    const uint8_t dims[4] = {(uint8_t)(cols >> 8), (uint8_t)cols, (uint8_t)(rows >> 8), (uint8_t)rows};
+    for (uint8_t d : dims) {
+      msg[len++] = d;
+      if (d == T_IAC) msg[len++] = T_IAC;
+    }
+    msg[len++] = T_IAC; msg[len++] = T_SE;
+    reply.write(msg, len);
+  }
+
+private:
+  enum State : uint8_t { TS_DATA, TS_IAC, TS_OPT, TS_SB, TS_SB_IAC };
+  State state = TS_DATA;
+  uint8_t verb = 0;
+  uint8_t localOn = 0;   // опции, которые включены с нашей стороны (WILL)
+  uint8_t remoteOn = 0;  // опции, которые включены на стороне сервера (DO)
+  uint8_t sb[TELNET_SB_MAX];
+  uint8_t sbLen = 0;
+  bool compressStart = false;
+  bool afterCr = false;  // последний байт данных - CR (пара CR NUL на стыке блоков)
+
+  // NVT (RFC 854): одиночный CR передается как CR NUL, NUL после CR
+  // отбрасываем. Вне двоичного режима NUL в тексте редок, так что
+  // блок по-прежнему копируется кусками между ними.
+  template <class Out>
+  size_t writeNvt(const uint8_t *p, size_t n, Out &out) {
+    size_t produced = 0;
+    while (n) {
+      const uint8_t *nul = (const uint8_t *)memchr(p, 0, n);
+      size_t run = nul ? (size_t)(nul - p) : n;
+      bool drop = nul && (run ? p[run - 1] == '\r' : afterCr);
+      if (run) {
+        out.write(p, run);
+        produced += run;
+        afterCr = p[run - 1] == '\r';
+      }
+      if (nul) {
+        if (!drop) {
+          out.put(0);
+          produced++;
+        }
+        afterCr = false;
+        run++;
+      }
+      p += run;
+      n -= run;
+    }
+    return produced;
+  }
+
+  static uint8_t optBit(uint8_t opt) {
+    switch (opt) {
+      case TO_BINARY: return 0x01;
+      case TO_ECHO:   return 0x02;
+      case TO_SGA:    return 0x04;
+      case TO_TTYPE:  return 0x08;
+      case TO_NAWS:   return 0x10;
+      case TO_COMPRESS2: return 0x20;
+      default:        return 0;
+    }
+  }
+
+  template <class Reply>
+  static void send3(Reply &reply, uint8_t verb, uint8_t opt) {
+    const uint8_t msg[3] = {T_IAC, verb, opt};
+    reply.write(msg, 3);
+  }
+
+  // Отвечаем только при смене состояния опции, чтобы не зациклиться
+  template <class Reply>
+  void negotiate(uint8_t v, uint8_t opt, Reply &reply) {
+    uint8_t bit = optBit(opt);
+    switch (v) {
+      case T_DO: {
+        // эхо делает терминал, не мы; сжимать свой поток не умеем
+        bool ok = bit && opt != TO_ECHO && opt != TO_COMPRESS2;
+        if (!ok) {
+          send3(reply, T_WONT, opt);
+        } else if (!(localOn & bit)) {
+          localOn |= bit;
+          send3(reply, T_WILL, opt);
+          if (opt == TO_NAWS) sendWindowSize(reply);
+        }
+        break;
+      }
+      case T_DONT:
+        if (localOn & bit) {
+          localOn &= ~bit;
+          send3(reply, T_WONT, opt);
+        }
+        break;
+      case T_WILL: {
+        bool ok = opt == TO_BINARY || opt == TO_SGA || opt == TO_ECHO ||
+                  (opt == TO_COMPRESS2 && acceptCompress);
+        if (!ok) {
+          send3(reply, T_DONT, opt);
+        } else if (!(remoteOn & bit)) {
+          remoteOn |= bit;
+          send3(reply, T_DO, opt);
+        }
+        break;
+      }
+      case T_WONT:
+        if (remoteOn & bit) {
+          remoteOn &= ~bit;
+          send3(reply, T_DONT, opt);
+        }
+        break;
+    }
+  }
+
+  template <class Reply>
+  void subnegotiate(Reply &reply) {
+    if (sbLen >= 1 && sb[0] == TO_COMPRESS2 && remoteEnabled(TO_COMPRESS2)) {
+      compressStart = true;
+      return;
+    }
+    // TTYPE SEND -> TTYPE IS <тип>
+    if (sbLen >= 2 && sb[0] == TO_TTYPE && sb[1] == 1 && localEnabled(TO_TTYPE)) {
+      const uint8_t head[4] = {T_IAC, T_SB, TO_TTYPE, 0};
+      const uint8_t tail[2] = {T_IAC, T_SE};
+      reply.write(head, 4);
+      reply.write((const uint8_t *)termType, strlen(termType));
+      reply.write(tail, 2);
+    }
+  }
+};
+
+// Распознавание начала передачи файлов в потоке. Состояние хранится
+// между блоками, как у разборщика telnet, отдельно для каждого направления.
+//   ZMODEM: ZPAD ZPAD ZDLE 'B' '0' - шестнадцатеричный заголовок ZRQINIT/ZRINIT
+//   XMODEM/YMODEM: SOH или STX, номер блока 0 или 1, его дополнение - и
+//   только если последним байтом навстречу был запрос приемника ('C', NAK
+//   или 'G'). Без него 01 01 FE в ANSI- и PETSCII-графике - не передача.
+enum TransferProto : uint8_t { XFER_NONE, XFER_ZMODEM, XFER_XYMODEM };
+
+#define XFER_NAK 0x15
+
+class TransferDetector {
+public:
+  void reset() {
+    for (Direction &d : dirs) d = Direction();
+  }
+
+  // toNet - поток от терминала в сеть, иначе из сети в терминал
+  TransferProto feed(const uint8_t *p, size_t n, bool toNet) {
+    static const uint8_t zSig[] = {'*', '*', 0x18, 'B', '0'};
+    Direction &d = dirs[toNet];
+    const Direction &peer = dirs[!toNet];
+    for (size_t i = 0; i < n; i++) {
+      uint8_t c = p[i];
+      if (c == zSig[d.zPos]) d.zPos++;
+      else d.zPos = c == '*' ? (d.zPos == 2 ? 2 : 1) : 0;
+      if (d.zPos == sizeof(zSig)) {
+        reset();
+        return XFER_ZMODEM;
+      }
+
+      if (d.yPos == 1 && c <= 1) {
+        d.block = c;
+        d.yPos = 2;
+      } else if (d.yPos == 2 && c == (uint8_t)(255 - d.block) && receiverWaiting(peer.last)) {
+        reset();
+        return XFER_XYMODEM;
+      } else {
+        d.yPos = (c == 0x01 || c == 0x02) ? 1 : 0;
+      }
+    }
+    if (n) d.last = p[n - 1];
+    return XFER_NONE;
+  }
+
+private:
+  static bool receiverWaiting(uint8_t c) { return c == 'C' || c == XFER_NAK || c == 'G'; }
+
+  struct Direction {
+    uint8_t zPos = 0;
+    uint8_t yPos = 0;
+    uint8_t block = 0;
+    uint8_t last = 0;  // последний байт в этом направлении
+  };
+  Direction dirs[2];
+};
+
+// Гистограмма задержек с логарифмическими корзинами: номер корзины =
+// число значащих бит значения (0, 1, 2-3, 4-7, ... мкс). Запись - это
+// clz, инкремент и сравнение, так что ее можно не выключать в работе.
+// Пишет одна задача, читать снимок можно из любой.
+class LatencyHistogram {
+public:
+  static const int BUCKETS = 33;
+
+  void record(uint32_t us) {
+    int b = us ? 32 - __builtin_clz(us) : 0;
+    buckets[b]++;
+    count++;
+    sum += us;
+    if (us > maxValue) maxValue = us;
+  }
+
+  void reset() {
+    memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    sum = 0;
+    maxValue = 0;
+  }
+
+  // Верхняя граница корзины, в которую попадает pct процентов замеров
+  uint32_t percentile(uint32_t pct) const {
+    if (count == 0) return 0;
+    uint64_t need = ((uint64_t)count * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+      seen += buckets[b];
+      if (seen >= need) return bucketLimit(b);
+    }
+    return maxValue;
+  }
+
+  static uint32_t bucketLimit(int b) { return b >= 32 ? 0xFFFFFFFFu : (1u << b) - 1; }
+
+  uint32_t buckets[BUCKETS] = {};
+  uint32_t count = 0;
+  uint64_t sum = 0;
+  uint32_t maxValue = 0;
+};
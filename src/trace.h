@@ -0,0 +1,126 @@
+#pragma once
+/*
+   Трассировка ATHEX: событие насоса данных и его текстовый вид - время,
+   сессия, направление, hex-дамп с ASCII и разбор команд telnet.
+   Насос только копирует байты в кольцо, форматирует фоновая задача.
+   Не зависит от Arduino.
+*/
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "modem_core.h"
+
+#define TRACE_OUTBOUND 0x80      // от терминала в сеть
+#define TRACE_TELNET 0x40        // разбирать IAC
+#define TRACE_SESSION_MASK 0x07
+#define TRACE_MAX_DATA 240       // данных в одном событии
+#define TRACE_BYTES_PER_LINE 16
+// Текст одного события: заголовок, строки дампа и разбор telnet
+#define TRACE_TEXT_MAX (64 + (TRACE_MAX_DATA / TRACE_BYTES_PER_LINE) * 80 + TRACE_MAX_DATA * 8)
+
+struct TraceEvent {
+  uint32_t us;     // micros()
+  uint8_t flags;
+  uint8_t len;
+};
+
+inline const char *traceTelnetCommand(uint8_t c) {
+  static const char *const names[] = {"SE", "NOP", "DM", "BRK", "IP", "AO", "AYT", "EC",
+                                      "EL", "GA", "SB", "WILL", "WONT", "DO", "DONT", "IAC"};
+  return c >= T_SE ? names[c - T_SE] : nullptr;
+}
+
+inline const char *traceTelnetOption(uint8_t o) {
+  switch (o) {
+    case TO_BINARY: return "BINARY";
+    case TO_ECHO: return "ECHO";
+    case TO_SGA: return "SGA";
+    case 5: return "STATUS";
+    case 6: return "TM";
+    case TO_TTYPE: return "TTYPE";
+    case TO_NAWS: return "NAWS";
+    case 32: return "TSPEED";
+    case 33: return "LFLOW";
+    case 34: return "LINEMODE";
+    case 39: return "NEW-ENVIRON";
+    case TO_COMPRESS2: return "COMPRESS2";
+    default: return nullptr;
+  }
+}
+
+// Дописать в out с позиции pos, не выходя за size; возвращает новую позицию
+inline size_t traceAppend(char *out, size_t size, size_t pos, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+inline size_t traceAppend(char *out, size_t size, size_t pos, const char *fmt, ...) {
+  if (pos >= size) return pos;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(out + pos, size - pos, fmt, args);
+  va_end(args);
+  if (n < 0) return pos;
+  return pos + (size_t)n < size ? pos + n : size - 1;
+}
+
+// Разбор команд telnet внутри события. Последовательность, разрезанная
+// между событиями, помечается как оборванная.
+inline size_t traceFormatTelnet(const uint8_t *p, size_t n, char *out, size_t size, size_t pos) {
+  bool any = false;
+  for (size_t i = 0; i < n; i++) {
+    if (p[i] != T_IAC) continue;
+    if (!any) pos = traceAppend(out, size, pos, "  TELNET:");
+    any = true;
+    if (i + 1 >= n) {
+      pos = traceAppend(out, size, pos, " IAC ...");
+      break;
+    }
+    uint8_t cmd = p[++i];
+    const char *name = traceTelnetCommand(cmd);
+    if (cmd == T_IAC) {
+      pos = traceAppend(out, size, pos, " [FF]");
+    } else if (cmd >= T_WILL || cmd == T_SB) {
+      if (i + 1 >= n) {
+        pos = traceAppend(out, size, pos, " IAC %s ...", name);
+        break;
+      }
+      uint8_t opt = p[++i];
+      const char *optName = traceTelnetOption(opt);
+      if (optName) pos = traceAppend(out, size, pos, " IAC %s %s", name, optName);
+      else pos = traceAppend(out, size, pos, " IAC %s %u", name, opt);
+    } else if (name) {
+      pos = traceAppend(out, size, pos, " IAC %s", name);
+    } else {
+      pos = traceAppend(out, size, pos, " IAC %u", cmd);
+    }
+  }
+  if (any) pos = traceAppend(out, size, pos, "\r\n");
+  return pos;
+}
+
+// Событие целиком в текст; out - не меньше TRACE_TEXT_MAX
+inline size_t traceFormat(const TraceEvent &ev, const uint8_t *data, char *out, size_t size) {
+  size_t pos = traceAppend(out, size, 0, "%lu.%06lu S%u %s %u BYTES\r\n",
+                           (unsigned long)(ev.us / 1000000), (unsigned long)(ev.us % 1000000),
+                           ev.flags & TRACE_SESSION_MASK, ev.flags & TRACE_OUTBOUND ? ">>" : "<<",
+                           ev.len);
+  for (size_t line = 0; line < ev.len; line += TRACE_BYTES_PER_LINE) {
+    size_t n = ev.len - line < TRACE_BYTES_PER_LINE ? ev.len - line : TRACE_BYTES_PER_LINE;
+    char ascii[TRACE_BYTES_PER_LINE + 1];
+    pos = traceAppend(out, size, pos, "  %04x ", (unsigned)line);
+    for (size_t i = 0; i < TRACE_BYTES_PER_LINE; i++) {
+      if (i < n) {
+        uint8_t c = data[line + i];
+        pos = traceAppend(out, size, pos, " %02X", c);
+        ascii[i] = c >= 0x20 && c < 0x7F ? c : '.';
+      } else {
+        pos = traceAppend(out, size, pos, "   ");
+      }
+    }
+    ascii[n] = 0;
+    pos = traceAppend(out, size, pos, "  |%s|\r\n", ascii);
+  }
+  if (ev.flags & TRACE_TELNET) pos = traceFormatTelnet(data, ev.len, out, size, pos);
+  return pos;
+}
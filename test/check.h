@@ -0,0 +1,52 @@
+#pragma once
+// Минимальный раннер для хост-тестов: TEST(имя) { CHECK(...); }. Первая
+// проваленная проверка завершает тест; итог - код возврата для ctest.
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+struct TestCase {
+  const char *name;
+  void (*fn)();
+  TestCase *next;
+};
+
+TestCase *&testList();
+void testFail(const char *file, int line, const std::string &what);
+
+struct TestRegistrar {
+  TestRegistrar(TestCase *tc) {
+    TestCase **tail = &testList();
+    while (*tail) tail = &(*tail)->next;
+    *tail = tc;
+  }
+};
+
+#define TEST(name)                                                     \
+  static void test_##name();                                           \
+  static TestCase testCase_##name = {#name, test_##name, nullptr};     \
+  static TestRegistrar testRegistrar_##name(&testCase_##name);         \
+  static void test_##name()
+
+#define CHECK(cond)                                                    \
+  do {                                                                 \
+    if (!(cond)) return testFail(__FILE__, __LINE__, #cond);           \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                 \
+  do {                                                                 \
+    auto checkA_ = (a);                                                \
+    auto checkB_ = (b);                                                \
+    if (!(checkA_ == checkB_))                                         \
+      return testFail(__FILE__, __LINE__, std::string(#a " == " #b ": ") + \
+                      std::to_string(checkA_) + " != " + std::to_string(checkB_)); \
+  } while (0)
+
+// Для строк: при провале печатает обе
+#define CHECK_STR(haystack, needle)                                    \
+  do {                                                                 \
+    std::string checkH_ = (haystack);                                  \
+    if (checkH_.find(needle) == std::string::npos)                     \
+      return testFail(__FILE__, __LINE__, std::string("\"") + (needle) + "\" not in:\n" + checkH_); \
+  } while (0)
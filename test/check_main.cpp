@@ -0,0 +1,39 @@
+// Раннер хост-тестов: все TEST() по порядку объявления, или выбранные
+// именами в аргументах
+
+#include "check.h"
+
+#include <stdlib.h>
+
+static bool failed;
+
+TestCase *&testList() {
+  static TestCase *head = nullptr;
+  return head;
+}
+
+void testFail(const char *file, int line, const std::string &what) {
+  printf("  FAILED %s:%d: %s\n", file, line, what.c_str());
+  failed = true;
+}
+
+int main(int argc, char **argv) {
+  int run = 0, failures = 0;
+  for (TestCase *tc = testList(); tc; tc = tc->next) {
+    bool wanted = argc < 2;
+    for (int i = 1; i < argc; i++) wanted |= strcmp(argv[i], tc->name) == 0;
+    if (!wanted) continue;
+    printf("[ RUN  ] %s\n", tc->name);
+    fflush(stdout);
+    failed = false;
+    tc->fn();
+    printf("[ %s ] %s\n", failed ? "FAIL" : " OK ", tc->name);
+    fflush(stdout);
+    run++;
+    failures += failed;
+  }
+  printf("%d tests, %d failed\n", run, failures);
+  fflush(stdout);
+  // Задачи прошивки крутятся вечно - выходим, не дожидаясь их
+  _Exit(failures ? 1 : 0);
+}
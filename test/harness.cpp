@@ -0,0 +1,332 @@
+// Стенд хост-тестов: прошивка в процессе, терминал, TCP-серверы
+
+#include "harness.h"
+
+#include <host.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+
+// === ПРОШИВКА ===
+
+static std::atomic<unsigned long> loopMaxUs{0};
+
+void modemStart() {
+  char dir[] = "/tmp/modem-test-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    exit(1);
+  }
+  hostSetDataDir(dir);
+  hostSetPortOffset(-1);
+  setup();
+  std::thread([] {
+    for (;;) {
+      unsigned long started = micros();
+      loop();
+      unsigned long took = micros() - started;
+      unsigned long seen = loopMaxUs.load();
+      while (took > seen && !loopMaxUs.compare_exchange_weak(seen, took)) {}
+    }
+  }).detach();
+}
+
+unsigned long modemLoopMaxUs(bool reset) {
+  return reset ? loopMaxUs.exchange(0) : loopMaxUs.load();
+}
+
+uint16_t modemPort(uint16_t firmwarePort) {
+  return hostBoundPort(firmwarePort);
+}
+
+// === ТЕРМИНАЛ ===
+
+Terminal::Terminal() {
+  fd_ = open(hostSerialPath(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd_ < 0) {
+    perror("terminal");
+    exit(1);
+  }
+  struct termios tio;
+  tcgetattr(fd_, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(fd_, TCSANOW, &tio);
+}
+
+Terminal::~Terminal() {
+  close(fd_);
+}
+
+void Terminal::write(const std::string &s) {
+  write(s.data(), s.size());
+}
+
+void Terminal::write(const void *buf, size_t n) {
+  const uint8_t *p = (const uint8_t *)buf;
+  while (n > 0) {
+    ssize_t res = ::write(fd_, p, n);
+    if (res > 0) {
+      p += res;
+      n -= res;
+      continue;
+    }
+    struct pollfd pfd = {fd_, POLLOUT, 0};
+    poll(&pfd, 1, 100);
+  }
+}
+
+size_t Terminal::read(void *buf, size_t n, unsigned timeoutMs) {
+  if (!in_.empty()) {
+    size_t take = std::min(n, in_.size());
+    memcpy(buf, in_.data(), take);
+    in_.erase(0, take);
+    return take;
+  }
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  if (poll(&pfd, 1, timeoutMs) <= 0) return 0;
+  ssize_t res = ::read(fd_, buf, n);
+  return res > 0 ? res : 0;
+}
+
+bool Terminal::fill(unsigned timeoutMs) {
+  char buf[4096];
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  if (poll(&pfd, 1, timeoutMs) <= 0) return false;
+  ssize_t res = ::read(fd_, buf, sizeof(buf));
+  if (res <= 0) return false;
+  in_.append(buf, res);
+  return true;
+}
+
+bool Terminal::expect(const std::string &needle, unsigned timeoutMs) {
+  unsigned long deadline = millis() + timeoutMs;
+  for (;;) {
+    size_t at = in_.find(needle);
+    if (at != std::string::npos) {
+      in_.erase(0, at + needle.size());
+      return true;
+    }
+    long left = (long)(deadline - millis());
+    if (left <= 0) return false;
+    fill(left);
+  }
+}
+
+std::string Terminal::command(const std::string &cmd, unsigned timeoutMs) {
+  drain(20);
+  write(cmd + "\r");
+  unsigned long deadline = millis() + timeoutMs;
+  for (;;) {
+    size_t ok = in_.find("\r\nOK\r\n");
+    size_t err = in_.find("ERROR");
+    size_t end = std::min(ok == std::string::npos ? ok : ok + 6, err == std::string::npos ? err : err + 5);
+    if (end != std::string::npos) {
+      std::string out = in_.substr(0, end);
+      in_.erase(0, end);
+      return out;
+    }
+    long left = (long)(deadline - millis());
+    if (left <= 0) break;
+    fill(left);
+  }
+  std::string out = in_;
+  in_.clear();
+  return out;
+}
+
+std::string Terminal::drain(unsigned quietMs) {
+  while (fill(quietMs)) {}
+  std::string out = in_;
+  in_.clear();
+  return out;
+}
+
+Terminal &modemTerminal(void (*beforeStart)()) {
+  static Terminal *t = nullptr;
+  if (!t) {
+    if (beforeStart) beforeStart();
+    modemStart();
+    t = new Terminal;
+    t->drain(200);
+  }
+  return *t;
+}
+
+// === СЕТЬ ===
+
+TcpServer::TcpServer(std::function<void(int fd)> handler, int backlog) : handler_(handler) {
+  fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::bind(fd_, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd_, backlog) != 0) {
+    perror("server");
+    exit(1);
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(fd_, (sockaddr *)&addr, &len);
+  port_ = ntohs(addr.sin_port);
+  thread_ = std::thread([this] {
+    while (!stop_) {
+      if (paused_) {
+        usleep(10000);
+        continue;
+      }
+      struct pollfd pfd = {fd_, POLLIN, 0};
+      if (poll(&pfd, 1, 20) <= 0) continue;
+      int client = accept(fd_, nullptr, nullptr);
+      if (client < 0) continue;
+      accepted_++;
+      {
+        std::lock_guard<std::mutex> guard(clientsLock_);
+        clients_.push_back(client);
+      }
+      std::thread([this, client] {
+        if (handler_) handler_(client);
+        std::lock_guard<std::mutex> guard(clientsLock_);
+        clients_.erase(std::find(clients_.begin(), clients_.end(), client));
+        close(client);
+        clientsDone_.notify_all();
+      }).detach();
+    }
+  });
+}
+
+// Обработчики держат ссылки на данные теста: обрываем их соединения и
+// ждем, пока все выйдут
+TcpServer::~TcpServer() {
+  stop_ = true;
+  thread_.join();
+  close(fd_);
+  std::unique_lock<std::mutex> guard(clientsLock_);
+  for (int client : clients_) shutdown(client, SHUT_RDWR);
+  clientsDone_.wait(guard, [this] { return clients_.empty(); });
+}
+
+int tcpConnect(uint16_t port, unsigned timeoutMs) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) {
+    close(fd);
+    return -1;
+  }
+  struct pollfd pfd = {fd, POLLOUT, 0};
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (poll(&pfd, 1, timeoutMs) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, 0);
+  return fd;
+}
+
+bool sendAll(int fd, const void *buf, size_t n) {
+  const uint8_t *p = (const uint8_t *)buf;
+  while (n > 0) {
+    ssize_t res = send(fd, p, n, MSG_NOSIGNAL);
+    if (res <= 0) return false;
+    p += res;
+    n -= res;
+  }
+  return true;
+}
+
+size_t recvAll(int fd, void *buf, size_t n, unsigned timeoutMs) {
+  uint8_t *p = (uint8_t *)buf;
+  size_t got = 0;
+  unsigned long deadline = millis() + timeoutMs;
+  while (got < n) {
+    long left = (long)(deadline - millis());
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (left <= 0 || poll(&pfd, 1, left) <= 0) break;
+    ssize_t res = recv(fd, p + got, n - got, 0);
+    if (res <= 0) break;
+    got += res;
+  }
+  return got;
+}
+
+void echoHandler(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  char buf[16384];
+  for (;;) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0 || !sendAll(fd, buf, n)) break;
+  }
+}
+
+std::string httpGet(uint16_t port, const char *path) {
+  int fd = tcpConnect(port);
+  if (fd < 0) return "";
+  std::string req = std::string("GET ") + path + " HTTP/1.0\r\n\r\n";
+  sendAll(fd, req.data(), req.size());
+  std::string out;
+  char buf[4096];
+  for (;;) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 2000) <= 0) break;
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) break;
+    out.append(buf, n);
+  }
+  close(fd);
+  return out;
+}
+
+bool dialLocal(Terminal &term, uint16_t port, const char *prefix) {
+  term.drain(20);
+  term.write(std::string(prefix) + "127.0.0.1:" + std::to_string(port) + "\r");
+  return term.expect("CONNECT", 5000) && term.expect("\r\n\r\n", 500);
+}
+
+bool hangUp(Terminal &term) {
+  usleep(100000);
+  term.write("+++");
+  if (!term.expect("OK", 3000)) return false;
+  term.write("ATH\r");
+  bool ok = term.expect("NO CARRIER", 3000);
+  term.drain(50);
+  return ok;
+}
+
+long reportValue(const std::string &report, const std::string &line, const std::string &label) {
+  size_t at = report.find(line);
+  if (at == std::string::npos) return -1;
+  size_t eol = report.find('\n', at);
+  std::string text = report.substr(at, eol == std::string::npos ? std::string::npos : eol - at);
+  size_t pos = text.find(label, line.size());
+  if (pos == std::string::npos) return -1;
+
+  char last = label.back();
+  if (last == '=' || last == ':') return strtol(text.c_str() + pos + label.size(), nullptr, 10);
+  // Число перед меткой: "2 HITS"
+  size_t end = pos;
+  while (end > 0 && text[end - 1] == ' ') end--;
+  size_t start = end;
+  while (start > 0 && isdigit((unsigned char)text[start - 1])) start--;
+  return start == end ? -1 : strtol(text.c_str() + start, nullptr, 10);
+}
@@ -0,0 +1,108 @@
+#pragma once
+// Стенд для хост-тестов и замеров: прошивка в этом же процессе, терминал
+// на ведомой стороне ее псевдотерминала, локальные TCP-серверы.
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+#include <stddef.h>
+
+unsigned long millis();
+unsigned long micros();
+
+// === ПРОШИВКА ===
+
+// setup() и поток с loop(). Каталог данных - новый во /tmp, порты
+// слушателей - свободные от ядра. Только один раз на процесс.
+void modemStart();
+
+// Самая долгая итерация loop() с прошлого вызова, мкс
+unsigned long modemLoopMaxUs(bool reset = true);
+
+// Где прошивка слушает свой порт (6400 - входящие, 80 - веб, 81 - ws)
+uint16_t modemPort(uint16_t firmwarePort);
+
+// === ТЕРМИНАЛ ===
+
+class Terminal {
+public:
+  Terminal();
+  ~Terminal();
+
+  void write(const std::string &s);
+  void write(const void *buf, size_t n);
+  // Сколько пришло за timeoutMs (0 - без ожидания), в buf не больше n
+  size_t read(void *buf, size_t n, unsigned timeoutMs);
+
+  // Ждет строку; все до нее включительно снимается с входа
+  bool expect(const std::string &needle, unsigned timeoutMs = 3000);
+  // Команда и ответ до OK/ERROR включительно
+  std::string command(const std::string &cmd, unsigned timeoutMs = 3000);
+  // Все, что накопилось; ждет тишины quietMs
+  std::string drain(unsigned quietMs = 100);
+  // Полученное, но еще не снятое expect()
+  const std::string &pending() const { return in_; }
+
+private:
+  bool fill(unsigned timeoutMs);
+
+  int fd_;
+  std::string in_;
+};
+
+// Терминал тестов: при первом вызове запускает прошивку (modemStart) и
+// вычитывает приветствие. beforeStart - настройка хоста до setup(), берется
+// только в первом вызове.
+Terminal &modemTerminal(void (*beforeStart)() = nullptr);
+
+// === СЕТЬ ===
+
+// Сервер на 127.0.0.1, свободный порт; handler - в потоке на соединение.
+// Деструктор обрывает соединения и ждет выхода всех обработчиков: handler
+// должен выходить, когда recv()/send() возвращают ошибку.
+class TcpServer {
+public:
+  explicit TcpServer(std::function<void(int fd)> handler, int backlog = 16);
+  ~TcpServer();
+  uint16_t port() const { return port_; }
+  int listenFd() const { return fd_; }
+  unsigned accepted() const { return accepted_; }
+  // Перестать принимать: новые SYN копятся в очереди ядра
+  void pause() { paused_ = true; }
+
+private:
+  int fd_;
+  uint16_t port_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> paused_{false};
+  std::atomic<unsigned> accepted_{0};
+  std::thread thread_;
+  std::function<void(int)> handler_;
+  std::mutex clientsLock_;
+  std::condition_variable clientsDone_;
+  std::vector<int> clients_;
+};
+
+int tcpConnect(uint16_t port, unsigned timeoutMs = 2000);
+bool sendAll(int fd, const void *buf, size_t n);
+// Ровно n байт или меньше, если соединение закрыто или истек таймаут
+size_t recvAll(int fd, void *buf, size_t n, unsigned timeoutMs);
+// Эхо-сервер без буферизации: что пришло - сразу назад
+void echoHandler(int fd);
+
+// Ответ HTTP целиком, с заголовком; "" - не удалось соединиться
+std::string httpGet(uint16_t port, const char *path);
+
+// Звонок на 127.0.0.1:port; true - пришел CONNECT
+bool dialLocal(Terminal &term, uint16_t port, const char *prefix = "ATDT");
+// +++ с паузой S12 и ATH; true - пришел NO CARRIER или OK
+bool hangUp(Terminal &term);
+
+// Число после метки в отчете, например "HITS" в "DNS CACHE: 1 ENTRIES, 2 HITS"
+long reportValue(const std::string &report, const std::string &line, const std::string &label);
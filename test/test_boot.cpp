@@ -0,0 +1,42 @@
+// Загрузка на чистом флеше: форматирование LittleFS не задерживает OK и
+// командный режим, запись сессий доступна после монтирования
+
+#include "check.h"
+#include "harness.h"
+
+#include <host.h>
+
+#include <unistd.h>
+
+static const unsigned FORMAT_MS = 1500;
+
+static void slowFormat() {
+  hostSetFsFormatMs(FORMAT_MS);
+}
+
+TEST(commands_answer_while_formatting) {
+  unsigned long started = millis();
+  modemTerminal(slowFormat);
+  CHECK_STR(modemTerminal().command("AT", 500), "OK");
+  std::string info = modemTerminal().command("ATI");
+  CHECK(millis() - started < FORMAT_MS);
+  CHECK_STR(info, "LITTLEFS: MOUNTING");
+  CHECK_STR(modemTerminal().command("AT$CAP=1"), "ERROR");
+  CHECK(modemLoopMaxUs() < 100000);
+}
+
+TEST(capture_after_mount) {
+  usleep(FORMAT_MS * 1000);
+  CHECK_STR(modemTerminal().command("ATI"), "LITTLEFS: MOUNTED IN");
+  CHECK_STR(modemTerminal().command("AT$CAP=1"), "OK");
+  CHECK_STR(modemTerminal().command("AT$CAP=0"), "OK");
+}
+
+TEST(settings_record_version) {
+  CHECK_STR(modemTerminal().command("ATI"), "SETTINGS");
+  CHECK_STR(modemTerminal().command("AT$SSID=bootnet"), "OK");
+  CHECK_STR(modemTerminal().command("AT&W"), "OK");
+  CHECK_STR(modemTerminal().command("ATZ"), "OK");
+  CHECK_STR(modemTerminal().command("AT$SSID?"), "bootnet");
+  CHECK_STR(modemTerminal().command("ATI"), "(RECORD)");
+}
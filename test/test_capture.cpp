@@ -0,0 +1,157 @@
+// Запись сессий (AT$CAP): фоновые сессии тоже пишутся, файл читает capdump,
+// воспроизведение фильтрует по сессии
+
+#include "check.h"
+#include "harness.h"
+
+#include <capture.h>
+#include <host.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Вывод capdump с аргументами args над файлом записи
+static std::string capdump(const std::string &args) {
+  std::string cmd = std::string(CAPDUMP) + " " + args + " " + hostDataDir() + "/littlefs/capture.wmc";
+  FILE *fp = popen(cmd.c_str(), "r");
+  if (!fp) return "";
+  std::string out;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) out.append(buf, n);
+  pclose(fp);
+  return out;
+}
+
+// Запись дописана и закрыта captureTask
+static bool captureClosed() {
+  for (int i = 0; i < 50; i++) {
+    if (modemTerminal().command("AT$CAP?").find("CAPTURE: OFF") != std::string::npos) return true;
+    usleep(50000);
+  }
+  return false;
+}
+
+TEST(varint_round_trip) {
+  const uint32_t values[] = {0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, 0xFFFFFFFF};
+  for (uint32_t v : values) {
+    CaptureRecord rec = {true, 5, v, v ^ 0x5A5A5A5A}, back;
+    uint8_t hdr[CAP_HDR_MAX];
+    size_t n = captureEncodeHeader(hdr, rec);
+    CHECK(n <= CAP_HDR_MAX);
+    CHECK_EQ(captureDecodeHeader(hdr, n, back), n);
+    CHECK_EQ(captureDecodeHeader(hdr, n - 1, back), (size_t)0); // заголовок не целиком
+    CHECK(back.outbound && back.session == 5);
+    CHECK_EQ(back.deltaUs, v);
+    CHECK_EQ(back.length, v ^ 0x5A5A5A5A);
+  }
+}
+
+// Сессия 0 уходит в фон и там получает данные: они в записи с ее номером,
+// хотя до терминала дошли уже после остановки записи
+TEST(background_session_recorded) {
+  TcpServer late([](int fd) {
+    usleep(3000000); // к этому времени на линии уже вторая сессия
+    const char text[] = "BACKGROUND-DATA";
+    sendAll(fd, text, sizeof(text) - 1);
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+  TcpServer echo(echoHandler);
+
+  CHECK_STR(modemTerminal().command("AT$CAP=1"), "OK");
+  CHECK(dialLocal(modemTerminal(), late.port()));
+  usleep(1100000);
+  modemTerminal().write("+++");
+  CHECK(modemTerminal().expect("OK"));
+  CHECK(dialLocal(modemTerminal(), echo.port()));
+  modemTerminal().write("HELLO-ECHO");
+  CHECK(modemTerminal().expect("HELLO-ECHO"));
+  usleep(1000000);
+  CHECK(hangUp(modemTerminal()));
+  CHECK_STR(modemTerminal().command("AT$CAP=0"), "OK"); // до возврата в сессию 0
+  CHECK(captureClosed());
+  modemTerminal().write("ATO0\r");
+  CHECK(modemTerminal().expect("CONNECT"));
+  CHECK(modemTerminal().expect("BACKGROUND-DATA"));
+  CHECK(hangUp(modemTerminal()));
+
+  std::string listing = capdump("");
+  CHECK_STR(listing, " in  s0 ");
+  CHECK_STR(listing, " in  s1 ");
+  CHECK_STR(listing, " out s1 ");
+  CHECK(capdump("--raw --session 0").find("BACKGROUND-DATA") != std::string::npos);
+  CHECK(capdump("--raw --session 0").find("HELLO-ECHO") == std::string::npos);
+  CHECK(capdump("--raw --session 1").find("HELLO-ECHO") != std::string::npos);
+}
+
+// Воспроизведение только сессии 1: эхо есть, фоновых данных нет
+TEST(replay_filters_session) {
+  modemTerminal().write("AT$PLAY=0,1\r");
+  std::string shown = modemTerminal().drain(500);
+  size_t echoAt = shown.find("HELLO-ECHO");
+  CHECK(echoAt != std::string::npos);
+  CHECK(shown.find("\r\nOK\r\n", echoAt) != std::string::npos); // OK - после записи
+  CHECK(shown.find("OK") > echoAt);
+  CHECK(shown.find("BACKGROUND-DATA") == std::string::npos);
+  CHECK_STR(modemTerminal().command("AT$PLAY=0,8"), "ERROR");
+}
+
+// Поток крупнее буфера записи: ничего не потеряно и не обрезано
+TEST(long_stream_complete) {
+  std::string data;
+  for (int i = 0; data.size() < 12000; i++) data += "LINE " + std::to_string(i) + "\r\n";
+  TcpServer source([&](int fd) {
+    for (size_t at = 0; at < data.size(); at += 1000) {
+      sendAll(fd, data.data() + at, std::min((size_t)1000, data.size() - at));
+      usleep(20000); // флеш успевает, записи не теряются
+    }
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+  CHECK_STR(modemTerminal().command("AT$CAP=1"), "OK");
+  CHECK(dialLocal(modemTerminal(), source.port()));
+  CHECK(modemTerminal().expect("LINE 0"));
+  usleep(1000000);
+  CHECK(hangUp(modemTerminal()));
+  CHECK_STR(modemTerminal().command("AT$CAP=0"), "OK");
+  CHECK(captureClosed());
+  CHECK_STR(modemTerminal().command("AT$CAP?"), " 0 DROPPED");
+  CHECK(capdump("--raw") == data);
+
+  // Без пауз запись обгоняет USB: OK ждет, пока serialOut опустеет
+  modemTerminal().write("AT$PLAY=0\r");
+  std::string shown;
+  char buf[4096];
+  while (shown.find("\r\nOK\r\n") == std::string::npos) {
+    size_t n = modemTerminal().read(buf, sizeof(buf), 2000);
+    if (n == 0) break;
+    shown.append(buf, n);
+    usleep(2000);
+  }
+  size_t at = shown.find(data);
+  CHECK(at != std::string::npos);
+  CHECK_EQ(shown.find("\r\nOK\r\n"), at + data.size());
+}
+
+// Звонок во время воспроизведения ждет: ни RING, ни автоответа, пока
+// воспроизведение не кончится
+TEST(call_waits_for_replay) {
+  CHECK_STR(modemTerminal().command("ATS0=1"), "OK");
+  modemTerminal().write("AT$PLAY=1\r");
+  CHECK(modemTerminal().expect("LINE 0"));
+  int caller = tcpConnect(modemPort(6400));
+  CHECK(caller >= 0);
+  std::string during = modemTerminal().drain(800);
+  CHECK(during.find("RING") == std::string::npos);
+  CHECK(during.find("CONNECT") == std::string::npos);
+  modemTerminal().write("\r"); // любая клавиша прерывает воспроизведение
+  CHECK(modemTerminal().expect("OK"));
+  CHECK(modemTerminal().expect("RING"));
+  CHECK(modemTerminal().expect("CONNECT"));
+  CHECK(hangUp(modemTerminal()));
+  close(caller);
+  CHECK_STR(modemTerminal().command("ATS0=0"), "OK");
+}
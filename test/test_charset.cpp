@@ -0,0 +1,120 @@
+// CharsetTranslator: таблицы, CP437 <-> UTF-8 с разрезанными между
+// буферами последовательностями, ограниченный выход
+
+#include "check.h"
+
+#include <charset.h>
+
+#include <random>
+#include <vector>
+
+static std::vector<uint8_t> allBytes() {
+  std::vector<uint8_t> v(256);
+  for (int i = 0; i < 256; i++) v[i] = i;
+  return v;
+}
+
+// Сеть -> терминал целиком
+static std::vector<uint8_t> toUtf8(const std::vector<uint8_t> &in) {
+  std::vector<uint8_t> out(in.size() * 3);
+  size_t consumed;
+  size_t n = CharsetTranslator::toTerminal(CS_CP437_UTF8, in.data(), in.size(), out.data(), out.size(), consumed);
+  out.resize(n);
+  return out;
+}
+
+TEST(cp437_round_trip_whole) {
+  std::vector<uint8_t> src = allBytes();
+  std::vector<uint8_t> utf = toUtf8(src);
+  CHECK(utf.size() > 256 + 128);
+  CharsetTranslator t;
+  std::vector<uint8_t> back(utf.size());
+  back.resize(t.fromTerminal(CS_CP437_UTF8, utf.data(), utf.size(), back.data()));
+  CHECK(back == src);
+}
+
+// Каждая точка разреза, в том числе посреди многобайтной последовательности
+TEST(utf8_split_at_every_offset) {
+  std::vector<uint8_t> src = allBytes();
+  std::vector<uint8_t> utf = toUtf8(src);
+  for (size_t cut = 0; cut <= utf.size(); cut++) {
+    CharsetTranslator t;
+    std::vector<uint8_t> back(utf.size());
+    size_t n = t.fromTerminal(CS_CP437_UTF8, utf.data(), cut, back.data());
+    n += t.fromTerminal(CS_CP437_UTF8, utf.data() + cut, utf.size() - cut, back.data() + n);
+    back.resize(n);
+    CHECK(back == src);
+  }
+}
+
+TEST(utf8_random_fragments) {
+  std::mt19937 rnd(7);
+  std::vector<uint8_t> src(64 * 1024);
+  for (uint8_t &c : src) c = rnd();
+  std::vector<uint8_t> utf = toUtf8(src);
+  CharsetTranslator t;
+  std::vector<uint8_t> back(utf.size());
+  size_t i = 0, n = 0;
+  while (i < utf.size()) {
+    size_t len = std::min<size_t>(1 + rnd() % 5, utf.size() - i);
+    n += t.fromTerminal(CS_CP437_UTF8, utf.data() + i, len, back.data() + n);
+    i += len;
+  }
+  back.resize(n);
+  CHECK(back == src);
+}
+
+// Выход кончился: последовательность не режется, consumed - сколько взято
+TEST(cp437_out_limit_keeps_sequences) {
+  const uint8_t in[] = {'a', 0xDB, 0xDB, 'b'}; // █ = E2 96 88
+  uint8_t out[16];
+  size_t consumed;
+  size_t n = CharsetTranslator::toTerminal(CS_CP437_UTF8, in, sizeof(in), out, 5, consumed);
+  CHECK_EQ(n, (size_t)4);
+  CHECK_EQ(consumed, (size_t)2);
+  n = CharsetTranslator::toTerminal(CS_CP437_UTF8, in + consumed, sizeof(in) - consumed, out, 3, consumed);
+  CHECK_EQ(n, (size_t)3);
+  CHECK_EQ(consumed, (size_t)1);
+}
+
+TEST(broken_utf8_recovers) {
+  CharsetTranslator t;
+  // одиночное продолжение, оборванное начало, затем обычный текст
+  const uint8_t in[] = {0x80, 'x', 0xE2, 0x96, 'y', 0xC3, 0xA9};
+  uint8_t out[16];
+  size_t n = t.fromTerminal(CS_CP437_UTF8, in, sizeof(in), out);
+  CHECK_EQ(n, (size_t)3);
+  CHECK_EQ(out[0], 'x');
+  CHECK_EQ(out[1], 'y');
+  CHECK_EQ(out[2], 0x82); // é
+  // Незнакомый символ - '?'
+  const uint8_t euro[] = {0xE2, 0x82, 0xAC};
+  CHECK_EQ(t.fromTerminal(CS_CP437_UTF8, euro, 3, out), (size_t)1);
+  CHECK_EQ(out[0], '?');
+}
+
+TEST(petscii_letters_and_controls) {
+  CharsetTranslator t;
+  const uint8_t text[] = "Hello\r\n\b";
+  uint8_t pet[16], back[16];
+  size_t consumed;
+  size_t n = CharsetTranslator::toTerminal(CS_PETSCII, text, 8, pet, sizeof(pet), consumed);
+  CHECK_EQ(n, (size_t)7); // LF выброшен
+  CHECK_EQ(pet[0], 0xC8);
+  CHECK_EQ(pet[1], 0x45);
+  CHECK_EQ(pet[6], 0x14);
+  n = t.fromTerminal(CS_PETSCII, pet, n, back);
+  CHECK(std::string((char *)back, n) == "Hello\r\b");
+}
+
+TEST(atascii_end_of_line) {
+  CharsetTranslator t;
+  const uint8_t text[] = "ok\r\n";
+  uint8_t at[8], back[8];
+  size_t consumed;
+  size_t n = CharsetTranslator::toTerminal(CS_ATASCII, text, 4, at, sizeof(at), consumed);
+  CHECK_EQ(n, (size_t)3);
+  CHECK_EQ(at[2], 0x9B);
+  n = t.fromTerminal(CS_ATASCII, at, n, back);
+  CHECK(std::string((char *)back, n) == "ok\r");
+}
@@ -0,0 +1,52 @@
+// Разбор AT-строк: цепочки, S-регистры, ошибка посреди цепочки
+
+#include "check.h"
+#include "harness.h"
+
+#include <unistd.h>
+
+TEST(chained_line) {
+  CHECK_STR(modemTerminal().command("ATE1V1S0=2S7=45"), "OK");
+  CHECK_STR(modemTerminal().command("ATS0?"), "002");
+  CHECK_STR(modemTerminal().command("ATS7?"), "045");
+  CHECK_STR(modemTerminal().command("ATS0=0"), "OK");
+}
+
+TEST(lowercase_and_spaces) {
+  CHECK_STR(modemTerminal().command("at s7=50 e1"), "OK");
+  CHECK_STR(modemTerminal().command("ats7?"), "050");
+}
+
+TEST(error_stops_chain) {
+  CHECK_STR(modemTerminal().command("ATS7=40"), "OK");
+  // S7=300 вне диапазона: S0=3 после нее не выполняется
+  CHECK_STR(modemTerminal().command("ATS7=300S0=3"), "ERROR");
+  CHECK_STR(modemTerminal().command("ATS7?"), "040");
+  CHECK_STR(modemTerminal().command("ATS0?"), "000");
+}
+
+TEST(unknown_command_is_error) {
+  CHECK_STR(modemTerminal().command("ATQQ"), "ERROR");
+  CHECK_STR(modemTerminal().command("AT"), "OK");
+}
+
+TEST(string_argument_ends_chain) {
+  CHECK_STR(modemTerminal().command("ATS7=30$BM=BUSY S0=1"), "BUSY MESSAGE SET: BUSY S0=1");
+  CHECK_STR(modemTerminal().command("AT$BM?"), "BUSY S0=1");
+  CHECK_STR(modemTerminal().command("ATS0?"), "000");
+}
+
+TEST(escape_register_changes_escape) {
+  TcpServer echo(echoHandler);
+  CHECK_STR(modemTerminal().command("ATS2=35"), "OK"); // '#'
+  CHECK(dialLocal(modemTerminal(), echo.port()));
+  modemTerminal().write("a+++b");
+  CHECK(modemTerminal().expect("a+++b"));
+  usleep(1100000);
+  modemTerminal().write("###");
+  CHECK(modemTerminal().expect("OK"));
+  modemTerminal().write("ATH\r");
+  CHECK(modemTerminal().expect("NO CARRIER"));
+  modemTerminal().drain(50);
+  CHECK_STR(modemTerminal().command("ATS2=43"), "OK");
+}
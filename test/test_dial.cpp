@@ -0,0 +1,110 @@
+// Неблокирующий набор: сервер, который теряет SYN, медленный DNS, отбой
+// клавишей. loop() при этом не должен замирать.
+
+#include "check.h"
+#include "harness.h"
+
+#include <host.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Предел одного прохода loop(), мкс. В замер входит delay(1) в конце
+// loop() и вытеснение другими задачами на хосте; блокирующий connect()
+// дал бы секунды (S7).
+static const unsigned long LOOP_LIMIT_US = 50000;
+
+// Сервер не принимает, очередь ядра забита: новые SYN молча теряются
+struct SynDropServer {
+  TcpServer server{nullptr, 0};
+  std::vector<int> fillers;
+
+  SynDropServer() {
+    server.pause();
+    for (int i = 0; i < 4; i++) {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons(server.port());
+      connect(fd, (sockaddr *)&addr, sizeof(addr));
+      fillers.push_back(fd);
+    }
+    usleep(50000);
+  }
+  ~SynDropServer() {
+    for (int fd : fillers) close(fd);
+  }
+  // Проверка стенда: соединение не устанавливается
+  bool dropping() {
+    int fd = tcpConnect(server.port(), 300);
+    if (fd >= 0) close(fd);
+    return fd < 0;
+  }
+};
+
+TEST(syn_drop_times_out) {
+  SynDropServer dead;
+  CHECK(dead.dropping());
+  CHECK_STR(modemTerminal().command("ATS7=2"), "OK");
+  modemLoopMaxUs();
+  unsigned long started = millis();
+  modemTerminal().write("ATDT127.0.0.1:" + std::to_string(dead.server.port()) + "\r");
+  CHECK(modemTerminal().expect("NO ANSWER", 5000));
+  unsigned long took = millis() - started;
+  CHECK(took >= 1900 && took < 3500);
+  unsigned long worst = modemLoopMaxUs();
+  printf("  NO ANSWER after %lu ms, worst loop() %lu us\n", took, worst);
+  CHECK(worst < LOOP_LIMIT_US);
+  CHECK_STR(modemTerminal().command("ATS7=30"), "OK");
+}
+
+TEST(keypress_aborts_connect) {
+  SynDropServer dead;
+  CHECK(dead.dropping());
+  modemTerminal().drain(20);
+  modemTerminal().write("ATDT127.0.0.1:" + std::to_string(dead.server.port()) + "\r");
+  CHECK(modemTerminal().expect("DIALING", 2000));
+  usleep(300000);
+  unsigned long started = millis();
+  modemTerminal().write("x");
+  CHECK(modemTerminal().expect("NO CARRIER", 1000));
+  CHECK(millis() - started < 500);
+  // Модем снова в командном режиме, нажатая клавиша никуда не ушла
+  CHECK_STR(modemTerminal().command("AT"), "OK");
+  CHECK_STR(modemTerminal().command("ATI"), "CALL STATUS: NOT CONNECTED");
+}
+
+TEST(slow_dns_keeps_loop_running) {
+  TcpServer echo(echoHandler);
+  hostResolverAdd("slow.bbs", htonl(INADDR_LOOPBACK), 800);
+  modemLoopMaxUs();
+  modemTerminal().drain(20);
+  modemTerminal().write("ATDTslow.bbs:" + std::to_string(echo.port()) + "\r");
+  // Пока имя резолвится, веб-сервер отвечает
+  usleep(200000);
+  int web = tcpConnect(modemPort(80), 500);
+  CHECK(web >= 0);
+  const char req[] = "GET / HTTP/1.0\r\n\r\n";
+  sendAll(web, req, sizeof(req) - 1);
+  char head[16] = {};
+  recvAll(web, head, 12, 500);
+  close(web);
+  CHECK_STR(std::string(head), "HTTP/1.1 200");
+  CHECK(modemTerminal().expect("CONNECT", 3000));
+  CHECK(modemLoopMaxUs() < LOOP_LIMIT_US);
+  CHECK(hangUp(modemTerminal()));
+  hostResolverRemove("slow.bbs");
+}
+
+TEST(unknown_host_no_answer) {
+  hostResolverAdd("nowhere.bbs", 0);
+  modemTerminal().drain(20);
+  modemTerminal().write("ATDTnowhere.bbs\r");
+  CHECK(modemTerminal().expect("NO ANSWER", 3000));
+  hostResolverRemove("nowhere.bbs");
+}
@@ -0,0 +1,105 @@
+// Кэш DNS на подставном резолвере: попадания, срок жизни (AT$DNSTTL),
+// прогрев имен самых частых быстрых номеров и его повтор до истечения срока
+
+#include "check.h"
+#include "harness.h"
+
+#include <host.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+// Звонок в закрытый порт: резолв, connect() получает отказ, NO ANSWER
+static bool dialRefused(const std::string &host) {
+  modemTerminal().drain(20);
+  modemTerminal().write("ATDT" + host + ":1\r");
+  return modemTerminal().expect("NO ANSWER", 3000);
+}
+
+static long dnsStat(const char *label) {
+  return reportValue(modemTerminal().command("ATI"), "DNS CACHE:", label);
+}
+
+TEST(second_dial_hits_cache) {
+  hostResolverAdd("hit.bbs", htonl(INADDR_LOOPBACK));
+  long hits = dnsStat("HITS");
+  CHECK(dialRefused("hit.bbs"));
+  CHECK(dialRefused("hit.bbs"));
+  CHECK_EQ(hostResolverQueries("hit.bbs"), 1u);
+  CHECK_EQ(dnsStat("HITS"), hits + 1);
+  CHECK_STR(modemTerminal().command("ATI"), "TTL 60 S");
+}
+
+TEST(entry_expires_after_ttl) {
+  hostResolverAdd("short.bbs", htonl(INADDR_LOOPBACK));
+  CHECK_STR(modemTerminal().command("AT$DNSTTL=1"), "OK");
+  CHECK(dialRefused("short.bbs"));
+  CHECK(dialRefused("short.bbs"));
+  CHECK_EQ(hostResolverQueries("short.bbs"), 1u);
+  usleep(1200000);
+  CHECK(dialRefused("short.bbs"));
+  CHECK_EQ(hostResolverQueries("short.bbs"), 2u);
+  CHECK_STR(modemTerminal().command("AT$DNSTTL=60"), "OK");
+}
+
+TEST(ttl_zero_disables_cache) {
+  hostResolverAdd("nocache.bbs", htonl(INADDR_LOOPBACK));
+  CHECK_STR(modemTerminal().command("AT$DNSTTL=0"), "OK");
+  CHECK(dialRefused("nocache.bbs"));
+  CHECK(dialRefused("nocache.bbs"));
+  CHECK_EQ(hostResolverQueries("nocache.bbs"), 2u);
+  CHECK_EQ(dnsStat("ENTRIES"), 0L);
+  CHECK_STR(modemTerminal().command("AT$DNSTTL?"), "0");
+  CHECK_STR(modemTerminal().command("AT$DNSTTL=60"), "OK");
+}
+
+// Десять быстрых номеров на восемь мест: прогрев после ATC1 берет только
+// DNS_PREFETCH_MAX самых частых, остальное место - ручным звонкам
+TEST(prefetch_fits_cache) {
+  for (int i = 0; i < 10; i++) {
+    std::string name = "z" + std::to_string(i) + ".bbs";
+    hostResolverAdd(name.c_str(), htonl(INADDR_LOOPBACK));
+    CHECK_STR(modemTerminal().command("AT&Z" + std::to_string(i) + "=" + name + ":1"), "SET");
+  }
+  modemTerminal().write("ATDS9\r");
+  CHECK(modemTerminal().expect("NO ANSWER", 3000));
+  CHECK_STR(modemTerminal().command("ATC0"), "OK");
+  CHECK_STR(modemTerminal().command("ATC1"), "OK");
+  for (int tries = 0; tries < 100 && hostResolverQueries("z2.bbs") == 0; tries++) usleep(20000);
+  usleep(50000);
+  CHECK_EQ(hostResolverQueries("z9.bbs"), 2u); // звонил чаще всех - первым
+  for (int i = 0; i < 9; i++) {
+    std::string name = "z" + std::to_string(i) + ".bbs";
+    CHECK_EQ(hostResolverQueries(name.c_str()), i < 3 ? 1u : 0u);
+  }
+
+  CHECK(dialRefused("z0.bbs"));
+  CHECK_EQ(hostResolverQueries("z0.bbs"), 1u);
+}
+
+// Прогрев повторяется на 3/4 срока жизни: ATDS после истечения первой
+// записи все равно попадает в кэш
+TEST(prefetch_repeats_before_expiry) {
+  CHECK_STR(modemTerminal().command("AT$DNSTTL=2"), "OK");
+  unsigned before = hostResolverQueries("z0.bbs");
+  usleep(3500000);
+  CHECK(hostResolverQueries("z0.bbs") >= before + 2);
+  unsigned queries = hostResolverQueries("z0.bbs");
+  long hits = dnsStat("HITS");
+  modemTerminal().write("ATDS0\r");
+  CHECK(modemTerminal().expect("NO ANSWER", 3000));
+  CHECK(hostResolverQueries("z0.bbs") <= queries + 1); // разве что очередной проход прогрева
+  CHECK_EQ(dnsStat("HITS"), hits + 1);
+  CHECK_STR(modemTerminal().command("AT$DNSTTL=60"), "OK");
+}
+
+TEST(ttl_saved_with_settings) {
+  CHECK_STR(modemTerminal().command("AT$DNSTTL=120"), "OK");
+  CHECK_STR(modemTerminal().command("AT&W"), "OK");
+  CHECK_STR(modemTerminal().command("AT$DNSTTL=5"), "OK");
+  CHECK_STR(modemTerminal().command("ATZ"), "OK");
+  CHECK_STR(modemTerminal().command("AT$DNSTTL?"), "120");
+  CHECK_STR(modemTerminal().command("AT&F"), "OK");
+  CHECK_STR(modemTerminal().command("AT$DNSTTL?"), "60");
+}
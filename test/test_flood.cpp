@@ -0,0 +1,86 @@
+// Флуд входящих звонков на порт 6400 во время активного звонка: эхо не
+// теряется и не становится заметно медленнее, флуд отсекается лимитами
+
+#include "check.h"
+#include "harness.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+static const int FLOOD_THREADS = 4;
+static const int ECHO_SAMPLES = 400;
+
+// Эхо по одному символу; p99 в мкс или 0, если ответ не пришел или не тот
+static unsigned long echoP99() {
+  std::vector<unsigned long> samples;
+  for (int i = 0; i < ECHO_SAMPLES; i++) {
+    char c = 'a' + i % 26, back = 0;
+    unsigned long started = micros();
+    modemTerminal().write(&c, 1);
+    if (modemTerminal().read(&back, 1, 1000) != 1 || back != c) return 0;
+    samples.push_back(micros() - started);
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() * 99 / 100];
+}
+
+// ATI целиком: command() остановился бы на "ERROR" внутри отчета
+static std::string modemInfo() {
+  modemTerminal().write("ATI\r");
+  return modemTerminal().drain(300);
+}
+
+static long calls(const std::string &info) {
+  return std::max(reportValue(info, "LISTENER:", "CALLS"), 0L);
+}
+
+static long rejected(const std::string &info) {
+  return std::max(reportValue(info, "REJECTED:", "RATE LIMITED"), 0L) +
+         std::max(reportValue(info, "REJECTED:", "THROTTLED"), 0L) +
+         std::max(reportValue(info, "REJECTED:", "BUSY"), 0L) +
+         std::max(reportValue(info, "REJECTED:", "QUEUE FULL"), 0L);
+}
+
+TEST(echo_latency_under_call_flood) {
+  std::string before = modemInfo();
+  TcpServer echo(echoHandler);
+  CHECK(dialLocal(modemTerminal(), echo.port()));
+  unsigned long quiet = echoP99();
+  CHECK(quiet > 0);
+
+  // Очередь SYN (LISTEN_BACKLOG) заполняется быстрее, чем loop() ее
+  // выбирает: лишние SYN отбрасывает стек, поэтому ждем connect() недолго
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> flood;
+  for (int i = 0; i < FLOOD_THREADS; i++) {
+    flood.emplace_back([&] {
+      while (!stop) {
+        int fd = tcpConnect(modemPort(6400), 20);
+        if (fd >= 0) close(fd);
+      }
+    });
+  }
+  usleep(200000); // флуд уже идет
+  modemLoopMaxUs();
+  unsigned long flooded = echoP99();
+  unsigned long worst = modemLoopMaxUs();
+  stop = true;
+  for (std::thread &t : flood) t.join();
+
+  CHECK(flooded > 0);
+  CHECK(hangUp(modemTerminal()));
+  std::string after = modemInfo();
+  long floodCalls = calls(after) - calls(before);
+  printf("  echo p99 %lu us quiet, %lu us under %ld calls, worst loop() %lu us\n", quiet, flooded, floodCalls,
+         worst);
+  CHECK(floodCalls > 100);
+  CHECK_EQ(rejected(after) - rejected(before), floodCalls); // звонок занят: ни один не принят
+  // На одном ядре флуд-потоки делят процессор с модемом: запас в 4 раза и
+  // 5 мс, но не десятки миллисекунд, как при accept() в netTask
+  CHECK(flooded < quiet * 4 + 5000);
+  CHECK(worst < 50000);
+}
@@ -0,0 +1,194 @@
+// Управление потоком из конца в конец: медленный сервер, медленный
+// терминал, XON/XOFF. Ни один байт не должен потеряться.
+
+#include "check.h"
+#include "harness.h"
+
+#include <mutex>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Печатный текст без '+', 0xFF и XON/XOFF, с номером позиции внутри
+static std::vector<uint8_t> payload(size_t n) {
+  std::vector<uint8_t> data(n);
+  for (size_t i = 0; i < n; i++) data[i] = (i % 64 == 63) ? '\n' : 'a' + (i * 7 + i / 64) % 26;
+  return data;
+}
+
+static size_t firstDiff(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+  size_t n = std::min(a.size(), b.size());
+  for (size_t i = 0; i < n; i++) {
+    if (a[i] != b[i]) return i;
+  }
+  return a.size() == b.size() ? std::string::npos : n;
+}
+
+// Терминал вставляет полмегабайта; сервер с маленьким окном читает по
+// 2 КБ раз в 5 мс, так что буферы ядра и модема быстро заполняются
+TEST(paste_to_slow_server) {
+  const std::vector<uint8_t> data = payload(512 * 1024);
+  std::vector<uint8_t> received;
+  std::mutex lock;
+  TcpServer slow([&](int fd) {
+    int small = 16384;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    char buf[2048];
+    for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) break;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        received.insert(received.end(), buf, buf + n);
+      }
+      usleep(5000);
+    }
+  });
+  CHECK(dialLocal(modemTerminal(), slow.port()));
+  modemTerminal().write(data.data(), data.size());
+  for (int i = 0; i < 300; i++) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (received.size() >= data.size()) break;
+    }
+    usleep(100000);
+  }
+  CHECK(hangUp(modemTerminal()));
+  std::lock_guard<std::mutex> guard(lock);
+  // Первые символы +++ уходят в линию, как у Hayes: модем еще не знает,
+  // что это переход в командный режим
+  while (received.size() > data.size() && received.back() == '+') received.pop_back();
+  CHECK_EQ(received.size(), data.size());
+  CHECK_EQ(firstDiff(received, data), std::string::npos);
+}
+
+// ZMODEM с терминала через telnet на медленный сервер: WILL/DO BINARY из
+// начала передачи и удвоенные 0xFF не должны потеряться, когда tx полон
+TEST(zmodem_upload_over_telnet) {
+  std::vector<uint8_t> data = {'*', '*', 0x18, 'B', '0', '0', '\r', '\n'};
+  for (uint32_t i = 0, x = 1; i < 256 * 1024; i++) {
+    x = x * 1103515245 + 12345;
+    data.push_back(i % 97 == 0 ? 0xFF : x >> 23);
+  }
+  std::vector<uint8_t> raw;
+  std::mutex lock;
+  TcpServer slow([&](int fd) {
+    int small = 16384;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    char buf[2048];
+    for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) break;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        raw.insert(raw.end(), buf, buf + n);
+      }
+      usleep(2000);
+    }
+  });
+  CHECK_STR(modemTerminal().command("ATNET1"), "OK");
+  CHECK(dialLocal(modemTerminal(), slow.port()));
+  modemTerminal().write(data.data(), data.size());
+
+  // Разбор telnet на стороне сервера: IAC IAC - 0xFF, IAC WILL/DO x - опция
+  std::vector<uint8_t> received;
+  int binaryRequests = 0;
+  for (int i = 0; i < 300 && received.size() < data.size(); i++) {
+    usleep(100000);
+    std::lock_guard<std::mutex> guard(lock);
+    received.clear();
+    binaryRequests = 0;
+    for (size_t at = 0; at < raw.size(); at++) {
+      if (raw[at] != 0xFF || at + 1 >= raw.size()) {
+        received.push_back(raw[at]);
+      } else if (raw[at + 1] == 0xFF) {
+        received.push_back(0xFF);
+        at++;
+      } else if (at + 2 < raw.size()) {
+        if (raw[at + 2] == 0) binaryRequests++;
+        at += 2;
+      }
+    }
+  }
+  CHECK_EQ(binaryRequests, 2);
+  CHECK_EQ(received.size(), data.size());
+  CHECK_EQ(firstDiff(received, data), std::string::npos);
+  usleep(3200000); // конец передачи - пауза XFER_IDLE_MS, до нее +++ не ищется
+  CHECK(hangUp(modemTerminal()));
+  CHECK_STR(modemTerminal().command("ATNET0"), "OK");
+}
+
+// Сервер шлет мегабайт сразу, терминал читает по 1 КБ раз в 2 мс
+TEST(download_to_slow_terminal) {
+  const std::vector<uint8_t> data = payload(1024 * 1024);
+  TcpServer fast([&](int fd) {
+    sendAll(fd, data.data(), data.size());
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+  CHECK_STR(modemTerminal().command("AT&K3"), "OK");
+  CHECK(dialLocal(modemTerminal(), fast.port()));
+  std::vector<uint8_t> got;
+  char buf[1024];
+  while (got.size() < data.size()) {
+    size_t n = modemTerminal().read(buf, sizeof(buf), 3000);
+    if (n == 0) break;
+    got.insert(got.end(), buf, buf + n);
+    usleep(2000);
+  }
+  CHECK(hangUp(modemTerminal()));
+  CHECK_EQ(got.size(), data.size());
+  CHECK_EQ(firstDiff(got, data), std::string::npos);
+}
+
+// AT&K4: после XOFF модем молчит, после XON отдает все, что накопил
+TEST(xoff_holds_output) {
+  const std::vector<uint8_t> data = payload(64 * 1024);
+  std::atomic<bool> go{false};
+  TcpServer source([&](int fd) {
+    while (!go) usleep(1000);
+    sendAll(fd, data.data(), data.size());
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+  CHECK_STR(modemTerminal().command("AT&K4"), "OK");
+  CHECK(dialLocal(modemTerminal(), source.port()));
+  modemTerminal().write("\x13");
+  usleep(50000);
+  go = true;
+  char buf[4096];
+  CHECK_EQ(modemTerminal().read(buf, sizeof(buf), 500), (size_t)0);
+
+  modemTerminal().write("\x11");
+  std::vector<uint8_t> got;
+  while (got.size() < data.size()) {
+    size_t n = modemTerminal().read(buf, sizeof(buf), 2000);
+    if (n == 0) break;
+    got.insert(got.end(), buf, buf + n);
+  }
+  CHECK(hangUp(modemTerminal()));
+  CHECK_STR(modemTerminal().command("AT&K3"), "OK");
+  CHECK_EQ(got.size(), data.size());
+  CHECK_EQ(firstDiff(got, data), std::string::npos);
+}
+
+// Сервер шлет блок и сразу закрывает соединение; терминал читает медленно,
+// так что хвост еще ждет в serialOut. NO CARRIER - строго после него.
+TEST(no_carrier_after_last_byte) {
+  const std::vector<uint8_t> data = payload(256 * 1024);
+  TcpServer goodbye([&](int fd) { sendAll(fd, data.data(), data.size()); });
+  CHECK(dialLocal(modemTerminal(), goodbye.port()));
+  std::string got;
+  char buf[1024];
+  while (got.find("NO CARRIER") == std::string::npos) {
+    size_t n = modemTerminal().read(buf, sizeof(buf), 3000);
+    if (n == 0) break;
+    got.append(buf, n);
+    usleep(2000);
+  }
+  size_t at = got.find("NO CARRIER");
+  CHECK(at != std::string::npos);
+  CHECK_EQ(at, data.size() + 2); // "\r\n" перед результатом
+  CHECK(got.compare(0, data.size(), std::string(data.begin(), data.end())) == 0);
+  modemTerminal().drain(100);
+}
@@ -0,0 +1,95 @@
+// История приема: поток за время командного режима доходит после ATO без
+// пропусков и повторов; выдача AT$HIST не перебивается звонком
+
+#include "check.h"
+#include "harness.h"
+
+#include <regex>
+#include <string>
+
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const int LINES = 80000;
+
+static std::string numberedLine(int i) {
+  char line[16];
+  snprintf(line, sizeof(line), "%06d\r\n", i);
+  return line;
+}
+
+// Строки 000000..LINES-1 по 400 штук раз в 20 мс, около 4 с
+static void numberedSource(int fd) {
+  std::string batch;
+  for (int i = 0; i < LINES; i++) {
+    batch += numberedLine(i);
+    if (i % 400 == 399 || i == LINES - 1) {
+      if (!sendAll(fd, batch.data(), batch.size())) return;
+      batch.clear();
+      usleep(20000);
+    }
+  }
+  char c;
+  while (recv(fd, &c, 1, 0) > 0) {}
+}
+
+static std::string expectedStream() {
+  std::string all;
+  for (int i = 0; i < LINES; i++) all += numberedLine(i);
+  return all;
+}
+
+TEST(stream_survives_escape_and_ato) {
+  TcpServer source(numberedSource);
+  CHECK_STR(modemTerminal().command("ATE0"), "OK");
+  CHECK(dialLocal(modemTerminal(), source.port()));
+
+  std::string got = modemTerminal().pending();
+  char buf[65536];
+  unsigned long started = millis();
+  while (millis() - started < 500) got.append(buf, modemTerminal().read(buf, sizeof(buf), 100));
+  modemTerminal().write("+++");
+  while (got.find("\r\nOK\r\n") == std::string::npos && millis() - started < 5000)
+    got.append(buf, modemTerminal().read(buf, sizeof(buf), 100));
+  usleep(1000000); // поток копится в истории
+  modemTerminal().write("ATO\r");
+  std::string last = numberedLine(LINES - 1);
+  while (got.find(last) == std::string::npos && millis() - started < 30000) {
+    size_t n = modemTerminal().read(buf, sizeof(buf), 2000);
+    if (n == 0) break;
+    got.append(buf, n);
+  }
+
+  // Ответы модема вставлены в поток целиком, без них - ровно исходный поток.
+  // Перед CONNECT - перевод строки после команды ATO.
+  got = std::regex_replace(got, std::regex("\r\nOK\r\n\r\n|(\r\n)?\r\nCONNECT[^\r]*\r\n\r\n"), "");
+  CHECK_EQ(got.size(), expectedStream().size());
+  CHECK(got == expectedStream());
+  CHECK(hangUp(modemTerminal()));
+  CHECK_STR(modemTerminal().command("ATE1"), "OK");
+}
+
+// Терминал не читает, выдача стоит посередине; звонок ждет ее конца
+TEST(call_waits_for_history_dump) {
+  CHECK_STR(modemTerminal().command("ATS0=1"), "OK");
+  modemTerminal().write("AT$HIST\r");
+  usleep(300000);
+  int caller = tcpConnect(modemPort(6400));
+  CHECK(caller >= 0);
+  usleep(800000);
+
+  std::string got;
+  char buf[65536];
+  std::string last = numberedLine(LINES - 1);
+  unsigned long started = millis();
+  while (got.find("CONNECT") == std::string::npos && millis() - started < 10000)
+    got.append(buf, modemTerminal().read(buf, sizeof(buf), 100));
+  size_t end = got.find(last);
+  CHECK(end != std::string::npos);
+  CHECK(got.find("RING") > end);
+  CHECK(got.find("CONNECT") > end);
+  CHECK(hangUp(modemTerminal()));
+  close(caller);
+  CHECK_STR(modemTerminal().command("ATS0=0"), "OK");
+}
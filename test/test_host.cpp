@@ -0,0 +1,35 @@
+// Хост-сборка целиком: загрузка, AT, звонок на эхо-сервер, отбой
+
+#include "check.h"
+#include "harness.h"
+
+#include <host.h>
+
+TEST(answers_at) {
+  CHECK_STR(modemTerminal().command("AT"), "OK");
+  std::string info = modemTerminal().command("ATI");
+  CHECK_STR(info, "WIFI: CONNECTED");
+  CHECK_STR(info, "IP: 127.0.0.1");
+}
+
+TEST(listeners_bound) {
+  modemTerminal();
+  CHECK(modemPort(6400) != 0);
+  CHECK(modemPort(80) != 0);
+  CHECK(modemPort(81) != 0);
+}
+
+TEST(dial_echo_hangup) {
+  TcpServer echo(echoHandler);
+  CHECK(dialLocal(modemTerminal(), echo.port()));
+  modemTerminal().write("hello, bbs");
+  CHECK(modemTerminal().expect("hello, bbs"));
+  CHECK(hangUp(modemTerminal()));
+  CHECK_STR(modemTerminal().command("ATI"), "CALL STATUS: NOT CONNECTED");
+}
+
+TEST(settings_survive_write) {
+  CHECK_STR(modemTerminal().command("AT$SSID=hostnet"), "OK");
+  CHECK_STR(modemTerminal().command("AT&W"), "OK");
+  CHECK_STR(modemTerminal().command("AT$SSID?"), "hostnet");
+}
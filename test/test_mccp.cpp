@@ -0,0 +1,132 @@
+// MCCP2 против заглушки сервера: поток сжат zlib (deflate), режется на
+// куски как попало; после конца сжатия идет обычный telnet
+
+#include "check.h"
+#include "harness.h"
+
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static const uint8_t WILL_COMPRESS2[] = {255, 251, 86};
+static const uint8_t DO_COMPRESS2[] = {255, 253, 86};
+static const uint8_t DONT_COMPRESS2[] = {255, 254, 86};
+static const uint8_t START_COMPRESS2[] = {255, 250, 86, 255, 240};
+
+// Текст без 0xFF и без одиночных CR: в NVT доходит как есть
+static std::string payload(size_t n) {
+  std::string text;
+  for (int i = 0; text.size() < n; i++) text += "MCCP LINE " + std::to_string(i) + " ======== =========\r\n";
+  return text;
+}
+
+static std::vector<uint8_t> deflateAll(const std::string &text) {
+  uLongf len = compressBound(text.size());
+  std::vector<uint8_t> out(len);
+  compress2(out.data(), &len, (const Bytef *)text.data(), text.size(), 9);
+  out.resize(len);
+  return out;
+}
+
+// Ответ модема на WILL COMPRESS2: три байта DO или DONT
+static std::string negotiate(int fd) {
+  sendAll(fd, WILL_COMPRESS2, sizeof(WILL_COMPRESS2));
+  uint8_t reply[3];
+  if (recvAll(fd, reply, sizeof(reply), 2000) != sizeof(reply)) return "none";
+  if (memcmp(reply, DO_COMPRESS2, 3) == 0) return "do";
+  if (memcmp(reply, DONT_COMPRESS2, 3) == 0) return "dont";
+  return "other";
+}
+
+// ATI целиком: command() остановился бы на "0 ERRORS" в строке MCCP
+static std::string modemInfo() {
+  modemTerminal().write("ATI\r");
+  return modemTerminal().drain(300);
+}
+
+// Все, что пришло в терминал до метки включительно
+static std::string readUntil(const std::string &mark, unsigned timeoutMs) {
+  std::string got;
+  char buf[65536];
+  unsigned long started = millis();
+  while (got.find(mark) == std::string::npos && millis() - started < timeoutMs)
+    got.append(buf, modemTerminal().read(buf, sizeof(buf), 100));
+  return got;
+}
+
+TEST(compressed_stream_arrives_intact) {
+  CHECK_STR(modemTerminal().command("ATNET1"), "OK"); // telnet: без него нет и MCCP
+  std::string text = payload(256 * 1024);
+  std::vector<uint8_t> packed = deflateAll(text);
+  std::string answer;
+  TcpServer server([&](int fd) {
+    answer = negotiate(fd);
+    if (answer != "do") return;
+    sendAll(fd, START_COMPRESS2, sizeof(START_COMPRESS2));
+    // Куски от 1 байта до 4 КБ: заголовок zlib и блоки режутся где угодно
+    size_t at = 0, step = 1;
+    while (at < packed.size()) {
+      size_t n = std::min(step, packed.size() - at);
+      if (!sendAll(fd, packed.data() + at, n)) return;
+      at += n;
+      step = step * 3 % 4093 + 1;
+      if (step < 16) usleep(1000);
+    }
+    const char tail[] = "PLAIN-TAIL\r\n";
+    sendAll(fd, tail, sizeof(tail) - 1);
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+
+  long streams = reportValue(modemInfo(), "MCCP:", "STREAMS");
+  CHECK(dialLocal(modemTerminal(), server.port()));
+  std::string got = readUntil("PLAIN-TAIL\r\n", 10000);
+  CHECK(answer == "do");
+  CHECK_EQ(got.size(), text.size() + 12);
+  CHECK(got.compare(0, text.size(), text) == 0);
+  CHECK(hangUp(modemTerminal()));
+
+  std::string info = modemInfo();
+  CHECK_EQ(reportValue(info, "MCCP:", "STREAMS"), std::max(streams, 0L) + 1);
+  CHECK_EQ(reportValue(info, "MCCP:", "ERRORS"), 0L);
+  CHECK_STR(info, "MCCP: IDLE"); // сервер закончил поток
+}
+
+TEST(refused_when_disabled) {
+  CHECK_STR(modemTerminal().command("ATNET1"), "OK"); // telnet: без него нет и MCCP
+  std::string answer;
+  TcpServer server([&](int fd) {
+    answer = negotiate(fd);
+    const char text[] = "UNCOMPRESSED\r\n";
+    sendAll(fd, text, sizeof(text) - 1);
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+  CHECK_STR(modemTerminal().command("AT$MCCP=0"), "OK");
+  CHECK(dialLocal(modemTerminal(), server.port()));
+  CHECK(modemTerminal().expect("UNCOMPRESSED"));
+  CHECK(answer == "dont");
+  CHECK(hangUp(modemTerminal()));
+  CHECK_STR(modemTerminal().command("AT$MCCP=1"), "OK");
+}
+
+// Испорченный поток не восстановить: соединение рвется, ошибка в ATI
+TEST(corrupt_stream_drops_call) {
+  CHECK_STR(modemTerminal().command("ATNET1"), "OK"); // telnet: без него нет и MCCP
+  TcpServer server([&](int fd) {
+    if (negotiate(fd) != "do") return;
+    sendAll(fd, START_COMPRESS2, sizeof(START_COMPRESS2));
+    const uint8_t junk[] = {0x78, 0x9C, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x11, 0x22, 0x33};
+    sendAll(fd, junk, sizeof(junk));
+    char c;
+    while (recv(fd, &c, 1, 0) > 0) {}
+  });
+  long errors = reportValue(modemInfo(), "MCCP:", "ERRORS");
+  CHECK(dialLocal(modemTerminal(), server.port()));
+  CHECK(modemTerminal().expect("NO CARRIER", 5000));
+  modemTerminal().drain(100);
+  CHECK_EQ(reportValue(modemInfo(), "MCCP:", "ERRORS"), std::max(errors, 0L) + 1);
+}
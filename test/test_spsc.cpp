@@ -0,0 +1,105 @@
+// SpscRing: писатель и читатель в разных потоках, блоки случайной длины,
+// переход через конец буфера. Читатель проверяет каждый байт. Пустое или
+// полное кольцо - yield(), иначе на одном ядре поток крутится весь квант.
+
+#include "check.h"
+
+#include <modem_core.h>
+
+#include <atomic>
+#include <random>
+#include <thread>
+
+static const size_t STRESS_BYTES = 32 * 1024 * 1024;
+
+static uint8_t pattern(size_t i) {
+  return (uint8_t)(i * 131 + (i >> 8));
+}
+
+TEST(two_threads_blocks) {
+  static SpscRing<4096> ring;
+  std::thread writer([] {
+    std::mt19937 rnd(1);
+    uint8_t chunk[1500];
+    size_t sent = 0;
+    while (sent < STRESS_BYTES) {
+      size_t n = std::min<size_t>(1 + rnd() % sizeof(chunk), STRESS_BYTES - sent);
+      for (size_t i = 0; i < n; i++) chunk[i] = pattern(sent + i);
+      size_t done = 0;
+      while (done < n) {
+        size_t w = ring.write(chunk + done, n - done);
+        if (w == 0) std::this_thread::yield();
+        done += w;
+      }
+      sent += n;
+    }
+  });
+  size_t got = 0;
+  size_t bad = STRESS_BYTES;
+  std::mt19937 rnd(2);
+  while (got < STRESS_BYTES) {
+    size_t len;
+    const uint8_t *p = ring.readPtr(len);
+    if (len == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    len = std::min<size_t>(len, 1 + rnd() % 700);
+    for (size_t i = 0; i < len && bad == STRESS_BYTES; i++) {
+      if (p[i] != pattern(got + i)) bad = got + i;
+    }
+    ring.consume(len);
+    got += len;
+  }
+  writer.join();
+  CHECK_EQ(bad, STRESS_BYTES);
+  CHECK(ring.empty());
+}
+
+// Побайтовый путь: write() по байту и get(), как serialTask и loop()
+TEST(two_threads_bytes) {
+  static SpscRing<256> ring;
+  const size_t total = 4 * 1024 * 1024;
+  std::thread writer([total] {
+    for (size_t i = 0; i < total;) {
+      uint8_t c = pattern(i);
+      if (ring.write(&c, 1) == 1) i++;
+      else std::this_thread::yield();
+    }
+  });
+  size_t got = 0, bad = total;
+  while (got < total) {
+    uint8_t c;
+    if (!ring.get(c)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (c != pattern(got) && bad == total) bad = got;
+    got++;
+  }
+  writer.join();
+  CHECK_EQ(bad, total);
+}
+
+// used() из любого потока не выходит за размер буфера
+TEST(used_stays_in_range) {
+  static SpscRing<1024> ring;
+  std::atomic<bool> stop{false};
+  std::thread writer([&] {
+    uint8_t chunk[300] = {};
+    while (!stop) ring.write(chunk, sizeof(chunk));
+  });
+  std::thread reader([&] {
+    while (!stop) {
+      size_t len;
+      ring.readPtr(len);
+      ring.consume(len);
+    }
+  });
+  size_t worst = 0;
+  for (int i = 0; i < 2000000; i++) worst = std::max(worst, ring.used());
+  stop = true;
+  writer.join();
+  reader.join();
+  CHECK(worst <= 1024);
+}
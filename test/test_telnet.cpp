@@ -0,0 +1,140 @@
+// TelnetParser: случайная нарезка потока, CR NUL, согласование опций
+
+#include "check.h"
+
+#include "modem_core.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Приемник с интерфейсом RingBuffer (write/put)
+struct Sink {
+  std::string data;
+  void write(const uint8_t *p, size_t n) { data.append((const char *)p, n); }
+  void put(uint8_t c) { data += (char)c; }
+};
+
+static std::vector<uint8_t> bytes(std::initializer_list<int> list) {
+  return std::vector<uint8_t>(list.begin(), list.end());
+}
+
+static void append(std::vector<uint8_t> &v, const std::vector<uint8_t> &more) {
+  v.insert(v.end(), more.begin(), more.end());
+}
+
+static void append(std::vector<uint8_t> &v, const char *text) {
+  v.insert(v.end(), text, text + strlen(text));
+}
+
+// Поток BBS: текст, экранированные 0xFF, согласование, TTYPE, CR NUL
+static std::vector<uint8_t> sampleStream() {
+  std::vector<uint8_t> s;
+  append(s, bytes({T_IAC, T_WILL, TO_ECHO, T_IAC, T_WILL, TO_SGA, T_IAC, T_DO, TO_TTYPE, T_IAC, T_DO, TO_NAWS}));
+  append(s, "Welcome!\r\n");
+  append(s, bytes({T_IAC, T_SB, TO_TTYPE, 1, T_IAC, T_SE}));
+  append(s, "Login: \r");
+  append(s, bytes({0}));
+  append(s, bytes({0xFF, 0xFF, 'x', T_IAC, T_NOP, 'y', T_IAC, T_DO, 99}));
+  for (int i = 0; i < 200; i++) append(s, "line of plain text with no commands at all\r\n");
+  append(s, bytes({'a', '\r', 0, 'b', 0, 'c'}));
+  return s;
+}
+
+static void parseWhole(const std::vector<uint8_t> &s, Sink &out, Sink &reply) {
+  TelnetParser p;
+  p.parse(s.data(), s.size(), out, reply);
+}
+
+TEST(random_fragmentation_matches_whole) {
+  std::vector<uint8_t> s = sampleStream();
+  Sink wholeOut, wholeReply;
+  parseWhole(s, wholeOut, wholeReply);
+
+  std::mt19937 rng(1234);
+  for (int round = 0; round < 500; round++) {
+    TelnetParser p;
+    Sink out, reply;
+    size_t pos = 0;
+    while (pos < s.size()) {
+      // Чаще всего - куски по 1-3 байта, чтобы резать каждую команду
+      size_t n = rng() % 4 == 0 ? 1 + rng() % 64 : 1 + rng() % 3;
+      if (n > s.size() - pos) n = s.size() - pos;
+      p.parse(s.data() + pos, n, out, reply);
+      pos += n;
+    }
+    CHECK(out.data == wholeOut.data);
+    CHECK(reply.data == wholeReply.data);
+  }
+}
+
+TEST(data_and_replies) {
+  std::vector<uint8_t> s = sampleStream();
+  Sink out, reply;
+  parseWhole(s, out, reply);
+
+  CHECK_STR(out.data, "Welcome!\r\nLogin: \r\xFFxy");
+  CHECK(out.data.find("Login: \r\0", 0, 9) == std::string::npos);
+  // NUL после CR снят, одиночный NUL остался
+  CHECK(out.data.size() >= 5);
+  CHECK(out.data.substr(out.data.size() - 5) == std::string("a\rb\0c", 5));
+
+  // DO ECHO/SGA в ответ на WILL, WILL TTYPE/NAWS + размер окна, TTYPE IS,
+  // WONT на неизвестную опцию
+  std::string expect = std::string("\xFF\xFD\x01\xFF\xFD\x03\xFF\xFB\x18\xFF\xFB\x1F", 12);
+  expect += std::string("\xFF\xFA\x1F\x00\x50\x00\x18\xFF\xF0", 9);
+  CHECK(reply.data.compare(0, 12, expect, 0, 12) == 0);
+  CHECK_STR(reply.data, expect.substr(12));
+  CHECK_STR(reply.data, std::string("\xFF\xFA\x18\x00" "ANSI\xFF\xF0", 10));
+  CHECK_STR(reply.data, std::string("\xFF\xFC\x63", 3));
+}
+
+TEST(cr_nul_stripped_across_split) {
+  TelnetParser p;
+  Sink out, reply;
+  const uint8_t a[] = {'o', 'k', '\r'};
+  const uint8_t b[] = {0, 'n', 0, '\r', 0, 0};
+  p.parse(a, sizeof(a), out, reply);
+  p.parse(b, sizeof(b), out, reply);
+  CHECK(out.data == std::string("ok\rn\0\r\0", 7));
+}
+
+TEST(cr_nul_kept_in_binary) {
+  TelnetParser p;
+  Sink out, reply;
+  const uint8_t will[] = {T_IAC, T_WILL, TO_BINARY};
+  p.parse(will, sizeof(will), out, reply);
+  CHECK(p.remoteEnabled(TO_BINARY));
+  const uint8_t data[] = {'\r', 0, 'z'};
+  p.parse(data, sizeof(data), out, reply);
+  CHECK(out.data == std::string("\r\0z", 3));
+}
+
+TEST(cr_lf_untouched) {
+  TelnetParser p;
+  Sink out, reply;
+  const uint8_t data[] = {'a', '\r', '\n', 'b'};
+  p.parse(data, sizeof(data), out, reply);
+  CHECK(out.data == "a\r\nb");
+}
+
+TEST(no_reply_loop_on_repeated_option) {
+  TelnetParser p;
+  Sink out, reply;
+  const uint8_t twice[] = {T_IAC, T_WILL, TO_SGA, T_IAC, T_WILL, TO_SGA};
+  p.parse(twice, sizeof(twice), out, reply);
+  CHECK(reply.data == std::string("\xFF\xFD\x03", 3));
+}
+
+TEST(compress_start_stops_parse) {
+  TelnetParser p;
+  p.acceptCompress = true;
+  Sink out, reply;
+  std::vector<uint8_t> s = bytes({T_IAC, T_WILL, TO_COMPRESS2, 'h', 'i', T_IAC, T_SB, TO_COMPRESS2, T_IAC, T_SE, 0x78, 0x9C});
+  size_t consumed = 0;
+  p.parse(s.data(), s.size(), out, reply, &consumed);
+  CHECK_EQ(consumed, s.size() - 2);
+  CHECK(p.takeCompressStart());
+  CHECK(out.data == "hi");
+  CHECK(reply.data == std::string("\xFF\xFD\x56", 3));
+}
@@ -0,0 +1,122 @@
+// TLS (ATDTS) против сервера на OpenSSL с самоподписанным сертификатом,
+// созданным при запуске: возобновление сессии считается, только когда
+// сервер его принял
+
+#include "check.h"
+#include "harness.h"
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// ATI целиком: command() остановился бы на "ERROR" внутри отчета
+static std::string modemInfo() {
+  modemTerminal().write("ATI\r");
+  return modemTerminal().drain(300);
+}
+
+// resumable = false - без кэша сессий и без tickets: каждое рукопожатие полное
+static SSL_CTX *serverContext(bool resumable) {
+  EVP_PKEY *key = EVP_EC_gen("P-256");
+  X509 *cert = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, key);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"127.0.0.1", -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  X509_sign(cert, key, EVP_sha256());
+
+  SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX_use_certificate(ctx, cert);
+  SSL_CTX_use_PrivateKey(ctx, key);
+  SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION); // как у модема
+  if (resumable) {
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"test", 4);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  }
+  X509_free(cert);
+  EVP_PKEY_free(key);
+  return ctx;
+}
+
+// Сервер: рукопожатие, приветствие, дальше читает до отбоя.
+// reused - сколько рукопожатий OpenSSL засчитал как возобновление.
+struct TlsServer {
+  explicit TlsServer(bool resumable)
+      : ctx(serverContext(resumable)), tcp([this](int fd) { serve(fd); }) {}
+  ~TlsServer() { SSL_CTX_free(ctx); }
+
+  void serve(int fd) {
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) == 1) {
+      handshakes++;
+      if (SSL_session_reused(ssl)) reused++;
+      const char hello[] = "HELLO OVER TLS\r\n";
+      SSL_write(ssl, hello, sizeof(hello) - 1);
+      char buf[256];
+      while (SSL_read(ssl, buf, sizeof(buf)) > 0) {}
+    }
+    SSL_free(ssl);
+    ERR_clear_error();
+  }
+
+  SSL_CTX *ctx;
+  std::atomic<int> handshakes{0};
+  std::atomic<int> reused{0};
+  TcpServer tcp; // последним: разрушается первым, пока ctx еще жив
+};
+
+static bool dialTls(TlsServer &server) {
+  if (!dialLocal(modemTerminal(), server.tcp.port(), "ATDTS ")) return false;
+  bool hello = modemTerminal().expect("HELLO OVER TLS");
+  return hangUp(modemTerminal()) && hello;
+}
+
+TEST(ati_says_certificates_not_verified) {
+  CHECK_STR(modemInfo(), "TLS CERTIFICATES: NOT VERIFIED");
+}
+
+TEST(resume_counted_when_server_accepts) {
+  TlsServer server(true);
+  std::string before = modemInfo();
+  long resumed = std::max(reportValue(before, "TLS:", "RESUMED"), 0L);
+  long offered = std::max(reportValue(before, "TLS:", "OFFERED"), 0L);
+
+  CHECK(dialTls(server));
+  CHECK(dialTls(server));
+  CHECK_EQ((int)server.handshakes, 2);
+  CHECK_EQ((int)server.reused, 1);
+
+  std::string info = modemInfo();
+  CHECK_EQ(reportValue(info, "TLS:", "RESUMED"), resumed + 1);
+  CHECK_EQ(reportValue(info, "TLS:", "OFFERED"), offered + 1);
+  CHECK_STR(info, "TLS RESUMED:");
+}
+
+// Сервер без кэша: сессия предложена, но рукопожатие полное
+TEST(refused_resume_not_counted) {
+  TlsServer server(false);
+  std::string before = modemInfo();
+  long resumed = std::max(reportValue(before, "TLS:", "RESUMED"), 0L);
+  long offered = std::max(reportValue(before, "TLS:", "OFFERED"), 0L);
+
+  CHECK(dialTls(server));
+  CHECK(dialTls(server));
+  CHECK(dialTls(server));
+  CHECK_EQ((int)server.handshakes, 3);
+  CHECK_EQ((int)server.reused, 0);
+
+  std::string info = modemInfo();
+  CHECK_EQ(reportValue(info, "TLS:", "RESUMED"), resumed);
+  CHECK_EQ(reportValue(info, "TLS:", "OFFERED"), offered + 2);
+}
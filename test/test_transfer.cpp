@@ -0,0 +1,60 @@
+// TransferDetector: ZMODEM по заголовку, X/YMODEM только после запроса
+// приемника; направления не смешиваются
+
+#include "check.h"
+
+#include "modem_core.h"
+
+#include <string>
+
+static TransferProto feed(TransferDetector &d, const std::string &s, bool toNet) {
+  return d.feed((const uint8_t *)s.data(), s.size(), toNet);
+}
+
+static const std::string ZRQINIT = std::string("rz\r**\x18" "B00000000000000\r\n", 21);
+
+TEST(zmodem_header_any_split) {
+  for (size_t cut = 0; cut <= ZRQINIT.size(); cut++) {
+    TransferDetector d;
+    TransferProto a = feed(d, ZRQINIT.substr(0, cut), false);
+    TransferProto b = feed(d, ZRQINIT.substr(cut), false);
+    CHECK(a == XFER_ZMODEM || b == XFER_ZMODEM);
+  }
+}
+
+TEST(zmodem_header_not_mixed_across_directions) {
+  TransferDetector d;
+  CHECK(feed(d, "**", false) == XFER_NONE);
+  CHECK(feed(d, "\x18" "B0", true) == XFER_NONE);
+}
+
+// Блок 1 и его дополнение посреди ANSI-графики: 01 01 FE без запроса
+TEST(art_is_not_xmodem) {
+  TransferDetector d;
+  const char raw[] = "\x1b[1;37m\xdb\xdb\x01\x01\xfe\xb0\xb1\x02\x00\xff\x1b[0m";
+  std::string art(raw, sizeof(raw) - 1);
+  CHECK(feed(d, "hello\r", true) == XFER_NONE);
+  CHECK(feed(d, art, false) == XFER_NONE);
+}
+
+TEST(xmodem_after_crc_request) {
+  TransferDetector d;
+  CHECK(feed(d, "Start your receiver\r\n", false) == XFER_NONE);
+  CHECK(feed(d, "C", true) == XFER_NONE);
+  CHECK(feed(d, std::string("\x01\x01\xfe", 3), false) == XFER_XYMODEM);
+}
+
+// Выгрузка: запрос NAK приходит из сети, блок 0 YMODEM (STX) - от терминала
+TEST(ymodem_upload_after_nak) {
+  TransferDetector d;
+  CHECK(feed(d, std::string("\x15", 1), false) == XFER_NONE);
+  CHECK(feed(d, std::string("\x02\x00", 2), true) == XFER_NONE);
+  CHECK(feed(d, std::string("\xff", 1), true) == XFER_XYMODEM);
+}
+
+// Запрос должен быть последним, что приемник прислал
+TEST(request_must_be_last_byte) {
+  TransferDetector d;
+  CHECK(feed(d, "CD", true) == XFER_NONE);
+  CHECK(feed(d, std::string("\x01\x01\xfe", 3), false) == XFER_NONE);
+}
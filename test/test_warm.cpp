@@ -0,0 +1,125 @@
+// Прогрев быстрых номеров (AT$WARM) против локального сервера: соединение
+// отдается ATDS, один адрес не прогревается чаще WARM_HOST_GAP_MS, прогрев
+// не освежает запись кэша DNS
+
+#include "check.h"
+#include "harness.h"
+
+#include <host.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Сервер-BBS: заставка сразу после connect, дальше читает до отбоя
+static void bannerHandler(int fd) {
+  const char banner[] = "WELCOME TO WARM BBS\r\n";
+  sendAll(fd, banner, sizeof(banner) - 1);
+  char c;
+  while (recv(fd, &c, 1, 0) > 0) {}
+}
+
+static std::string speedDial(int n, const std::string &host, uint16_t port) {
+  return modemTerminal().command("AT&Z" + std::to_string(n) + "=" + host + ":" + std::to_string(port));
+}
+
+// Звонок ATDSn до CONNECT и заставки, потом отбой. stopWarm - выключить
+// прогрев до ATH: пока идет звонок, пул новых соединений не открывает, и
+// адрес не попадает в учет WARM_HOST_GAP_MS для следующих тестов.
+static bool dialSpeed(int n, bool stopWarm = false) {
+  modemTerminal().drain(20);
+  modemTerminal().write("ATDS" + std::to_string(n) + "\r");
+  bool ok = modemTerminal().expect("CONNECT", 5000) && modemTerminal().expect("WELCOME TO WARM BBS");
+  if (!stopWarm) return hangUp(modemTerminal()) && ok;
+  usleep(100000);
+  modemTerminal().write("+++");
+  ok = modemTerminal().expect("OK", 3000) && ok;
+  ok = modemTerminal().command("AT$WARM=0").find("OK") != std::string::npos && ok;
+  modemTerminal().write("ATH\r");
+  ok = modemTerminal().expect("NO CARRIER", 3000) && ok;
+  modemTerminal().drain(50);
+  return ok;
+}
+
+static bool waitAccepted(TcpServer &server, unsigned count, unsigned timeoutMs) {
+  for (unsigned waited = 0; server.accepted() < count && waited < timeoutMs; waited += 50) usleep(50000);
+  return server.accepted() >= count;
+}
+
+static long warmStat(const char *label) {
+  return reportValue(modemTerminal().command("AT$WARM?"), "WARM POOL:", label);
+}
+
+// Заставка, присланная прогретому соединению, доходит до терминала
+TEST(speed_dial_takes_warm_connection) {
+  TcpServer bbs(bannerHandler);
+  CHECK_STR(speedDial(0, "127.0.0.1", bbs.port()), "OK");
+  CHECK(dialSpeed(0));
+  CHECK_EQ(bbs.accepted(), 1u);
+
+  long hits = warmStat("HITS");
+  CHECK_STR(modemTerminal().command("AT$WARM=1"), "OK");
+  CHECK(waitAccepted(bbs, 2, 3000));
+  usleep(600000); // проверка пула раз в WARM_CHECK_MS
+  CHECK_STR(modemTerminal().command("AT$WARM?"), "READY");
+
+  CHECK(dialSpeed(0, true));
+  CHECK_EQ(bbs.accepted(), 2u); // звонок без нового connect()
+  CHECK_EQ(warmStat("HITS"), hits + 1);
+  CHECK_STR(modemTerminal().command("AT&Z0="), "OK");
+}
+
+// Два быстрых номера на одну BBS: прогревается только один
+TEST(one_warm_dial_per_host) {
+  TcpServer bbs(bannerHandler);
+  CHECK_STR(speedDial(1, "127.0.0.1", bbs.port()), "OK");
+  CHECK_STR(speedDial(2, "127.0.0.1", bbs.port()), "OK");
+  CHECK(dialSpeed(1));
+  CHECK(dialSpeed(2));
+  CHECK_EQ(bbs.accepted(), 2u);
+
+  long limited = warmStat("LIMITED");
+  CHECK_STR(modemTerminal().command("AT$WARM=2"), "OK");
+  CHECK(waitAccepted(bbs, 3, 3000));
+  usleep(1500000);
+  CHECK_EQ(bbs.accepted(), 3u);
+  CHECK_EQ(warmStat("LIMITED"), limited + 1);
+  CHECK_STR(modemTerminal().command("AT$WARM?"), "1: 127.0.0.1"); // равные счетчики: первый номер
+
+  CHECK(dialSpeed(1, true));
+  CHECK_EQ(bbs.accepted(), 3u);
+  CHECK_STR(modemTerminal().command("AT&Z1="), "OK");
+  CHECK_STR(modemTerminal().command("AT&Z2="), "OK");
+}
+
+// Звонок в закрытый порт: резолв, connect() получает отказ, NO ANSWER
+static bool dialRefused(const std::string &host) {
+  modemTerminal().drain(20);
+  modemTerminal().write("ATDT" + host + ":1\r");
+  return modemTerminal().expect("NO ANSWER", 3000);
+}
+
+// Кэш DNS на 8 имен вытесняет самое давнее по lastUsed. Прогрев берет адрес
+// из кэша, но запись не освежает: вытесняется имя прогретой BBS, а не
+// набранное после него вручную.
+TEST(warm_lookup_keeps_dns_entry_age) {
+  TcpServer bbs(bannerHandler);
+  hostResolverAdd("warm.bbs", htonl(INADDR_LOOPBACK));
+  for (int i = 0; i < 8; i++) hostResolverAdd(("other" + std::to_string(i) + ".bbs").c_str(), htonl(INADDR_LOOPBACK));
+
+  CHECK_STR(speedDial(3, "warm.bbs", bbs.port()), "OK");
+  unsigned accepted = bbs.accepted();
+  CHECK(dialSpeed(3));
+  CHECK(dialRefused("other0.bbs"));
+  CHECK_STR(modemTerminal().command("AT$WARM=1"), "OK");
+  CHECK(waitAccepted(bbs, accepted + 2, 3000)); // прогрев: адрес warm.bbs из кэша
+  CHECK_EQ(hostResolverQueries("warm.bbs"), 1u);
+  CHECK_STR(modemTerminal().command("AT$WARM=0"), "OK");
+
+  for (int i = 1; i < 8; i++) CHECK(dialRefused("other" + std::to_string(i) + ".bbs"));
+  CHECK(dialRefused("other0.bbs"));
+  CHECK_EQ(hostResolverQueries("other0.bbs"), 1u);
+  CHECK(dialRefused("warm.bbs"));
+  CHECK_EQ(hostResolverQueries("warm.bbs"), 2u);
+}
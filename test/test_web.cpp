@@ -0,0 +1,112 @@
+// Веб-интерфейс: текст пользователя в HTML и JSON экранируется, веб-терминал
+// по умолчанию только показывает, декодер страницы следует ATPET
+
+#include "check.h"
+#include "harness.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void joinNetwork(const std::string &name) {
+  CHECK_STR(modemTerminal().command("AT$SSID=" + name), "OK");
+  CHECK_STR(modemTerminal().command("ATC1"), "OK");
+  for (int i = 0; i < 50 && modemTerminal().command("ATI").find("WIFI: CONNECTED") == std::string::npos; i++) usleep(20000);
+}
+
+TEST(root_escapes_ssid) {
+  joinNetwork("<script>alert('x')</script>&co");
+  std::string page = httpGet(modemPort(80), "/");
+  CHECK_STR(page, "HTTP/1.1 200");
+  CHECK_STR(page, "&lt;script&gt;alert(&#39;x&#39;)&lt;/script&gt;&amp;co");
+  CHECK(page.find("<script>alert") == std::string::npos);
+}
+
+TEST(status_json_escapes_ssid) {
+  joinNetwork("a\"b\\c");
+  std::string json = httpGet(modemPort(80), "/api/status");
+  CHECK_STR(json, "\"ssid\":\"a\\\"b\\\\c\"");
+}
+
+TEST(web_terminal_view_only_by_default) {
+  CHECK_STR(modemTerminal().command("AT$WS?"), "1");
+  CHECK_STR(modemTerminal().command("AT$WS=2"), "OK");
+  CHECK_STR(modemTerminal().command("AT&W"), "OK");
+  CHECK_STR(modemTerminal().command("ATZ"), "OK");
+  CHECK_STR(modemTerminal().command("AT$WS?"), "2");
+  CHECK_STR(modemTerminal().command("AT&F"), "OK");
+  CHECK_STR(modemTerminal().command("AT$WS?"), "1");
+  CHECK_STR(modemTerminal().command("AT$WS=3"), "ERROR");
+}
+
+// Минимальный клиент WebSocket: рукопожатие и кадр с маской
+static int wsOpen() {
+  int fd = tcpConnect(modemPort(81));
+  if (fd < 0) return -1;
+  const char req[] = "GET / HTTP/1.1\r\nHost: x\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+  sendAll(fd, req, sizeof(req) - 1);
+  char reply[512];
+  size_t got = recvAll(fd, reply, 129, 1000);
+  if (got < 12 || memcmp(reply + 9, "101", 3) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void wsSendText(int fd, const char *text) {
+  size_t n = strlen(text);
+  uint8_t frame[64] = {0x81, (uint8_t)(0x80 | n), 1, 2, 3, 4};
+  for (size_t i = 0; i < n; i++) frame[6 + i] = text[i] ^ frame[2 + i % 4];
+  sendAll(fd, frame, 6 + n);
+}
+
+TEST(browser_input_needs_interactive_mode) {
+  std::atomic<size_t> received{0};
+  TcpServer sink([&](int fd) {
+    char buf[256];
+    for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) break;
+      received += n;
+    }
+  });
+  CHECK(dialLocal(modemTerminal(), sink.port()));
+  int ws = wsOpen();
+  CHECK(ws >= 0);
+  usleep(100000);
+  wsSendText(ws, "view");
+  usleep(300000);
+  CHECK_EQ((size_t)received, (size_t)0);
+  close(ws);
+
+  modemTerminal().write("+++");
+  usleep(1200000);
+  CHECK(modemTerminal().expect("OK"));
+  CHECK_STR(modemTerminal().command("AT$WS=2"), "OK");
+  modemTerminal().write("ATO\r");
+  CHECK(modemTerminal().expect("CONNECT"));
+  size_t before = received; // "++" от перехода в командный режим
+  ws = wsOpen();
+  CHECK(ws >= 0);
+  usleep(100000);
+  wsSendText(ws, "typed");
+  for (int i = 0; i < 50 && received < before + 5; i++) usleep(20000);
+  close(ws);
+  CHECK_EQ((size_t)received, before + 5);
+  CHECK(hangUp(modemTerminal()));
+  CHECK_STR(modemTerminal().command("AT$WS=1"), "OK");
+}
+
+TEST(page_decoder_follows_charset) {
+  CHECK_STR(modemTerminal().command("ATPET0"), "OK");
+  CHECK_STR(httpGet(modemPort(80), "/term"), "new TextDecoder('utf-8')");
+  CHECK_STR(modemTerminal().command("ATPET1"), "OK");
+  std::string page = httpGet(modemPort(80), "/term");
+  CHECK(page.find("TextDecoder") == std::string::npos);
+  CHECK_STR(page, "var m=[0,1,2,");
+  CHECK_STR(modemTerminal().command("ATPET3"), "OK");
+  CHECK_STR(httpGet(modemPort(80), "/term"), "new TextDecoder('utf-8')");
+  CHECK_STR(modemTerminal().command("ATPET0"), "OK");
+}